@@ -29,6 +29,7 @@
 #define CPUID_SSSE3    (1 <<  9)
 #define CPUID_SSE41    (1 << 19)
 #define CPUID_SSE42    (1 << 20)
+#define CPUID_FMA3     (1 << 12)
 #define CPUID_AVX     ((1 << 27) | (1 << 28))
 #define CPUID_AVX2    ((1 <<  5) | (1 <<  3) | (1 << 8))
 
@@ -74,6 +75,7 @@ static int GetCPUFeatures()
 			const unsigned long long xcrFeatureMask = _xgetbv(_XCR_XFEATURE_ENABLED_MASK);
 			if ((xcrFeatureMask & 0x6) == 0x6) {
 				nCPUFeatures |= CPUInfo::CPU_AVX;
+				if (nBuff[2] & CPUID_FMA3) nCPUFeatures |= CPUInfo::CPU_FMA3;
 
 				if (nHighestFeature >= 7) {
 					__cpuid(nBuff, 7);
@@ -100,6 +102,7 @@ static const int  nCPUFeatures = GetCPUFeatures();
 static const bool bSSSE3       = !!(nCPUFeatures & CPUInfo::CPU_SSSE3);
 static const bool bSSE4        = !!(nCPUFeatures & CPUInfo::CPU_SSE4);
 static const bool bAVX2        = !!(nCPUFeatures & CPUInfo::CPU_AVX2);
+static const bool bFMA3        = !!(nCPUFeatures & CPUInfo::CPU_FMA3);
 
 static DWORD GetProcessorNumber()
 {
@@ -118,4 +121,5 @@ namespace CPUInfo {
 	const bool HaveSSSE3()           { return bSSSE3; }
 	const bool HaveSSE4()            { return bSSE4; }
 	const bool HaveAVX2()            { return bAVX2; }
+	const bool HaveFMA3()            { return bFMA3; }
 } // namespace CPUInfo
@@ -40,6 +40,7 @@ namespace CPUInfo {
 		CPU_SSE42    = 0x0200,
 		CPU_AVX      = 0x4000,
 		CPU_AVX2     = 0x8000,
+		CPU_FMA3     = 0x10000,
 	};
 
 	const int GetType();
@@ -49,4 +50,5 @@ namespace CPUInfo {
 	const bool HaveSSSE3();
 	const bool HaveSSE4();
 	const bool HaveAVX2();
+	const bool HaveFMA3();
 } // namespace CPUInfo
@@ -20,6 +20,10 @@
 
 #include "stdafx.h"
 #include <ppl.h>
+#include <mutex>
+#include <tuple>
+#include <immintrin.h>
+#include "CPUInfo.h"
 #include "ResampleRGB32.h"
 
 // based on https://github.com/uploadcare/pillow-simd/blob/3.4.x/libImaging/Resample.c
@@ -218,41 +222,273 @@ int precompute_coeffs(int inSize, int outSize, filter_t* filterp, int **boundsp,
 	return kmax;
 }
 
-int normalize_coeffs_8bpc(int outSize, int kmax, double *prekk, INT32 **kkp)
+// 16-bit coefficients for the SIMD passes. The weights of our filters stay
+// within (-2.0, 2.0), so 14 bits of precision still fit signed 16-bit.
+#define COEFS_PRECISION 14
+
+struct resample_coeffs_t {
+	int                kmax = 0;
+	std::vector<int>   bounds;
+	std::vector<INT32> kk;   // PRECISION_BITS, scalar passes
+	std::vector<INT16> kk16; // COEFS_PRECISION, SIMD passes
+};
+
+static std::shared_ptr<const resample_coeffs_t> get_coeffs(int inSize, int outSize, int filter, filter_t* filterp)
 {
-	int x;
-	INT32 *kk;
+	// The same few (source, target, filter) tuples are requested again and again
+	// by every subtitle renderer, so the tables are kept in a small MRU list.
+	static std::mutex mutex;
+	static std::list<std::pair<std::tuple<int, int, int>, std::shared_ptr<const resample_coeffs_t>>> cache;
+	const auto key = std::make_tuple(inSize, outSize, filter);
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (auto it = cache.begin(); it != cache.end(); ++it) {
+		if (it->first == key) {
+			cache.splice(cache.begin(), cache, it);
+			return it->second;
+		}
+	}
 
-	// malloc check ok, overflow checked in precompute_coeffs
-	kk = (INT32*)malloc(outSize * kmax * sizeof(INT32));
-	if (!kk) {
-		return 0;
+	int* bounds;
+	double* prekk;
+	const int kmax = precompute_coeffs(inSize, outSize, filterp, &bounds, &prekk);
+	if (!kmax) {
+		return nullptr;
+	}
+
+	auto coeffs = std::make_shared<resample_coeffs_t>();
+	coeffs->kmax = kmax;
+	coeffs->bounds.assign(bounds, bounds + outSize * 2);
+	coeffs->kk.resize(outSize * kmax);
+	coeffs->kk16.resize(outSize * kmax);
+
+	for (int x = 0; x < outSize * kmax; x++) {
+		const double rnd = prekk[x] < 0 ? -0.5 : 0.5;
+		coeffs->kk[x]   = (INT32)(rnd + prekk[x] * (1 << PRECISION_BITS));
+		coeffs->kk16[x] = (INT16)std::clamp((int)(rnd + prekk[x] * (1 << COEFS_PRECISION)), SHRT_MIN, SHRT_MAX);
+	}
+
+	free(bounds);
+	free(prekk);
+
+	cache.emplace_front(key, coeffs);
+	if (cache.size() > 8) {
+		cache.pop_back();
+	}
+
+	return coeffs;
+}
+
+static inline int read_coeffs_pair(const INT16* k)
+{
+	int pair;
+	memcpy(&pair, k, sizeof(pair));
+	return pair;
+}
+
+static __forceinline UINT32 pack_pixel(__m128i sss)
+{
+	sss = _mm_srai_epi32(sss, COEFS_PRECISION);
+	sss = _mm_packs_epi32(sss, sss);
+	return (UINT32)_mm_cvtsi128_si32(_mm_packus_epi16(sss, sss));
+}
+
+static void resample_horizontal_line_SSE41(UINT32* const lineOut, const int destW, const BYTE* const lineIn, const resample_coeffs_t& coeffs, const UINT32 mask)
+{
+	// [r0 r1 g0 g1 b0 b1 a0 a1] as 16-bit for _mm_madd_epi16
+	const __m128i shuffle = _mm_setr_epi8(0, -1, 4, -1, 1, -1, 5, -1, 2, -1, 6, -1, 3, -1, 7, -1);
+
+	for (int xx = 0; xx < destW; xx++) {
+		const INT16* k = &coeffs.kk16[xx * coeffs.kmax];
+		const BYTE* p  = lineIn + coeffs.bounds[xx * 2 + 0] * 4;
+		const int xmax = coeffs.bounds[xx * 2 + 1];
+
+		__m128i sss = _mm_set1_epi32(1 << (COEFS_PRECISION - 1));
+		int x = 0;
+		for (; x + 2 <= xmax; x += 2) {
+			const __m128i pix = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i*)(p + x * 4)), shuffle);
+			sss = _mm_add_epi32(sss, _mm_madd_epi16(pix, _mm_set1_epi32(read_coeffs_pair(&k[x]))));
+		}
+		if (x < xmax) {
+			const __m128i pix = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(*(const int*)(p + x * 4)));
+			sss = _mm_add_epi32(sss, _mm_madd_epi16(pix, _mm_set1_epi32((UINT16)k[x])));
+		}
+
+		lineOut[xx] = pack_pixel(sss) & mask;
 	}
+}
 
-	for (x = 0; x < outSize * kmax; x++) {
-		if (prekk[x] < 0) {
-			kk[x] = (int) (-0.5 + prekk[x] * (1 << PRECISION_BITS));
-		} else {
-			kk[x] = (int) (0.5 + prekk[x] * (1 << PRECISION_BITS));
+static void resample_horizontal_line_AVX2(UINT32* const lineOut, const int destW, const BYTE* const lineIn, const resample_coeffs_t& coeffs, const UINT32 mask)
+{
+	const __m256i shuffle = _mm256_setr_epi8(
+		0, -1, 4, -1, 1, -1,  5, -1,  2, -1,  6, -1,  3, -1,  7, -1,
+		8, -1, 12, -1, 9, -1, 13, -1, 10, -1, 14, -1, 11, -1, 15, -1);
+	const __m128i shuffle128 = _mm256_castsi256_si128(shuffle);
+
+	for (int xx = 0; xx < destW; xx++) {
+		const INT16* k = &coeffs.kk16[xx * coeffs.kmax];
+		const BYTE* p  = lineIn + coeffs.bounds[xx * 2 + 0] * 4;
+		const int xmax = coeffs.bounds[xx * 2 + 1];
+
+		__m256i sss256 = _mm256_setzero_si256();
+		int x = 0;
+		for (; x + 4 <= xmax; x += 4) {
+			const __m256i pix = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(p + x * 4))), shuffle);
+			const __m256i mmk = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_set1_epi32(read_coeffs_pair(&k[x]))),
+														 _mm_set1_epi32(read_coeffs_pair(&k[x + 2])), 1);
+			sss256 = _mm256_add_epi32(sss256, _mm256_madd_epi16(pix, mmk));
+		}
+
+		__m128i sss = _mm_add_epi32(_mm256_castsi256_si128(sss256), _mm256_extracti128_si256(sss256, 1));
+		sss = _mm_add_epi32(sss, _mm_set1_epi32(1 << (COEFS_PRECISION - 1)));
+		for (; x + 2 <= xmax; x += 2) {
+			const __m128i pix = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i*)(p + x * 4)), shuffle128);
+			sss = _mm_add_epi32(sss, _mm_madd_epi16(pix, _mm_set1_epi32(read_coeffs_pair(&k[x]))));
+		}
+		if (x < xmax) {
+			const __m128i pix = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(*(const int*)(p + x * 4)));
+			sss = _mm_add_epi32(sss, _mm_madd_epi16(pix, _mm_set1_epi32((UINT16)k[x])));
 		}
+
+		lineOut[xx] = pack_pixel(sss) & mask;
 	}
+}
 
-	*kkp = kk;
-	return kmax;
+static void resample_vertical_pixels_C(UINT32* const lineOut, int xx, const int W, const BYTE* const src, const INT16* k, const int ymin, const int ymax, const UINT32 mask)
+{
+	for (; xx < W; xx++) {
+		int ss[4] = { 1 << (COEFS_PRECISION - 1), 1 << (COEFS_PRECISION - 1), 1 << (COEFS_PRECISION - 1), 1 << (COEFS_PRECISION - 1) };
+		for (int y = 0; y < ymax; y++) {
+			const BYTE* pix = src + ((y + ymin) * W + xx) * 4;
+			for (int c = 0; c < 4; c++) {
+				ss[c] += pix[c] * k[y];
+			}
+		}
+
+		UINT32 out = 0;
+		for (int c = 0; c < 4; c++) {
+			out |= (UINT32)std::clamp(ss[c] >> COEFS_PRECISION, 0, 255) << (c * 8);
+		}
+		lineOut[xx] = out & mask;
+	}
+}
+
+static void resample_vertical_line_SSE41(UINT32* const lineOut, int xx, const int W, const BYTE* const src, const INT16* k, const int ymin, const int ymax, const UINT32 mask)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i vmask = _mm_set1_epi32(mask);
+	const size_t pitch = W * 4;
+
+	for (; xx + 4 <= W; xx += 4) {
+		// the output is four pixels with four 32-bit sums each
+		__m128i sss0, sss1, sss2, sss3;
+		sss0 = sss1 = sss2 = sss3 = _mm_set1_epi32(1 << (COEFS_PRECISION - 1));
+
+		const BYTE* p = src + ymin * pitch + xx * 4;
+		int y = 0;
+		for (; y + 2 <= ymax; y += 2, p += pitch * 2) {
+			const __m128i mmk = _mm_set1_epi32(read_coeffs_pair(&k[y]));
+			const __m128i a   = _mm_loadu_si128((const __m128i*)p);
+			const __m128i b   = _mm_loadu_si128((const __m128i*)(p + pitch));
+			const __m128i lo  = _mm_unpacklo_epi8(a, b);
+			const __m128i hi  = _mm_unpackhi_epi8(a, b);
+			sss0 = _mm_add_epi32(sss0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), mmk));
+			sss1 = _mm_add_epi32(sss1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), mmk));
+			sss2 = _mm_add_epi32(sss2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), mmk));
+			sss3 = _mm_add_epi32(sss3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), mmk));
+		}
+		if (y < ymax) {
+			const __m128i mmk = _mm_set1_epi32((UINT16)k[y]);
+			const __m128i a   = _mm_loadu_si128((const __m128i*)p);
+			const __m128i lo  = _mm_unpacklo_epi8(a, zero);
+			const __m128i hi  = _mm_unpackhi_epi8(a, zero);
+			sss0 = _mm_add_epi32(sss0, _mm_madd_epi16(_mm_unpacklo_epi16(lo, zero), mmk));
+			sss1 = _mm_add_epi32(sss1, _mm_madd_epi16(_mm_unpackhi_epi16(lo, zero), mmk));
+			sss2 = _mm_add_epi32(sss2, _mm_madd_epi16(_mm_unpacklo_epi16(hi, zero), mmk));
+			sss3 = _mm_add_epi32(sss3, _mm_madd_epi16(_mm_unpackhi_epi16(hi, zero), mmk));
+		}
+
+		sss0 = _mm_packs_epi32(_mm_srai_epi32(sss0, COEFS_PRECISION), _mm_srai_epi32(sss1, COEFS_PRECISION));
+		sss2 = _mm_packs_epi32(_mm_srai_epi32(sss2, COEFS_PRECISION), _mm_srai_epi32(sss3, COEFS_PRECISION));
+		_mm_storeu_si128((__m128i*)&lineOut[xx], _mm_and_si128(_mm_packus_epi16(sss0, sss2), vmask));
+	}
+
+	resample_vertical_pixels_C(lineOut, xx, W, src, k, ymin, ymax, mask);
+}
+
+static void resample_vertical_line_AVX2(UINT32* const lineOut, const int W, const BYTE* const src, const INT16* k, const int ymin, const int ymax, const UINT32 mask)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i vmask = _mm256_set1_epi32(mask);
+	const size_t pitch = W * 4;
+
+	int xx = 0;
+	for (; xx + 8 <= W; xx += 8) {
+		// same as SSE4.1, the low lane holds pixels 0-3 and the high lane pixels 4-7
+		__m256i sss0, sss1, sss2, sss3;
+		sss0 = sss1 = sss2 = sss3 = _mm256_set1_epi32(1 << (COEFS_PRECISION - 1));
+
+		const BYTE* p = src + ymin * pitch + xx * 4;
+		int y = 0;
+		for (; y + 2 <= ymax; y += 2, p += pitch * 2) {
+			const __m256i mmk = _mm256_set1_epi32(read_coeffs_pair(&k[y]));
+			const __m256i a   = _mm256_loadu_si256((const __m256i*)p);
+			const __m256i b   = _mm256_loadu_si256((const __m256i*)(p + pitch));
+			const __m256i lo  = _mm256_unpacklo_epi8(a, b);
+			const __m256i hi  = _mm256_unpackhi_epi8(a, b);
+			sss0 = _mm256_add_epi32(sss0, _mm256_madd_epi16(_mm256_unpacklo_epi8(lo, zero), mmk));
+			sss1 = _mm256_add_epi32(sss1, _mm256_madd_epi16(_mm256_unpackhi_epi8(lo, zero), mmk));
+			sss2 = _mm256_add_epi32(sss2, _mm256_madd_epi16(_mm256_unpacklo_epi8(hi, zero), mmk));
+			sss3 = _mm256_add_epi32(sss3, _mm256_madd_epi16(_mm256_unpackhi_epi8(hi, zero), mmk));
+		}
+		if (y < ymax) {
+			const __m256i mmk = _mm256_set1_epi32((UINT16)k[y]);
+			const __m256i a   = _mm256_loadu_si256((const __m256i*)p);
+			const __m256i lo  = _mm256_unpacklo_epi8(a, zero);
+			const __m256i hi  = _mm256_unpackhi_epi8(a, zero);
+			sss0 = _mm256_add_epi32(sss0, _mm256_madd_epi16(_mm256_unpacklo_epi16(lo, zero), mmk));
+			sss1 = _mm256_add_epi32(sss1, _mm256_madd_epi16(_mm256_unpackhi_epi16(lo, zero), mmk));
+			sss2 = _mm256_add_epi32(sss2, _mm256_madd_epi16(_mm256_unpacklo_epi16(hi, zero), mmk));
+			sss3 = _mm256_add_epi32(sss3, _mm256_madd_epi16(_mm256_unpackhi_epi16(hi, zero), mmk));
+		}
+
+		sss0 = _mm256_packs_epi32(_mm256_srai_epi32(sss0, COEFS_PRECISION), _mm256_srai_epi32(sss1, COEFS_PRECISION));
+		sss2 = _mm256_packs_epi32(_mm256_srai_epi32(sss2, COEFS_PRECISION), _mm256_srai_epi32(sss3, COEFS_PRECISION));
+		_mm256_storeu_si256((__m256i*)&lineOut[xx], _mm256_and_si256(_mm256_packus_epi16(sss0, sss2), vmask));
+	}
+
+	resample_vertical_line_SSE41(lineOut, xx, W, src, k, ymin, ymax, mask);
 }
 
 void CResampleRGB32::ResampleHorizontal(BYTE* dest, int destW, int H, const BYTE* const src, int srcW)
 {
-	if (m_alpha) {
+	const resample_coeffs_t& coeffs = *m_coeffsHor;
+
+	if (m_bUseSSE41) {
+		const UINT32 mask = m_alpha ? 0xFFFFFFFF : 0x00FFFFFF;
+
+		concurrency::parallel_for(0, H, [&](int yy) {
+			const BYTE* lineIn = src + yy * srcW * 4;
+			UINT32* const lineOut = (UINT32*)dest + yy * destW;
+
+			if (m_bUseAVX2) {
+				resample_horizontal_line_AVX2(lineOut, destW, lineIn, coeffs, mask);
+			} else {
+				resample_horizontal_line_SSE41(lineOut, destW, lineIn, coeffs, mask);
+			}
+		});
+	}
+	else if (m_alpha) {
 		concurrency::parallel_for(0, H, [&](int yy) {
 			const BYTE* lineIn = src + yy * srcW * 4;
 			UINT32* const lineOut = (UINT32*)dest + yy * destW;
 
 			int ss0, ss1, ss2, ss3;
 			for (int xx = 0; xx < destW; xx++) {
-				const INT32* k = &m_kkHor[xx * m_kmaxHor];
-				const int xmin = m_boundsHor[xx * 2 + 0];
-				const int xmax = m_boundsHor[xx * 2 + 1];
+				const INT32* k = &coeffs.kk[xx * coeffs.kmax];
+				const int xmin = coeffs.bounds[xx * 2 + 0];
+				const int xmax = coeffs.bounds[xx * 2 + 1];
 				ss0 = ss1 = ss2 = ss3 = 1 << (PRECISION_BITS - 1);
 
 				for (int x = 0; x < xmax; x++) {
@@ -273,9 +509,9 @@ void CResampleRGB32::ResampleHorizontal(BYTE* dest, int destW, int H, const BYTE
 
 			int ss0, ss1, ss2;
 			for (int xx = 0; xx < destW; xx++) {
-				const INT32* k = &m_kkHor[xx * m_kmaxHor];
-				const int xmin = m_boundsHor[xx * 2 + 0];
-				const int xmax = m_boundsHor[xx * 2 + 1];
+				const INT32* k = &coeffs.kk[xx * coeffs.kmax];
+				const int xmin = coeffs.bounds[xx * 2 + 0];
+				const int xmax = coeffs.bounds[xx * 2 + 1];
 				ss0 = ss1 = ss2 = 1 << (PRECISION_BITS - 1);
 
 				for (int x = 0; x < xmax; x++) {
@@ -292,12 +528,30 @@ void CResampleRGB32::ResampleHorizontal(BYTE* dest, int destW, int H, const BYTE
 
 void CResampleRGB32::ResampleVertical(BYTE* dest, int W, int destH, const BYTE* const src, int srcH)
 {
-	if (m_alpha) {
+	const resample_coeffs_t& coeffs = *m_coeffsVer;
+
+	if (m_bUseSSE41) {
+		const UINT32 mask = m_alpha ? 0xFFFFFFFF : 0x00FFFFFF;
+
+		concurrency::parallel_for(0, destH, [&](int yy) {
+			UINT32* const lineOut = (UINT32*)dest + yy * W;
+			const INT16* k = &coeffs.kk16[yy * coeffs.kmax];
+			const int ymin = coeffs.bounds[yy * 2 + 0];
+			const int ymax = coeffs.bounds[yy * 2 + 1];
+
+			if (m_bUseAVX2) {
+				resample_vertical_line_AVX2(lineOut, W, src, k, ymin, ymax, mask);
+			} else {
+				resample_vertical_line_SSE41(lineOut, 0, W, src, k, ymin, ymax, mask);
+			}
+		});
+	}
+	else if (m_alpha) {
 		concurrency::parallel_for(0, destH, [&](int yy) {
 			UINT32* const lineOut = (UINT32*)dest + yy * W;
-			const INT32* k = &m_kkVer[yy * m_kmaxVer];
-			const int ymin = m_boundsVer[yy * 2 + 0];
-			const int ymax = m_boundsVer[yy * 2 + 1];
+			const INT32* k = &coeffs.kk[yy * coeffs.kmax];
+			const int ymin = coeffs.bounds[yy * 2 + 0];
+			const int ymax = coeffs.bounds[yy * 2 + 1];
 			int ss0, ss1, ss2, ss3;
 			for (int xx = 0; xx < W; xx++) {
 				ss0 = ss1 = ss2 = ss3 = 1 << (PRECISION_BITS - 1);
@@ -316,9 +570,9 @@ void CResampleRGB32::ResampleVertical(BYTE* dest, int W, int destH, const BYTE*
 	else {
 		concurrency::parallel_for(0, destH, [&](int yy) {
 			UINT32* const lineOut = (UINT32*)dest + yy * W;
-			const INT32* k = &m_kkVer[yy * m_kmaxVer];
-			const int ymin = m_boundsVer[yy * 2 + 0];
-			const int ymax = m_boundsVer[yy * 2 + 1];
+			const INT32* k = &coeffs.kk[yy * coeffs.kmax];
+			const int ymin = coeffs.bounds[yy * 2 + 0];
+			const int ymax = coeffs.bounds[yy * 2 + 1];
 			int ss0, ss1, ss2;
 			for (int xx = 0; xx < W; xx++) {
 				ss0 = ss1 = ss2 = 1 << (PRECISION_BITS - 1);
@@ -340,15 +594,8 @@ void CResampleRGB32::FreeData()
 	free(m_pTemp);
 	m_pTemp = nullptr;
 
-	free(m_boundsHor);
-	m_boundsHor = nullptr;
-	free(m_kkHor);
-	m_kkHor  = nullptr;
-
-	free(m_boundsVer);
-	m_boundsVer = nullptr;
-	free(m_kkVer);
-	m_kkVer = nullptr;
+	m_coeffsHor.reset();
+	m_coeffsVer.reset();
 }
 
 HRESULT CResampleRGB32::Init()
@@ -381,30 +628,16 @@ HRESULT CResampleRGB32::Init()
 	}
 
 	if (m_bResampleHor) {
-		double *prekk;
-		m_kmaxHor = precompute_coeffs(m_srcW, m_destW, m_pFilter, &m_boundsHor, &prekk);
-		if (!m_kmaxHor) {
-			FreeData();
-			return E_OUTOFMEMORY;
-		}
-		m_kmaxHor = normalize_coeffs_8bpc(m_destW, m_kmaxHor, prekk, &m_kkHor);
-		free(prekk);
-		if (!m_kmaxHor) {
+		m_coeffsHor = get_coeffs(m_srcW, m_destW, m_filter, m_pFilter);
+		if (!m_coeffsHor) {
 			FreeData();
 			return E_OUTOFMEMORY;
 		}
 	}
 
 	if (m_bResampleVer) {
-		double *prekk;
-		m_kmaxVer = precompute_coeffs(m_srcH, m_destH, m_pFilter, &m_boundsVer, &prekk);
-		if (!m_kmaxVer) {
-			FreeData();
-			return E_OUTOFMEMORY;
-		}
-		m_kmaxVer = normalize_coeffs_8bpc(m_destH, m_kmaxVer, prekk, &m_kkVer);
-		free(prekk);
-		if (!m_kmaxVer) {
+		m_coeffsVer = get_coeffs(m_srcH, m_destH, m_filter, m_pFilter);
+		if (!m_coeffsVer) {
 			FreeData();
 			return E_OUTOFMEMORY;
 		}
@@ -415,6 +648,12 @@ HRESULT CResampleRGB32::Init()
 	return S_OK;
 }
 
+CResampleRGB32::CResampleRGB32()
+	: m_bUseSSE41(CPUInfo::HaveSSE4())
+	, m_bUseAVX2(CPUInfo::HaveAVX2())
+{
+}
+
 CResampleRGB32::~CResampleRGB32()
 {
 	FreeData();
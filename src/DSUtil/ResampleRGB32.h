@@ -21,6 +21,7 @@
 #pragma once
 
 struct filter_t;
+struct resample_coeffs_t;
 
 class CResampleRGB32
 {
@@ -49,13 +50,12 @@ private:
 
 	BYTE*  m_pTemp      = nullptr;
 
-	int*   m_boundsHor  = nullptr;
-	INT32* m_kkHor      = nullptr;
-	int    m_kmaxHor    = 0;
+	// coefficient tables are shared between instances with the same sizes and filter
+	std::shared_ptr<const resample_coeffs_t> m_coeffsHor;
+	std::shared_ptr<const resample_coeffs_t> m_coeffsVer;
 
-	int*   m_boundsVer  = nullptr;
-	INT32* m_kkVer      = nullptr;
-	int    m_kmaxVer    = 0;
+	const bool m_bUseSSE41;
+	const bool m_bUseAVX2;
 
 	void ResampleHorizontal(BYTE* dest, int destW, int H, const BYTE* const src, int srcW);
 	void ResampleVertical(BYTE* dest, int W, int destH, const BYTE* const src, int srcH);
@@ -64,6 +64,7 @@ private:
 	HRESULT Init();
 
 public:
+	CResampleRGB32();
 	~CResampleRGB32();
 
 	HRESULT SetParameters(const int destW, const int destH, const int srcW, const int srcH, const int filter, const bool alpha);
@@ -122,6 +122,9 @@ public IUnknown {
 	STDMETHOD (Reset) () PURE;
 
 	STDMETHOD_(void, SetInverseAlpha)(bool bInverted) PURE;
+
+	// dynamic subpictures kept for reuse, and the most of them used at the same time
+	STDMETHOD (GetPoolStats) (size_t& nPooled, size_t& nHighWater /*[out]*/) { return E_NOTIMPL; };
 };
 
 //
@@ -148,6 +151,9 @@ public IUnknown {
 	STDMETHOD (GetTextureSize) (POSITION pos, SIZE& MaxTextureSize, SIZE& VirtualSize, POINT& VirtualTopLeft) PURE;
 
 	STDMETHOD_(SUBTITLE_TYPE, GetType) () PURE;
+
+	// 0 is the full quality, higher levels trade accuracy of the costly effects for speed
+	STDMETHOD (SetRenderQuality) (int nLevel /*[in]*/) { return E_NOTIMPL; };
 };
 
 //
@@ -170,6 +176,19 @@ public IUnknown {
 	STDMETHOD (GetStats) (int nSubPic /*[in]*/, REFERENCE_TIME& rtStart, REFERENCE_TIME& rtStop /*[out]*/) PURE;
 
 	STDMETHOD_(bool, LookupSubPic)(REFERENCE_TIME rtNow /*[in]*/, bool bAdviseBlocking, CComPtr<ISubPic>& pSubPic /*[out]*/) PURE;
+
+	// start times of the video frames seen so far in increasing order, the queue predicts the next frames from them
+	STDMETHOD (SetFrameTimes) (const REFERENCE_TIME* pFrameTimes /*[in]*/, size_t nCount) { return E_NOTIMPL; };
+	STDMETHOD (GetFrameStats) (UINT64& nFrames, UINT64& nMispredicted, UINT64& nDropped /*[out]*/) { return E_NOTIMPL; };
+	// pool statistics of the allocator
+	STDMETHOD (GetPoolStats) (size_t& nPooled, size_t& nHighWater /*[out]*/) { return E_NOTIMPL; };
+
+	// like Invalidate(rtStart) but the displayed subpic is kept unless it intersects [rtStart, rtStop)
+	STDMETHOD (InvalidateRange) (REFERENCE_TIME rtStart /*[in]*/, REFERENCE_TIME rtStop /*[in]*/) { return Invalidate(rtStart); };
+
+	// lowers the rendering quality of the provider when the subpics are not rendered in time
+	STDMETHOD (SetAdaptiveQuality) (bool bAdaptive /*[in]*/) { return E_NOTIMPL; };
+	STDMETHOD (GetQualityStats) (int& nLevel, double& load /*[out]*/) { return E_NOTIMPL; };
 };
 
 //
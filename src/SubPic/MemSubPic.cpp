@@ -40,7 +40,29 @@ CMemSubPic::CMemSubPic(SubPicDesc& spd)
 
 CMemSubPic::~CMemSubPic()
 {
-	SAFE_DELETE_ARRAY(m_spd.bits);
+	FreeBits(m_spd.bits);
+}
+
+// Page aligned, in large pages when the process may use them
+BYTE* CMemSubPic::AllocBits(size_t size)
+{
+	const size_t largePage = GetLargePageMinimum();
+	if (largePage && size >= largePage) {
+		void* p = VirtualAlloc(nullptr, (size + largePage - 1) & ~(largePage - 1),
+							   MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (p) {
+			return (BYTE*)p;
+		}
+	}
+
+	return (BYTE*)VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+}
+
+void CMemSubPic::FreeBits(BYTE* bits)
+{
+	if (bits) {
+		VirtualFree(bits, 0, MEM_RELEASE);
+	}
 }
 
 // ISubPic
@@ -215,7 +237,7 @@ bool CMemSubPicAllocator::Alloc(bool fStatic, ISubPic** ppSubPic)
 	spd.bpp   = 32;
 	spd.pitch = spd.w * 4;
 	spd.type  = MSP_RGB32;
-	spd.bits  = new(std::nothrow) BYTE[spd.pitch * spd.h];
+	spd.bits  = CMemSubPic::AllocBits(spd.pitch * spd.h);
 	if (!spd.bits) {
 		return false;
 	}
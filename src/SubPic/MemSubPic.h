@@ -43,7 +43,14 @@ enum {
 	MSP_P210, // 4:2:2 10 bits
 	MSP_P216, // 4:2:2 16 bits
 	MSP_YV16, // 4:2:2 8 bits
-	MSP_YV24  // 4:4:4 8 bits
+	MSP_YV24, // 4:4:4 8 bits
+	// planar formats with 9-16 bit samples in the low bits of 16-bit words,
+	// SubPicDesc::bpp holds the number of bits per sample
+	MSP_YUV420P16,
+	MSP_YUV422P16,
+	MSP_YUV444P16,
+	MSP_RGBP,  // planar G (bits), B (bitsU), R (bitsV), 8 bits
+	MSP_RGBP16 // planar G (bits), B (bitsU), R (bitsV), 9-16 bits
 };
 
 // CMemSubPic
@@ -55,9 +62,12 @@ protected:
 	SubPicDesc m_spd;
 
 public:
-	CMemSubPic(SubPicDesc& spd);
+	CMemSubPic(SubPicDesc& spd); // takes ownership of spd.bits, allocated with AllocBits()
 	virtual ~CMemSubPic();
 
+	static BYTE* AllocBits(size_t size);
+	static void FreeBits(BYTE* bits);
+
 	// ISubPic
 protected:
 	STDMETHODIMP_(void*) GetObject() override; // returns SubPicDesc*
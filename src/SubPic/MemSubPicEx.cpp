@@ -121,11 +121,18 @@ CMemSubPicEx::CMemSubPicEx(SubPicDesc& spd, int alpha_blt_dst_type)
 	case MSP_YUY2:
 	case MSP_P010:
 	case MSP_P016:
+	case MSP_YUV420P16:
+	case MSP_YUV422P16:
+	case MSP_YUV444P16:
+	case MSP_RGBP16:
 		m_dst_packsize = 2;
 		break;
 	case MSP_YV12:
 	case MSP_IYUV:
 	case MSP_NV12:
+	case MSP_YV16:
+	case MSP_YV24:
+	case MSP_RGBP:
 		m_dst_packsize = 1;
 		break;
 	}
@@ -145,11 +152,14 @@ STDMETHODIMP CMemSubPicEx::Unlock(RECT* pDirtyRect)
 	case MSP_IYUV:
 	case MSP_P010:
 	case MSP_P016:
+	case MSP_YUV420P16:
 		// YUV 4:2:0
 		m_rcDirty.top &= ~1;
 		m_rcDirty.bottom = (m_rcDirty.bottom + 1) & ~1;
 		[[fallthrough]];
 	case MSP_YUY2:
+	case MSP_YV16:
+	case MSP_YUV422P16:
 		// YUV 4:2:2
 		m_rcDirty.left &= ~1;
 		m_rcDirty.right = (m_rcDirty.right + 1) & ~1;
@@ -168,6 +178,9 @@ STDMETHODIMP CMemSubPicEx::Unlock(RECT* pDirtyRect)
 	case MSP_P010:
 	case MSP_P016:
 	case MSP_YUY2:
+	case MSP_YV16:
+	case MSP_YUV420P16:
+	case MSP_YUV422P16:
 		for (; top < bottom; top += m_spd.pitch) {
 			BYTE* s = top;
 			BYTE* e = s + w*4;
@@ -188,6 +201,8 @@ STDMETHODIMP CMemSubPicEx::Unlock(RECT* pDirtyRect)
 		}
 		break;
 	case MSP_AYUV:
+	case MSP_YV24:
+	case MSP_YUV444P16:
 		for (; top < bottom; top += m_spd.pitch) {
 			BYTE* s = top;
 			BYTE* e = s + w*4;
@@ -274,6 +289,132 @@ void AlphaBlt_YUY2_C(int w, int h, BYTE* d, int dstpitch, const BYTE* s, int src
 }
 */
 
+// Blends a plane that has a sample for every source pixel. The sample is the byte
+// at 'offset' in the converted source pixel, 'black' is the zero level of the plane.
+template <typename T>
+static void AlphaBltPlane_SSE2(int w, int h, BYTE* d, int dstpitch, const BYTE* s, int srcpitch, int offset, int shift, int black)
+{
+	const __m128i mm_zero        = _mm_setzero_si128();
+	const __m128i mm_ff          = _mm_set1_epi32(0xff);
+	const __m128i mm_transparent = _mm_set1_epi16(0xff);
+	const __m128i mm_black       = _mm_set1_epi16((short)black);
+	const __m128i mm_offset      = _mm_cvtsi32_si128(offset * 8);
+	const __m128i mm_shift       = _mm_cvtsi32_si128(shift);
+	const int maxval = (1 << (sizeof(T) * 8)) - 1;
+
+	for (ptrdiff_t j = 0; j < h; j++, s += srcpitch, d += dstpitch) {
+		const BYTE* s2 = s;
+		T* d2 = (T*)d;
+		int i = 0;
+
+		for (; i + 8 <= w; i += 8, s2 += 32, d2 += 8) {
+			const __m128i p0 = _mm_loadu_si128((const __m128i*)s2);
+			const __m128i p1 = _mm_loadu_si128((const __m128i*)(s2 + 16));
+
+			const __m128i a = _mm_packs_epi32(_mm_srli_epi32(p0, 24), _mm_srli_epi32(p1, 24));
+			const __m128i transparent = _mm_cmpeq_epi16(a, mm_transparent);
+			if (_mm_movemask_epi8(transparent) == 0xffff) {
+				continue;
+			}
+
+			__m128i c = _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(p0, mm_offset), mm_ff),
+										_mm_and_si128(_mm_srl_epi32(p1, mm_offset), mm_ff));
+			c = _mm_sll_epi16(c, mm_shift);
+
+			__m128i dv;
+			if constexpr (sizeof(T) == 1) {
+				dv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)d2), mm_zero);
+			} else {
+				dv = _mm_loadu_si128((const __m128i*)d2);
+			}
+
+			// (d - black) * a / 256 + c. The difference does not fit in a signed 16-bit lane for
+			// 16-bit samples, so it is computed as d * a / 256 + c - black * a / 256 and the
+			// saturating subtraction clamps the result at 0.
+			const __m128i a8 = _mm_slli_epi16(a, 8);
+			__m128i r = _mm_adds_epu16(_mm_mulhi_epu16(dv, a8), c);
+			r = _mm_subs_epu16(r, _mm_mulhi_epu16(mm_black, a8));
+			r = _mm_or_si128(_mm_and_si128(transparent, dv), _mm_andnot_si128(transparent, r));
+
+			if constexpr (sizeof(T) == 1) {
+				_mm_storel_epi64((__m128i*)d2, _mm_packus_epi16(r, r));
+			} else {
+				_mm_storeu_si128((__m128i*)d2, r);
+			}
+		}
+
+		for (; i < w; i++, s2 += 4, d2++) {
+			if (s2[3] < 0xff) {
+				const int v = (((*d2 - black) * s2[3]) >> 8) + (s2[offset] << shift);
+				*d2 = (T)std::clamp(v, 0, maxval);
+			}
+		}
+	}
+}
+
+// Blends a chroma plane subsampled horizontally (4:2:2) or in both directions (4:2:0).
+// Source pixel pairs are AxYU AxYV, 'offset' selects U (0) or V (4).
+template <typename T>
+static void AlphaBltChroma(int w, int h, BYTE* d, int dstpitch, const BYTE* s, int srcpitch, int offset, bool b420, int shift, int black)
+{
+	const int maxval = (1 << (sizeof(T) * 8)) - 1;
+	const int pitch2 = b420 ? srcpitch : 0;
+
+	if (b420) {
+		h /= 2;
+		srcpitch *= 2;
+	}
+
+	for (ptrdiff_t j = 0; j < h; j++, s += srcpitch, d += dstpitch) {
+		const BYTE* s2 = s;
+		const BYTE* s2end = s2 + w * 4;
+		T* d2 = (T*)d;
+
+		for (; s2 < s2end; s2 += 8, d2++) {
+			const int ia = (s2[3] + s2[7] + s2[3 + pitch2] + s2[7 + pitch2]) >> 2;
+			if (ia < 0xff) {
+				const int c = (s2[offset] + s2[offset + pitch2]) >> 1;
+				const int v = (((*d2 - black) * ia) >> 8) + (c << shift);
+				*d2 = (T)std::clamp(v, 0, maxval);
+			}
+		}
+	}
+}
+
+template <typename T>
+static void AlphaBltPlanar(int w, int h, const BYTE* s, int srcpitch, const SubPicDesc& dst, const CRect& rd, int shift)
+{
+	const int pitchUV = dst.pitchUV ? dst.pitchUV : dst.pitch;
+	auto Plane = [&](BYTE* p, int pitch, int x, int y) {
+		return p + pitch * y + x * (int)sizeof(T);
+	};
+
+	switch (dst.type) {
+		case MSP_RGBP:
+		case MSP_RGBP16:
+			AlphaBltPlane_SSE2<T>(w, h, Plane(dst.bits, dst.pitch, rd.left, rd.top), dst.pitch, s, srcpitch, 1, shift, 0);
+			AlphaBltPlane_SSE2<T>(w, h, Plane(dst.bitsU, pitchUV, rd.left, rd.top), pitchUV, s, srcpitch, 0, shift, 0);
+			AlphaBltPlane_SSE2<T>(w, h, Plane(dst.bitsV, pitchUV, rd.left, rd.top), pitchUV, s, srcpitch, 2, shift, 0);
+			break;
+		case MSP_YV24:
+		case MSP_YUV444P16:
+			// Source is AYUV (V in the lowest byte)
+			AlphaBltPlane_SSE2<T>(w, h, Plane(dst.bits, dst.pitch, rd.left, rd.top), dst.pitch, s, srcpitch, 2, shift, 0x10 << shift);
+			AlphaBltPlane_SSE2<T>(w, h, Plane(dst.bitsU, pitchUV, rd.left, rd.top), pitchUV, s, srcpitch, 1, shift, 0x80 << shift);
+			AlphaBltPlane_SSE2<T>(w, h, Plane(dst.bitsV, pitchUV, rd.left, rd.top), pitchUV, s, srcpitch, 0, shift, 0x80 << shift);
+			break;
+		default: {
+			// Source is AxYU AxYV
+			const bool b420 = (dst.type == MSP_YUV420P16);
+			const int top = b420 ? rd.top / 2 : rd.top;
+			AlphaBltPlane_SSE2<T>(w, h, Plane(dst.bits, dst.pitch, rd.left, rd.top), dst.pitch, s, srcpitch, 1, shift, 0x10 << shift);
+			AlphaBltChroma<T>(w, h, Plane(dst.bitsU, pitchUV, rd.left / 2, top), pitchUV, s, srcpitch, 0, b420, shift, 0x80 << shift);
+			AlphaBltChroma<T>(w, h, Plane(dst.bitsV, pitchUV, rd.left / 2, top), pitchUV, s, srcpitch, 4, b420, shift, 0x80 << shift);
+			break;
+		}
+	}
+}
+
 STDMETHODIMP CMemSubPicEx::AlphaBlt(RECT* pSrc, RECT* pDst, SubPicDesc* pTarget)
 {
 	ASSERT(pTarget);
@@ -409,6 +550,23 @@ STDMETHODIMP CMemSubPicEx::AlphaBlt(RECT* pSrc, RECT* pDst, SubPicDesc* pTarget)
 		case MSP_YUY2:
 			AlphaBlt_YUY2_SSE2(w, h, d, dst.pitch, s, src.pitch);
 			break;
+		case MSP_YV16:
+		case MSP_YV24:
+		case MSP_RGBP:
+			if (!dst.bitsU || !dst.bitsV || rd.top > rd.bottom) {
+				return E_INVALIDARG;
+			}
+			AlphaBltPlanar<BYTE>(w, h, s, src.pitch, dst, rd, 0);
+			return S_OK;
+		case MSP_YUV420P16:
+		case MSP_YUV422P16:
+		case MSP_YUV444P16:
+		case MSP_RGBP16:
+			if (!dst.bitsU || !dst.bitsV || rd.top > rd.bottom || dst.bpp < 9 || dst.bpp > 16) {
+				return E_INVALIDARG;
+			}
+			AlphaBltPlanar<WORD>(w, h, s, src.pitch, dst, rd, dst.bpp - 8);
+			return S_OK;
 		case MSP_YV12:
 		case MSP_NV12:
 		case MSP_IYUV:
@@ -589,7 +747,7 @@ bool CMemSubPicExAllocator::Alloc(bool fStatic, ISubPic** ppSubPic)
 	spd.bpp   = 32;
 	spd.pitch = spd.w * 4;
 	spd.type  = MSP_RGB32;
-	spd.bits  = new(std::nothrow) BYTE[spd.pitch * spd.h];
+	spd.bits  = CMemSubPic::AllocBits(spd.pitch * spd.h);
 	if (!spd.bits) {
 		return false;
 	}
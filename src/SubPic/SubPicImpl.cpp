@@ -315,11 +315,60 @@ STDMETHODIMP CSubPicAllocatorImpl::AllocDynamic(ISubPic** ppSubPic)
 {
 	CheckPointer(ppSubPic, E_POINTER);
 
-	if (!Alloc(false, ppSubPic) || !*ppSubPic) {
-		return E_OUTOFMEMORY;
+	CComPtr<ISubPic> pSubPic;
+
+	{
+		CAutoLock cAutoLock(&m_poolLock);
+
+		// nobody else can take a reference to a subpicture only held by the pool
+		auto isIdle = [](const CComPtr<ISubPic>& pPooled) {
+			pPooled.p->AddRef();
+			return pPooled.p->Release() == 1;
+		};
+
+		size_t nInUse = 0;
+		for (auto& pPooled : m_pool) {
+			if (!isIdle(pPooled)) {
+				nInUse++;
+			} else if (!pSubPic) {
+				pSubPic = pPooled;
+			}
+		}
+
+		if (pSubPic) {
+			// the old content is not cleared here, only the next ClearDirtyRect() call clears it
+			CSize maxsize;
+			pSubPic->GetMaxSize(&maxsize);
+			pSubPic->SetDirtyRect(CRect(CPoint(0, 0), maxsize));
+		} else {
+			if (!Alloc(false, &pSubPic) || !pSubPic) {
+				return E_OUTOFMEMORY;
+			}
+			if (m_pool.size() < MAX_POOLED_SUBPICS) {
+				m_pool.emplace_back(pSubPic);
+			}
+		}
+
+		if (++nInUse > m_nPoolHighWater) {
+			m_nPoolHighWater = nInUse;
+			DLog(L"CSubPicAllocatorImpl::AllocDynamic() : %Iu dynamic subpictures in use", nInUse);
+		}
+
+		m_nPeriodHighWater = std::max(m_nPeriodHighWater, nInUse);
+		if (++m_nPeriodAllocs >= POOL_TRIM_PERIOD) {
+			// the subpictures have the maximum size, do not keep more than recently needed
+			for (size_t i = m_pool.size(); i-- > 0 && m_pool.size() > m_nPeriodHighWater;) {
+				if (isIdle(m_pool[i])) {
+					m_pool.erase(m_pool.begin() + i);
+				}
+			}
+			m_nPeriodHighWater = 0;
+			m_nPeriodAllocs = 0;
+		}
 	}
 
-	(*ppSubPic)->SetSize(m_cursize, m_curvidrect);
+	pSubPic->SetSize(m_cursize, m_curvidrect);
+	*ppSubPic = pSubPic.Detach();
 
 	return S_OK;
 }
@@ -336,6 +385,15 @@ STDMETHODIMP CSubPicAllocatorImpl::ChangeDevice(IUnknown* pDev)
 
 STDMETHODIMP CSubPicAllocatorImpl::Reset()
 {
+	{
+		CAutoLock cAutoLock(&m_poolLock);
+
+		m_pool.clear();
+		m_nPoolHighWater = 0;
+		m_nPeriodHighWater = 0;
+		m_nPeriodAllocs = 0;
+	}
+
 	CAutoLock cAutoLock(&m_staticLock);
 
 	m_pStatic.Release();
@@ -346,3 +404,13 @@ STDMETHODIMP_(void) CSubPicAllocatorImpl::SetInverseAlpha(bool bInverted)
 {
 	m_bInvAlpha = bInverted;
 }
+
+STDMETHODIMP CSubPicAllocatorImpl::GetPoolStats(size_t& nPooled, size_t& nHighWater)
+{
+	CAutoLock cAutoLock(&m_poolLock);
+
+	nPooled = m_pool.size();
+	nHighWater = m_nPoolHighWater;
+
+	return S_OK;
+}
@@ -130,6 +130,17 @@ private:
 	bool  m_fDynamicWriteOnly;
 	virtual bool Alloc(bool fStatic, ISubPic** ppSubPic) PURE;
 
+	// Dynamic subpictures are kept and handed out again once only the pool references them.
+	// All of them have the same maximum size, the pool is emptied by Reset(). Every
+	// POOL_TRIM_PERIOD allocations the pool is trimmed to the most subpictures used meanwhile.
+	static constexpr size_t MAX_POOLED_SUBPICS = 32;
+	static constexpr size_t POOL_TRIM_PERIOD = 64;
+	CCritSec m_poolLock;
+	std::vector<CComPtr<ISubPic>> m_pool;
+	size_t m_nPoolHighWater = 0;   // most dynamic subpictures in use at the same time
+	size_t m_nPeriodHighWater = 0; // the same since the last trim
+	size_t m_nPeriodAllocs = 0;
+
 protected:
 	bool  m_bInvAlpha = false;
 
@@ -150,4 +161,6 @@ public:
 	STDMETHODIMP SetMaxTextureSize(SIZE MaxTextureSize) { return E_NOTIMPL; };
 	STDMETHODIMP Reset();
 	STDMETHODIMP_(void) SetInverseAlpha(bool bInverted);
+
+	STDMETHODIMP GetPoolStats(size_t& nPooled, size_t& nHighWater);
 };
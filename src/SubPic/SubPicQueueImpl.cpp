@@ -97,11 +97,74 @@ STDMETHODIMP CSubPicQueueImpl::SetTime(REFERENCE_TIME rtNow)
 {
 	m_rtNow = rtNow;
 
+	{
+		std::lock_guard<std::mutex> lock(m_mutexFrameTimes);
+
+		// keep the last two past frames to know the current frame duration
+		while (m_frameTimes.size() > 2 && m_frameTimes[2] <= rtNow) {
+			m_frameTimes.pop_front();
+		}
+	}
+
+	return S_OK;
+}
+
+STDMETHODIMP CSubPicQueueImpl::SetFrameTimes(const REFERENCE_TIME* pFrameTimes, size_t nCount)
+{
+	CheckPointer(pFrameTimes, E_POINTER);
+
+	std::lock_guard<std::mutex> lock(m_mutexFrameTimes);
+
+	for (size_t i = 0; i < nCount; i++) {
+		const REFERENCE_TIME rt = pFrameTimes[i];
+		if (m_frameTimes.size() && rt <= m_frameTimes.back()) {
+			if (std::binary_search(m_frameTimes.cbegin(), m_frameTimes.cend(), rt)) {
+				continue;
+			}
+			// seeking, the frames known so far do not follow anymore
+			m_frameTimes.clear();
+		}
+		m_frameTimes.push_back(rt);
+	}
+
 	return S_OK;
 }
 
+STDMETHODIMP CSubPicQueueImpl::GetPoolStats(size_t& nPooled, size_t& nHighWater)
+{
+	return m_pAllocator ? m_pAllocator->GetPoolStats(nPooled, nHighWater) : E_FAIL;
+}
+
 // private
 
+REFERENCE_TIME CSubPicQueueImpl::GetFrameTime(REFERENCE_TIME rt, REFERENCE_TIME rtTimePerFrame)
+{
+	std::lock_guard<std::mutex> lock(m_mutexFrameTimes);
+
+	auto it = std::lower_bound(m_frameTimes.cbegin(), m_frameTimes.cend(), rt);
+	if (it != m_frameTimes.cend()) {
+		return *it;
+	}
+
+	// Continue from the last known frame with its duration, or round to the estimated frame timing
+	REFERENCE_TIME rtLast = 0;
+	if (m_frameTimes.size()) {
+		rtLast = m_frameTimes.back();
+		if (m_frameTimes.size() > 1) {
+			// a much longer gap comes from a seek or dropped frames, not from the frame rate
+			const REFERENCE_TIME rtDuration = rtLast - m_frameTimes[m_frameTimes.size() - 2];
+			if (rtDuration < rtTimePerFrame * 2) {
+				rtTimePerFrame = rtDuration;
+			}
+		}
+	}
+	if (rt <= rtLast || rtTimePerFrame <= 0) {
+		return std::max(rt, rtLast);
+	}
+
+	return rtLast + (rt - rtLast + rtTimePerFrame - 1) / rtTimePerFrame * rtTimePerFrame;
+}
+
 HRESULT CSubPicQueueImpl::RenderTo(ISubPic* pSubPic, REFERENCE_TIME rtStart, REFERENCE_TIME rtStop, double fps, BOOL bIsAnimated)
 {
 	CheckPointer(pSubPic, E_POINTER);
@@ -248,6 +311,49 @@ STDMETHODIMP CSubPicQueue::Invalidate(REFERENCE_TIME rtInvalidate)
 	return S_OK;
 }
 
+STDMETHODIMP CSubPicQueue::InvalidateRange(REFERENCE_TIME rtStart, REFERENCE_TIME rtStop)
+{
+	std::unique_lock<std::mutex> lock(m_mutexQueue);
+
+#if SUBPIC_TRACE_LEVEL > 0
+	DLog(L"InvalidateRange: %f - %f", double(rtStart) / 10000000.0, double(rtStop) / 10000000.0);
+#endif
+
+	auto intersects = [rtStart, rtStop](ISubPic* pSubPic) {
+		return pSubPic->GetStart() < rtStop && pSubPic->GetStop() > rtStart;
+	};
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutexSubpic);
+		if (m_pSubPic && intersects(m_pSubPic)) {
+			m_pSubPic.Release();
+		}
+	}
+
+	// The rendering thread continues after the last subpic, so the queue has to stay contiguous: it is cut
+	// from the first subpic ending after the range start even if the range falls in a gap between subpics
+	auto it = std::find_if(m_queue.begin(), m_queue.end(), [rtStart](const CComQIPtr<ISubPic>& pSubPic) {
+		return pSubPic->GetStop() > rtStart;
+	});
+	m_queue.erase(it, m_queue.end());
+
+	// The subpic being rendered is dropped like in Invalidate(), pending invalidations are merged
+	m_rtInvalidate = m_bInvalidate ? std::min(m_rtInvalidate, rtStart) : rtStart;
+	m_bInvalidate = true;
+	m_rtNowLast = LONGLONG_ERROR;
+
+	// Give the queue a chance to re-render the subtitles currently displayed
+	if (rtStart >= 0 && rtStart < m_rtNow && m_rtNow < rtStop) {
+		m_rtNow = rtStart;
+	}
+
+	lock.unlock();
+	m_condQueueFull.notify_one();
+	m_runQueueEvent.Set();
+
+	return S_OK;
+}
+
 STDMETHODIMP_(bool) CSubPicQueue::LookupSubPic(REFERENCE_TIME rtNow, CComPtr<ISubPic>& ppSubPic)
 {
 	// Old version of LookupSubPic, keep legacy behavior and never try to block
@@ -319,6 +425,7 @@ STDMETHODIMP_(bool) CSubPicQueue::LookupSubPic(REFERENCE_TIME rtNow, bool bAdvis
 							  double(rtNow) / 10000000.0, double(rtStart) / 10000000.0,
 							  double(rtStop) / 10000000.0, double(rtSegmentStop) / 10000000.0);
 #endif
+						m_nDropped++;
 					} else { // rtNow < rtSegmentStop
 						if (rtStart <= rtNow && rtNow < rtStop) {
 #if SUBPIC_TRACE_LEVEL > 2
@@ -387,6 +494,11 @@ STDMETHODIMP_(bool) CSubPicQueue::LookupSubPic(REFERENCE_TIME rtNow, bool bAdvis
 	}
 
 	if (ppSubPic) {
+		m_nFrames++;
+		if (rtNow < ppSubPic->GetStart() || ppSubPic->GetStop() <= rtNow) {
+			m_nMispredicted++;
+		}
+
 		// Save the subpic for later reuse
 		std::lock_guard<std::mutex> lock(m_mutexSubpic);
 		m_pSubPic = ppSubPic;
@@ -445,6 +557,34 @@ STDMETHODIMP CSubPicQueue::GetStats(int nSubPic, REFERENCE_TIME& rtStart, REFERE
 	return hr;
 }
 
+STDMETHODIMP CSubPicQueue::GetFrameStats(UINT64& nFrames, UINT64& nMispredicted, UINT64& nDropped)
+{
+	nFrames = m_nFrames;
+	nMispredicted = m_nMispredicted;
+	nDropped = m_nDropped;
+
+	return S_OK;
+}
+
+STDMETHODIMP CSubPicQueue::SetAdaptiveQuality(bool bAdaptive)
+{
+	m_bAdaptiveQuality = bAdaptive;
+	if (!bAdaptive) {
+		// the rendering thread restores the full quality of the provider
+		m_nQualityLevel = 0;
+	}
+
+	return S_OK;
+}
+
+STDMETHODIMP CSubPicQueue::GetQualityStats(int& nLevel, double& load)
+{
+	nLevel = m_nQualityLevel;
+	load = m_renderLoad;
+
+	return S_OK;
+}
+
 // private
 
 bool CSubPicQueue::EnqueueSubPic(CComPtr<ISubPic>& pSubPic, bool bBlocking)
@@ -493,6 +633,33 @@ REFERENCE_TIME CSubPicQueue::GetCurrentRenderingTime()
 	return std::max(rtNow, m_rtNow);
 }
 
+void CSubPicQueue::UpdateQualityLevel(double load)
+{
+	const double renderLoad = m_renderLoad + (load - m_renderLoad) * 0.1;
+	m_renderLoad = renderLoad;
+
+	if (!m_bAdaptiveQuality) {
+		return;
+	}
+
+	// The level is lowered quickly when the deadline is at risk but restored only
+	// after a sustained period with enough headroom to avoid oscillations
+	const int nLevel = m_nQualityLevel;
+	m_nQualityLevelAge++;
+	if (renderLoad > 0.8 && nLevel < MAX_QUALITY_LEVEL && m_nQualityLevelAge >= 16) {
+		m_nQualityLevel = nLevel + 1;
+		m_nQualityLevelAge = 0;
+	} else if (renderLoad < 0.4 && nLevel > 0 && m_nQualityLevelAge >= 120) {
+		m_nQualityLevel = nLevel - 1;
+		m_nQualityLevelAge = 0;
+	}
+#if SUBPIC_TRACE_LEVEL > 0
+	if (nLevel != m_nQualityLevel) {
+		DLog(L"Subtitle Renderer Thread: quality level %d -> %d (load %.2f)", nLevel, (int)m_nQualityLevel, renderLoad);
+	}
+#endif
+}
+
 // overrides
 
 DWORD CSubPicQueue::ThreadProc()
@@ -502,6 +669,7 @@ DWORD CSubPicQueue::ThreadProc()
 	SetThreadPriority(m_hThread, bDisableAnim ? THREAD_PRIORITY_LOWEST : THREAD_PRIORITY_ABOVE_NORMAL);
 
 	bool bWaitForEvent = false;
+	int nAppliedQualityLevel = 0;
 	for (; !m_bExitThread;) {
 		// When we have nothing to render, we just wait a bit
 		if (bWaitForEvent) {
@@ -536,11 +704,8 @@ DWORD CSubPicQueue::ThreadProc()
 
 				REFERENCE_TIME rtCurrent = std::max(rtStart, rtStartRendering);
 				if (rtCurrent > m_rtNow && rtTimePerFrame <= rtStop - rtStart) {
-					// Round current time to the next estimated video frame timing
-					REFERENCE_TIME rtCurrentRounded = (rtCurrent / rtTimePerFrame) * rtTimePerFrame;
-					if (rtCurrentRounded < rtCurrent) {
-						rtCurrent = rtCurrentRounded + rtTimePerFrame;
-					}
+					// Move current time to the next known or estimated video frame timing
+					rtCurrent = GetFrameTime(rtCurrent, rtTimePerFrame);
 				} else {
 					rtCurrent = m_rtNow;
 				}
@@ -572,11 +737,24 @@ DWORD CSubPicQueue::ThreadProc()
 							rtStopReal = rtStop;
 						}
 
+						const int nQualityLevel = m_nQualityLevel;
+						if (m_bAdaptiveQuality || nQualityLevel != nAppliedQualityLevel) {
+							pSubPicProvider->SetRenderQuality(nQualityLevel);
+							nAppliedQualityLevel = nQualityLevel;
+						}
+						const auto renderStart = std::chrono::steady_clock::now();
+						REFERENCE_TIME rtCovered = 0; // display duration of an animated subpic
+
 						HRESULT hr;
 						if (bIsAnimated) {
+							REFERENCE_TIME rtNextFrame = GetFrameTime(rtCurrent + 1, rtTimePerFrame);
+							if (nQualityLevel >= 2 && rtNextFrame < rtStopReal) {
+								// Halve the animation rate, a subpic spans two frames
+								rtNextFrame = GetFrameTime(rtNextFrame + 1, rtTimePerFrame);
+							}
 							// 3/4 is a magic number we use to avoid reusing the wrong frame due to slight
 							// misprediction of the frame end time
-							hr = RenderTo(pStatic, rtCurrent, std::min(rtCurrent + rtTimePerFrame * 3 / 4, rtStopReal), fps, bIsAnimated);
+							hr = RenderTo(pStatic, rtCurrent, std::min(rtCurrent + (rtNextFrame - rtCurrent) * 3 / 4, rtStopReal), fps, bIsAnimated);
 							// Set the segment start and stop timings
 							pStatic->SetSegmentStart(rtStart);
 							// The stop timing can be moved so that the duration from the current start time
@@ -584,8 +762,9 @@ DWORD CSubPicQueue::ThreadProc()
 							// avoids missing subtitle frame due to rounding errors in the timings.
 							// At worst this can cause a segment to be displayed for one more frame than expected
 							// but it's much less annoying than having the subtitle disappearing for one frame
-							pStatic->SetSegmentStop(std::max(rtCurrent + rtTimePerFrame, rtStopReal));
-							rtCurrent = std::min(rtCurrent + rtTimePerFrame, rtStopReal);
+							pStatic->SetSegmentStop(std::max(rtNextFrame, rtStopReal));
+							rtCovered = std::min(rtNextFrame, rtStopReal) - rtCurrent;
+							rtCurrent = std::min(rtNextFrame, rtStopReal);
 						} else {
 							hr = RenderTo(pStatic, rtStart, rtStopReal, fps, bIsAnimated);
 							// Non-animated subtitles aren't part of a segment
@@ -619,6 +798,16 @@ DWORD CSubPicQueue::ThreadProc()
 
 						pSubPic->SetType(sType);
 
+						// Only the animated subpics have to be rendered before they are displayed
+						if (bIsAnimated && rtCovered > 0) {
+							const auto renderTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - renderStart);
+							double load = renderTime.count() * 10.0 / rtCovered;
+							if (m_rtNow > rtCurrent) {
+								load = std::max(load, 1.0); // the queue is late
+							}
+							UpdateQualityLevel(load);
+						}
+
 						// Try to enqueue the subpic, if the queue is full stop rendering
 						if (!EnqueueSubPic(pSubPic, false)) {
 							bStopRendering = true;
@@ -685,6 +874,17 @@ STDMETHODIMP CSubPicQueueNoThread::Invalidate(REFERENCE_TIME rtInvalidate)
 	return S_OK;
 }
 
+STDMETHODIMP CSubPicQueueNoThread::InvalidateRange(REFERENCE_TIME rtStart, REFERENCE_TIME rtStop)
+{
+	CAutoLock cQueueLock(&m_csLock);
+
+	if (m_pSubPic && m_pSubPic->GetStart() < rtStop && m_pSubPic->GetStop() > rtStart) {
+		m_pSubPic.Release();
+	}
+
+	return S_OK;
+}
+
 STDMETHODIMP_(bool) CSubPicQueueNoThread::LookupSubPic(REFERENCE_TIME rtNow, CComPtr<ISubPic>& ppSubPic)
 {
 	// CSubPicQueueNoThread is always blocking so bAdviseBlocking doesn't matter anyway
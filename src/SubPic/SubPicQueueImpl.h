@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <condition_variable>
@@ -85,6 +86,9 @@ private:
 	CCritSec m_csSubPicProvider;
 	std::shared_ptr<SubPicProviderWithSharedLock> m_pSubPicProviderWithSharedLock;
 
+	std::mutex m_mutexFrameTimes;
+	std::deque<REFERENCE_TIME> m_frameTimes; // known frame times, the past ones are dropped by SetTime()
+
 protected:
 	double m_fps = DEFAULT_FPS;
 	REFERENCE_TIME m_rtTimePerFrame = std::llround(10000000.0 / DEFAULT_FPS);
@@ -99,6 +103,10 @@ protected:
 
 	HRESULT RenderTo(ISubPic* pSubPic, REFERENCE_TIME rtStart, REFERENCE_TIME rtStop, double fps, BOOL bIsAnimated);
 
+	// Start time of the first video frame at or after rt, known or predicted from the last
+	// known frame and its duration.
+	REFERENCE_TIME GetFrameTime(REFERENCE_TIME rt, REFERENCE_TIME rtTimePerFrame);
+
 public:
 	CSubPicQueueImpl(ISubPicAllocator* pAllocator, HRESULT* phr);
 	virtual ~CSubPicQueueImpl();
@@ -114,6 +122,9 @@ public:
 	STDMETHODIMP SetFPS(double fps);
 	STDMETHODIMP SetTime(REFERENCE_TIME rtNow);
 
+	STDMETHODIMP SetFrameTimes(const REFERENCE_TIME* pFrameTimes, size_t nCount);
+	STDMETHODIMP GetPoolStats(size_t& nPooled, size_t& nHighWater);
+
 	/*
 	STDMETHODIMP Invalidate(REFERENCE_TIME rtInvalidate = -1) PURE;
 	STDMETHODIMP_(bool) LookupSubPic(REFERENCE_TIME rtNow, ISubPic** ppSubPic) PURE;
@@ -148,8 +159,20 @@ protected:
 	bool m_bInvalidate = false;
 	REFERENCE_TIME m_rtInvalidate = 0;
 
+	std::atomic<UINT64> m_nFrames = 0;       // lookups that found a subpic
+	std::atomic<UINT64> m_nMispredicted = 0; // of which the subpic was rendered for another time
+	std::atomic<UINT64> m_nDropped = 0;      // subpics that expired before being displayed
+
+	// adaptive quality, the load is the average render time of an animated subpic relative to its display duration
+	static const int MAX_QUALITY_LEVEL = 3;
+	std::atomic<bool> m_bAdaptiveQuality = false;
+	std::atomic<int> m_nQualityLevel = 0;
+	std::atomic<double> m_renderLoad = 0.0;
+	int m_nQualityLevelAge = 0; // renders since the last level change
+
 	bool EnqueueSubPic(CComPtr<ISubPic>& pSubPic, bool bBlocking);
 	REFERENCE_TIME GetCurrentRenderingTime();
+	void UpdateQualityLevel(double load);
 
 	// CAMThread
 	virtual DWORD ThreadProc();
@@ -164,11 +187,17 @@ public:
 	STDMETHODIMP SetTime(REFERENCE_TIME rtNow);
 
 	STDMETHODIMP Invalidate(REFERENCE_TIME rtInvalidate = -1);
+	STDMETHODIMP InvalidateRange(REFERENCE_TIME rtStart, REFERENCE_TIME rtStop);
 	STDMETHODIMP_(bool) LookupSubPic(REFERENCE_TIME rtNow, CComPtr<ISubPic> &pSubPic);
 	STDMETHODIMP_(bool) LookupSubPic(REFERENCE_TIME rtNow, bool bAdviseBlocking, CComPtr<ISubPic>& pSubPic);
 
 	STDMETHODIMP GetStats(int& nSubPics, REFERENCE_TIME& rtNow, REFERENCE_TIME& rtStart, REFERENCE_TIME& rtStop);
 	STDMETHODIMP GetStats(int nSubPic, REFERENCE_TIME& rtStart, REFERENCE_TIME& rtStop);
+
+	STDMETHODIMP GetFrameStats(UINT64& nFrames, UINT64& nMispredicted, UINT64& nDropped);
+
+	STDMETHODIMP SetAdaptiveQuality(bool bAdaptive);
+	STDMETHODIMP GetQualityStats(int& nLevel, double& load);
 };
 
 class CSubPicQueueNoThread : public CSubPicQueueImpl
@@ -186,6 +215,7 @@ public:
 	// ISubPicQueue
 
 	STDMETHODIMP Invalidate(REFERENCE_TIME rtInvalidate = -1);
+	STDMETHODIMP InvalidateRange(REFERENCE_TIME rtStart, REFERENCE_TIME rtStop);
 	STDMETHODIMP_(bool) LookupSubPic(REFERENCE_TIME rtNow, CComPtr<ISubPic> &pSubPic);
 	STDMETHODIMP_(bool) LookupSubPic(REFERENCE_TIME rtNow, bool bAdviseBlocking, CComPtr<ISubPic>& pSubPic);
 
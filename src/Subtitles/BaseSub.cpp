@@ -69,7 +69,39 @@ void CBaseSub::FinalizeRender(SubPicDesc& spd)
 			hr = m_resample.Process(spd.bits, m_spd.bits);
 		}
 		ASSERT(hr == S_OK);
+
+		m_resizedKeys.clear();
+		if (S_OK == hr && !m_renderKeys.empty()) {
+			const int rowSize = spd.w * 4;
+			if (!m_pResizedBuff || m_resizedSize != CSize(spd.w, spd.h)) {
+				m_pResizedBuff.reset(new(std::nothrow) BYTE[rowSize * spd.h]);
+				m_resizedSize = CSize(spd.w, spd.h);
+			}
+
+			if (m_pResizedBuff) {
+				for (int y = 0; y < spd.h; y++) {
+					memcpy(m_pResizedBuff.get() + rowSize * y, spd.bits + spd.pitch * y, rowSize);
+				}
+				m_resizedKeys       = m_renderKeys;
+				m_resizedSourceSize = CSize(m_spd.w, m_spd.h);
+			}
+		}
+	}
+}
+
+bool CBaseSub::RenderResizedFromCache(SubPicDesc& spd, int nWidth, int nHeight)
+{
+	if ((spd.w == nWidth && spd.h == nHeight) || m_renderKeys.empty() || m_renderKeys != m_resizedKeys
+			|| m_resizedSize != CSize(spd.w, spd.h) || m_resizedSourceSize != CSize(nWidth, nHeight)) {
+		return false;
 	}
+
+	const int rowSize = spd.w * 4;
+	for (int y = 0; y < spd.h; y++) {
+		memcpy(spd.bits + spd.pitch * y, m_pResizedBuff.get() + rowSize * y, rowSize);
+	}
+
+	return true;
 }
 
 HRESULT CBaseSub::SetConvertType(LPCWSTR _yuvMatrix, ColorConvert::convertType _convertType)
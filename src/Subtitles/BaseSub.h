@@ -57,6 +57,12 @@ protected :
 	void					InitSpd(SubPicDesc& spd, int nWidth, int nHeight);
 	void					FinalizeRender(SubPicDesc& spd);
 
+	// Bitmap ids and positions of the objects drawn by the current render
+	std::vector<LONG64>		m_renderKeys;
+
+	// Resized frame of the last render, reused while the same objects are drawn at the same size
+	bool					RenderResizedFromCache(SubPicDesc& spd, int nWidth, int nHeight);
+
 	enum class YUVMATRIX
 	{
 		UNKNOWN,
@@ -68,4 +74,10 @@ protected :
 	ColorConvert::convertType	convertType;
 
 	bool m_bForced = false;
+
+private:
+	std::vector<LONG64>		m_resizedKeys;
+	std::unique_ptr<BYTE[]>	m_pResizedBuff;
+	CSize					m_resizedSize;
+	CSize					m_resizedSourceSize;
 };
@@ -23,10 +23,38 @@
 #include "ColorConvert.h"
 #include "DSUtil/GolombBuffer.h"
 #include <d3d9types.h>
+#include <emmintrin.h>
+
+static volatile LONG64 s_nBitmapCounter = 0;
+
+// Color of a pixel of a cleared (transparent) subpicture after FillSolidRect()
+static inline DWORD BlendOnTransparent(DWORD color)
+{
+	const DWORD a  = (color >> 24) + 1;
+	const DWORD ia = 256 - (color >> 24);
+
+	return ((((color & 0x00ff00ff) * a) & 0xff00ff00) >> 8) |
+		   ((((color & 0x0000ff00) * a) & 0x00ff0000) >> 8) |
+		   ((0x00ff0000 * ia) & 0xff000000);
+}
+
+// Draws a pixel of a decoded bitmap over a pixel which is already drawn
+static inline DWORD BlendOver(DWORD src, DWORD dst)
+{
+	const DWORD ia = (src >> 24) + 1;
+	DWORD ret = ((((dst >> 24) * ia) >> 8) << 24);
+	for (int shift = 0; shift < 24; shift += 8) {
+		const DWORD c = ((src >> shift) & 0xff) + ((((dst >> shift) & 0xff) * ia) >> 8);
+		ret |= std::min(c, 0xffUL) << shift;
+	}
+
+	return ret;
+}
 
 CompositionObject::CompositionObject()
 {
 	fill_u32(m_Colors, 0, std::size(m_Colors));
+	InvalidateBitmap();
 }
 
 CompositionObject::~CompositionObject()
@@ -36,14 +64,27 @@ CompositionObject::~CompositionObject()
 
 void CompositionObject::SetPalette(int nNbEntry, HDMV_PALETTE* pPalette, bool bRec709, ColorConvert::convertType type/* = ColorConvert::convertType::DEFAULT*/, bool bIsRGB/* = false*/)
 {
+	bool bChanged = m_nColorNumber != nNbEntry;
+
 	m_nColorNumber = nNbEntry;
 	for (int i = 0; i < nNbEntry; i++) {
+		DWORD color;
 		if (bIsRGB) {
-			m_Colors[pPalette[i].entry_id] = D3DCOLOR_ARGB(pPalette[i].T, pPalette[i].Y, pPalette[i].Cr, pPalette[i].Cb);
+			color = D3DCOLOR_ARGB(pPalette[i].T, pPalette[i].Y, pPalette[i].Cr, pPalette[i].Cb);
 		} else {
-			m_Colors[pPalette[i].entry_id] = ColorConvert::YCrCbToRGB(pPalette[i].T, pPalette[i].Y, pPalette[i].Cr, pPalette[i].Cb, bRec709, type);
+			color = ColorConvert::YCrCbToRGB(pPalette[i].T, pPalette[i].Y, pPalette[i].Cr, pPalette[i].Cb, bRec709, type);
+		}
+
+		if (m_Colors[pPalette[i].entry_id] != color) {
+			m_Colors[pPalette[i].entry_id] = color;
+			bChanged = true;
 		}
 	}
+
+	// DVB subtitles set the palette for every render, keep the bitmap when it is the same
+	if (bChanged) {
+		InvalidateBitmap();
+	}
 }
 
 void CompositionObject::SetRLEData(const BYTE* pBuffer, int nSize, int nTotalSize)
@@ -55,6 +96,8 @@ void CompositionObject::SetRLEData(const BYTE* pBuffer, int nSize, int nTotalSiz
 	m_nRLEPos		= std::min(nSize, nTotalSize);
 
 	memcpy(m_pRLEData, pBuffer, std::min(nSize, nTotalSize));
+
+	InvalidateBitmap();
 }
 
 void CompositionObject::AppendRLEData(const BYTE* pBuffer, int nSize)
@@ -63,6 +106,111 @@ void CompositionObject::AppendRLEData(const BYTE* pBuffer, int nSize)
 	if (m_nRLEPos + nSize <= m_nRLEDataSize) {
 		memcpy(m_pRLEData + m_nRLEPos, pBuffer, nSize);
 		m_nRLEPos += nSize;
+
+		InvalidateBitmap();
+	}
+}
+
+void CompositionObject::InvalidateBitmap()
+{
+	m_bitmap.clear();
+	m_nBitmapId = InterlockedIncrement64(&s_nBitmapCounter);
+}
+
+LONG64 CompositionObject::GetBitmapId()
+{
+	// DVB objects take the size of their region, which may change between renders
+	if (!m_bitmap.empty() && !IsBitmapValid()) {
+		InvalidateBitmap();
+	}
+
+	return m_nBitmapId;
+}
+
+void CompositionObject::FreeBitmap()
+{
+	if (m_bitmap.capacity()) {
+		std::vector<DWORD>().swap(m_bitmap);
+		m_nBitmapId = InterlockedIncrement64(&s_nBitmapCounter);
+	}
+}
+
+bool CompositionObject::AllocBitmap(SubPicDesc& spd)
+{
+	if (m_width <= 0 || m_height <= 0) {
+		return false;
+	}
+
+	if (!m_bitmap.empty()) {
+		InvalidateBitmap();
+	}
+
+	m_nBitmapWidth  = m_width;
+	m_nBitmapHeight = m_height;
+	m_bitmap.assign((size_t)m_width * m_height, 0xFF000000);
+
+	spd.type    = 0;
+	spd.w       = m_width;
+	spd.h       = m_height;
+	spd.bpp     = 32;
+	spd.pitch   = m_width * 4;
+	spd.bits    = (BYTE*)m_bitmap.data();
+	spd.vidrect = CRect(0, 0, spd.w, spd.h);
+
+	return true;
+}
+
+void CompositionObject::DrawBitmap(SubPicDesc& spd, int x, int y) const
+{
+	const int x0 = std::max(x, 0);
+	const int y0 = std::max(y, 0);
+	const int x1 = std::min(x + m_nBitmapWidth, spd.w);
+	const int y1 = std::min(y + m_nBitmapHeight, spd.h);
+	if (m_bitmap.empty() || x0 >= x1 || y0 >= y1) {
+		return;
+	}
+
+	const int width = x1 - x0;
+	const __m128i transparent = _mm_set1_epi32(0xFF000000);
+
+	for (int j = y0; j < y1; j++) {
+		const DWORD* src = &m_bitmap[(size_t)(j - y) * m_nBitmapWidth + (x0 - x)];
+		DWORD* dst = (DWORD*)(spd.bits + spd.pitch * j) + x0;
+
+		int i = 0;
+		for (; i + 4 <= width; i += 4) {
+			const __m128i s = _mm_loadu_si128((const __m128i*)&src[i]);
+			const __m128i s_transparent = _mm_cmpeq_epi32(s, transparent);
+			if (_mm_movemask_epi8(s_transparent) == 0xFFFF) {
+				continue;
+			}
+
+			const __m128i d = _mm_loadu_si128((const __m128i*)&dst[i]);
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(d, transparent)) == 0xFFFF) {
+				// Nothing is drawn there yet, copy the pixels of the bitmap
+				_mm_storeu_si128((__m128i*)&dst[i], _mm_or_si128(_mm_and_si128(s_transparent, d), _mm_andnot_si128(s_transparent, s)));
+			} else {
+				for (int k = i; k < i + 4; k++) {
+					if (src[k] != 0xFF000000) {
+						dst[k] = dst[k] == 0xFF000000 ? src[k] : BlendOver(src[k], dst[k]);
+					}
+				}
+			}
+		}
+		for (; i < width; i++) {
+			if (src[i] != 0xFF000000) {
+				dst[i] = dst[i] == 0xFF000000 ? src[i] : BlendOver(src[i], dst[i]);
+			}
+		}
+	}
+}
+
+void CompositionObject::FillRun(SubPicDesc& spd, SHORT nX, SHORT nY, SHORT nCount, DWORD color) const
+{
+	const int x0 = std::max<int>(nX, 0);
+	const int x1 = std::min<int>(nX + nCount, spd.w);
+	if (nY >= 0 && nY < spd.h && x0 < x1) {
+		FillSolidRect(spd, x0, nY, x1 - x0, 1, color);
 	}
 }
 
@@ -72,38 +220,66 @@ void CompositionObject::RenderHdmv(SubPicDesc& spd, SubPicDesc* spdResized)
 		return;
 	}
 
-	CGolombBuffer	GBuffer (m_pRLEData, m_nRLEDataSize);
-	BYTE			bTemp;
-	BYTE			bSwitch;
+	if (!IsBitmapValid()) {
+		DecodeHdmv();
+	}
+
+	DrawBitmap(spdResized ? *spdResized : spd, m_horizontal_position, m_vertical_position);
+}
+
+void CompositionObject::DecodeHdmv()
+{
+	SubPicDesc spd;
+	if (!AllocBitmap(spd)) {
+		return;
+	}
 
-	BYTE			nPaletteIndex = 0;
-	SHORT			nCount;
-	SHORT			nX	= m_horizontal_position;
-	SHORT			nY	= m_vertical_position;
+	DWORD colors[256];
+	for (size_t i = 0; i < std::size(colors); i++) {
+		colors[i] = BlendOnTransparent(m_Colors[i]);
+	}
 
-	while ((nY < (m_vertical_position + m_height)) && !GBuffer.IsEOF()) {
-		bTemp = GBuffer.ReadByte();
+	const BYTE* p   = m_pRLEData;
+	const BYTE* end = m_pRLEData + m_nRLEDataSize;
+	DWORD* row      = m_bitmap.data();
+	int nX          = 0;
+	int nY          = 0;
 
-		nPaletteIndex = bTemp;
-		nCount		  = 1;
+	while (nY < m_height && p < end) {
+		BYTE nPaletteIndex = *p++;
+		int nCount         = 1;
 
-		if (bTemp == 0x00) {
-			bSwitch	= GBuffer.ReadByte();
-			nCount	= bSwitch & 0x3f;
+		if (nPaletteIndex == 0x00) {
+			if (p >= end) {
+				break;
+			}
+			const BYTE bSwitch = *p++;
+			nCount = bSwitch & 0x3f;
 			if (bSwitch & 0x40) {
-				nCount = (nCount << 8) + GBuffer.ReadByte();
+				if (p >= end) {
+					break;
+				}
+				nCount = (nCount << 8) + *p++;
+			}
+			if (bSwitch & 0x80) {
+				if (p >= end) {
+					break;
+				}
+				nPaletteIndex = *p++;
 			}
-			nPaletteIndex = bSwitch & 0x80 ? GBuffer.ReadByte() : 0;
 		}
 
 		if (nCount > 0) {
-			if (nPaletteIndex != 0xFF) {	// Fully transparent (section 9.14.4.2.2.1.1)
-				FillSolidRect(spdResized ? *spdResized : spd, nX, nY, nCount, 1, m_Colors[nPaletteIndex]);
+			// Runs are clipped to the object, a corrupted stream must not write over the next row
+			nCount = std::min(nCount, m_width - nX);
+			if (nCount > 0 && nPaletteIndex != 0xFF) {	// Fully transparent (section 9.14.4.2.2.1.1)
+				fill_u32(row + nX, colors[nPaletteIndex], nCount);
 			}
 			nX += nCount;
 		} else {
 			nY++;
-			nX = m_horizontal_position;
+			nX = 0;
+			row += m_width;
 		}
 	}
 }
@@ -114,6 +290,20 @@ void CompositionObject::RenderDvb(SubPicDesc& spd, SHORT nX, SHORT nY, SubPicDes
 		return;
 	}
 
+	if (!IsBitmapValid()) {
+		DecodeDvb();
+	}
+
+	DrawBitmap(spdResized ? *spdResized : spd, nX, nY);
+}
+
+void CompositionObject::DecodeDvb()
+{
+	SubPicDesc spd;
+	if (!AllocBitmap(spd)) {
+		return;
+	}
+
 	CGolombBuffer	gb(m_pRLEData, m_nRLEDataSize);
 	SHORT			sTopFieldLength;
 	SHORT			sBottomFieldLength;
@@ -121,8 +311,8 @@ void CompositionObject::RenderDvb(SubPicDesc& spd, SHORT nX, SHORT nY, SubPicDes
 	sTopFieldLength		= gb.ReadShort();
 	sBottomFieldLength	= gb.ReadShort();
 
-	DvbRenderField(spdResized ? *spdResized : spd, gb, nX, nY,   sTopFieldLength);
-	DvbRenderField(spdResized ? *spdResized : spd, gb, nX, nY+1, sBottomFieldLength);
+	DvbRenderField(spd, gb, 0, 0, sTopFieldLength);
+	DvbRenderField(spd, gb, 0, 1, sBottomFieldLength);
 }
 
 void CompositionObject::DvbRenderField(SubPicDesc& spd, CGolombBuffer& gb, SHORT nXStart, SHORT nYStart, SHORT nLength)
@@ -214,7 +404,7 @@ void CompositionObject::Dvb2PixelsCodeString(SubPicDesc& spd, CGolombBuffer& gb,
 		}
 
 		if (nCount>0) {
-			FillSolidRect(spd, nX, nY, nCount, 1, m_Colors[nPaletteIndex]);
+			FillRun(spd, nX, nY, nCount, m_Colors[nPaletteIndex]);
 			nX += nCount;
 		}
 	}
@@ -277,7 +467,7 @@ void CompositionObject::Dvb4PixelsCodeString(SubPicDesc& spd, CGolombBuffer& gb,
 #endif
 
 		if (nCount>0) {
-			FillSolidRect(spd, nX, nY, nCount, 1, m_Colors[nPaletteIndex]);
+			FillRun(spd, nX, nY, nCount, m_Colors[nPaletteIndex]);
 			nX += nCount;
 		}
 	}
@@ -317,7 +507,7 @@ void CompositionObject::Dvb8PixelsCodeString(SubPicDesc& spd, CGolombBuffer& gb,
 		}
 
 		if (nCount>0) {
-			FillSolidRect(spd, nX, nY, nCount, 1, m_Colors[nPaletteIndex]);
+			FillRun(spd, nX, nY, nCount, m_Colors[nPaletteIndex]);
 			nX += nCount;
 		}
 	}
@@ -73,6 +73,11 @@ public :
 	void				SetPalette(int nNbEntry, HDMV_PALETTE* pPalette, bool bRec709, ColorConvert::convertType type = ColorConvert::convertType::DEFAULT, bool bIsRGB = false);
 	const bool			HavePalette() { return m_nColorNumber > 0; };
 
+	// Changes whenever the RLE data, the palette or the size change, and when the bitmap is decoded again
+	LONG64				GetBitmapId();
+	// Releases the decoded bitmap of an object which is not displayed
+	void				FreeBitmap();
+
 	CompositionObject* Copy() {
 		CompositionObject* pCompositionObject = DNew CompositionObject(*this);
 		if (m_pRLEData) {
@@ -90,6 +95,20 @@ private :
 	int		m_nColorNumber	= 0;
 	DWORD	m_Colors[256];
 
+	// Decoded bitmap, as it is drawn on a cleared subpicture
+	std::vector<DWORD>	m_bitmap;
+	SHORT				m_nBitmapWidth	= 0;
+	SHORT				m_nBitmapHeight	= 0;
+	LONG64				m_nBitmapId		= 0;
+
+	void	InvalidateBitmap();
+	bool	IsBitmapValid() const { return !m_bitmap.empty() && m_nBitmapWidth == m_width && m_nBitmapHeight == m_height; };
+	bool	AllocBitmap(SubPicDesc& spd);
+	void	DecodeHdmv();
+	void	DecodeDvb();
+	void	DrawBitmap(SubPicDesc& spd, int x, int y) const;
+	void	FillRun(SubPicDesc& spd, SHORT nX, SHORT nY, SHORT nCount, DWORD color) const;
+
 	void	DvbRenderField(SubPicDesc& spd, CGolombBuffer& gb, SHORT nXStart, SHORT nYStart, SHORT nLength);
 	void	Dvb2PixelsCodeString(SubPicDesc& spd, CGolombBuffer& gb, SHORT& nX, SHORT& nY);
 	void	Dvb4PixelsCodeString(SubPicDesc& spd, CGolombBuffer& gb, SHORT& nX, SHORT& nY);
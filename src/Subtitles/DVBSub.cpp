@@ -337,12 +337,31 @@ HRESULT CDVBSub::Render(SubPicDesc& spd, REFERENCE_TIME rt, RECT& bbox)
 {
 	HRESULT hr = E_FAIL;
 
-	if (DVB_PAGE* pPage = FindPage(rt)) {
+	DVB_PAGE* pPage = FindPage(rt);
+
+	// In file mode the pages are kept for the whole playback
+	for (POSITION pos = m_pages.GetHeadPosition(); pos;) {
+		DVB_PAGE* pOtherPage = m_pages.GetNext(pos);
+		if (pOtherPage != pPage) {
+			for (POSITION posO = pOtherPage->objects.GetHeadPosition(); posO;) {
+				pOtherPage->objects.GetNext(posO)->FreeBitmap();
+			}
+		}
+	}
+
+	if (pPage) {
 		pPage->rendered = true;
 		TRACE_DVB(L"DVB - Renderer - %s - %s", ReftimeToString(pPage->rtStart), ReftimeToString(pPage->rtStop));
 
 		const bool bRec709 = yuvMatrix == YUVMATRIX::BT709 ? true : yuvMatrix == YUVMATRIX::BT601 ? false : m_Display.width > 720;
 
+		struct DrawnObject {
+			CompositionObject* pObject;
+			SHORT nX, nY;
+		};
+		std::vector<DrawnObject> objects;
+		m_renderKeys.clear();
+
 		int nRegion = 1, nObject = 1;
 		for (POSITION pos = pPage->regionsPos.GetHeadPosition(); pos; nRegion++) {
 			DVB_REGION_POS regionPos = pPage->regionsPos.GetNext(pos);
@@ -357,8 +376,9 @@ HRESULT CDVBSub::Render(SubPicDesc& spd, REFERENCE_TIME rt, RECT& bbox)
 							pObject->m_height = pRegion->height;
 							pObject->SetPalette(pCLUT->size, pCLUT->palette, bRec709, convertType);
 
-							InitSpd(spd, m_Display.width, m_Display.height);
-							pObject->RenderDvb(spd, nX, nY, m_bResizedRender ? &m_spd : NULL);
+							objects.push_back({ pObject, nX, nY });
+							m_renderKeys.push_back(pObject->GetBitmapId());
+							m_renderKeys.push_back(MAKELONG(nX, nY));
 							TRACE_DVB(L" --> %d/%d - %d/%d", nRegion, pPage->regionsPos.GetCount(), nObject, pRegion->objects.GetCount());
 						}
 					}
@@ -371,7 +391,14 @@ HRESULT CDVBSub::Render(SubPicDesc& spd, REFERENCE_TIME rt, RECT& bbox)
 		bbox.right	= spd.w;
 		bbox.bottom	= spd.h;
 
-		FinalizeRender(spd);
+		if (!RenderResizedFromCache(spd, m_Display.width, m_Display.height)) {
+			for (const auto& object : objects) {
+				InitSpd(spd, m_Display.width, m_Display.height);
+				object.pObject->RenderDvb(spd, object.nX, object.nY, m_bResizedRender ? &m_spd : NULL);
+			}
+
+			FinalizeRender(spd);
+		}
 
 		hr = S_OK;
 	}
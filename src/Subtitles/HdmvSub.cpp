@@ -177,11 +177,21 @@ HRESULT CHdmvSub::Render(SubPicDesc& spd, REFERENCE_TIME rt, RECT& bbox)
 
 	const bool bRec709 = yuvMatrix == YUVMATRIX::BT709 ? true : yuvMatrix == YUVMATRIX::BT601 ? false : m_VideoDescriptor.nVideoWidth > 720;
 
+	std::vector<CompositionObject*> objects;
+	m_renderKeys.clear();
+
 	POSITION pos = m_pObjects.GetHeadPosition();
 	while (pos) {
 		CompositionObject* pObject = m_pObjects.GetNext(pos);
 
-		if (pObject && rt >= pObject->m_rtStart && rt < pObject->m_rtStop) {
+		if (!pObject) {
+			continue;
+		}
+
+		if (rt < pObject->m_rtStart || rt >= pObject->m_rtStop) {
+			// In file mode the objects are kept for the whole playback
+			pObject->FreeBitmap();
+		} else {
 			if (pObject->GetRLEDataSize() && pObject->m_width > 0 && pObject->m_height > 0 &&
 					m_VideoDescriptor.nVideoWidth >= (pObject->m_horizontal_position + pObject->m_width) &&
 					m_VideoDescriptor.nVideoHeight >= (pObject->m_vertical_position + pObject->m_height)) {
@@ -217,14 +227,24 @@ HRESULT CHdmvSub::Render(SubPicDesc& spd, REFERENCE_TIME rt, RECT& bbox)
 							  pObject->m_width, pObject->m_height, spd.w, spd.h,
 							  rt, ReftimeToString(rt));
 
-				InitSpd(spd, m_VideoDescriptor.nVideoWidth, m_VideoDescriptor.nVideoHeight);
-				pObject->RenderHdmv(spd, m_bResizedRender ? &m_spd : nullptr);
+				objects.push_back(pObject);
+				m_renderKeys.push_back(pObject->GetBitmapId());
+				m_renderKeys.push_back(MAKELONG(pObject->m_horizontal_position, pObject->m_vertical_position));
 
 				hr = S_OK;
 			}
 		}
 	}
 
+	if (RenderResizedFromCache(spd, m_VideoDescriptor.nVideoWidth, m_VideoDescriptor.nVideoHeight)) {
+		return hr;
+	}
+
+	for (const auto& pObject : objects) {
+		InitSpd(spd, m_VideoDescriptor.nVideoWidth, m_VideoDescriptor.nVideoHeight);
+		pObject->RenderHdmv(spd, m_bResizedRender ? &m_spd : nullptr);
+	}
+
 	FinalizeRender(spd);
 
 	return hr;
@@ -21,7 +21,9 @@
 
 #include "stdafx.h"
 #include <intrin.h>
+#include <deque>
 #include "RTS.h"
+#include "DSUtil/CPUInfo.h"
 #include <moreuuids.h>
 
 #define MAXGDIFONTSIZE 15087
@@ -86,6 +88,7 @@ CWord::CWord(const STSStyle& style, CStringW str, int ktype, int kstart, int ken
 	, m_kstart(kstart)
 	, m_kend(kend)
 	, m_fDrawn(false)
+	, m_fResampleSource(false)
 	, m_p(INT_MAX, INT_MAX)
 	, m_fLineBreak(false)
 	, m_fWhiteSpaceChar(false)
@@ -147,6 +150,8 @@ void CWord::Paint(const CPoint& p, const CPoint& org)
 				}
 			}
 		}
+	} else if (!m_fDrawn && m_renderingCaches.bResampleTransforms && PaintResampled(p, org)) {
+		m_renderingCaches.overlayCache.SetAt(overlayKey, m_pOverlayData);
 	} else {
 		if (!m_fDrawn) {
 			if (m_renderingCaches.outlineCache.Lookup(overlayKey, m_pOutlineData)) {
@@ -197,12 +202,12 @@ void CWord::Paint(const CPoint& p, const CPoint& org)
 
 			m_fDrawn = true;
 
-			if (!Rasterize(p.x & 7, p.y & 7, m_style.fBlur, m_style.fGaussianBlur)) {
+			if (!RasterizeStyle(p.x & 7, p.y & 7)) {
 				return;
 			}
 			m_renderingCaches.overlayCache.SetAt(overlayKey, m_pOverlayData);
 		} else if ((m_p.x & 7) != (p.x & 7) || (m_p.y & 7) != (p.y & 7)) {
-			Rasterize(p.x & 7, p.y & 7, m_style.fBlur, m_style.fGaussianBlur);
+			RasterizeStyle(p.x & 7, p.y & 7);
 			m_renderingCaches.overlayCache.SetAt(overlayKey, m_pOverlayData);
 		}
 	}
@@ -214,6 +219,116 @@ void CWord::Paint(const CPoint& p, const CPoint& org)
 	}
 }
 
+// The blurs are the most costly part of the rasterization, the higher quality levels shorten them
+bool CWord::RasterizeStyle(int xsub, int ysub)
+{
+	int fBlur = m_style.fBlur;
+	double fGaussianBlur = m_style.fGaussianBlur;
+
+	// the reference words of PaintResampled() have their blur scaled too
+	const double blurScale = m_fResampleSource ? RESAMPLE_FACTOR : 1.0;
+
+	switch (m_renderingCaches.nQualityLevel) {
+		case 0:
+			break;
+		case 1:
+			fBlur = std::min(fBlur, 2);
+			fGaussianBlur = std::min(fGaussianBlur, 4.0 * blurScale);
+			break;
+		case 2:
+			fBlur = std::min(fBlur, 1);
+			fGaussianBlur = std::min(fGaussianBlur, 2.0 * blurScale);
+			break;
+		default:
+			// a single box blur pass replaces the gaussian blur
+			fBlur = (fBlur || fGaussianBlur > 0) ? 1 : 0;
+			fGaussianBlur = 0;
+			break;
+	}
+
+	return Rasterize(xsub, ysub, fBlur, fGaussianBlur);
+}
+
+// Rotation and scaling are applied by resampling the overlay of the untransformed word,
+// which is rasterized once at a higher resolution and then cached like any other overlay.
+// Returns false when the result would differ visibly from the exact rasterization.
+bool CWord::PaintResampled(const CPoint& p, const CPoint& org)
+{
+	if (m_fResampleSource
+			|| m_style.fontAngleX != 0 || m_style.fontAngleY != 0
+			|| m_style.borderStyle != 0 || m_style.fBlur
+			|| m_style.outlineWidthX != m_style.outlineWidthY
+			|| m_style.fontScaleX <= 0 || m_style.fontScaleY <= 0) {
+		return false;
+	}
+
+	// The reference scale is quantized to quarter octaves so that scale animations can share it
+	auto refScale = [](double scale) {
+		return 100.0 * pow(2.0, std::ceil(log2(scale / 100.0) * 4.0 - 1e-9) / 4.0);
+	};
+	const double refScaleX = refScale(m_style.fontScaleX);
+	const double refScaleY = refScale(m_style.fontScaleY);
+	const double rx = m_style.fontScaleX / refScaleX;
+	const double ry = m_style.fontScaleY / refScaleY;
+
+	if (m_style.fontAngleZ == 0 && rx == 1.0 && ry == 1.0) {
+		return false; // nothing to gain
+	}
+
+	// The border and the blur are not scaled with the glyph, limit the error to half a pixel
+	const double borderSize = m_style.outlineWidthX / 8.0 + 3.0 * m_style.fGaussianBlur;
+	if ((1.0 - std::min(rx, ry)) * borderSize > 0.5) {
+		return false;
+	}
+
+	std::unique_ptr<CWord> pRefWord(Copy());
+	if (!pRefWord) {
+		return false;
+	}
+	pRefWord->m_fResampleSource = true;
+	pRefWord->m_style.fontAngleZ = 0;
+	pRefWord->m_style.fontScaleX = refScaleX * RESAMPLE_FACTOR;
+	pRefWord->m_style.fontScaleY = refScaleY * RESAMPLE_FACTOR;
+	pRefWord->m_style.outlineWidthX *= RESAMPLE_FACTOR;
+	pRefWord->m_style.outlineWidthY *= RESAMPLE_FACTOR;
+	pRefWord->m_style.fGaussianBlur *= RESAMPLE_FACTOR;
+	pRefWord->Paint(CPoint(0, 0), CPoint(0, 0));
+
+	const COverlayDataSharedPtr pRefOverlay = pRefWord->m_pOverlayData;
+	if (!pRefOverlay) {
+		return false;
+	}
+
+	// Same as Transform() without \frx and \fry: P' = K * R * (S * P - o) + o,
+	// where P is the path of the word and o the origin relative to it.
+	// The reference path is P_ref = K * S_ref * P, so P' = K * R * D * K^-1 * P_ref + o - K * R * o
+	const double xzoomf = m_scalex * 20000.0;
+	const double yzoomf = m_scaley * 20000.0;
+	const double kx = xzoomf / std::max(xzoomf, 1000.0);
+	const double ky = yzoomf / std::max(yzoomf, 1000.0);
+	const double caz = cos((M_PI / 180.0) * m_style.fontAngleZ);
+	const double saz = sin((M_PI / 180.0) * m_style.fontAngleZ);
+	const double dx = rx / RESAMPLE_FACTOR;
+	const double dy = ry / RESAMPLE_FACTOR;
+
+	const double m00 = caz * dx, m01 = kx * saz * dy / ky;
+	const double m10 = -ky * saz * dx / kx, m11 = caz * dy;
+
+	const double ox = (org.x - p.x) * 8.0, oy = (org.y - p.y) * 8.0;
+	const double cx = ox - kx * (caz * ox + saz * oy);
+	const double cy = oy - ky * (-saz * ox + caz * oy);
+
+	// Reference pixel (u, v) is centered at P_ref = 8 * (mOffset + 8 * (u, v) + 4) and
+	// destination pixel (i, j) at P' = 8 * (8 * (i, j) + 4 - sub)
+	const double rox = pRefOverlay->mOffsetX + 4, roy = pRefOverlay->mOffsetY + 4;
+	const double m[6] = {
+		m00, m01, (m00 * rox + m01 * roy + cx / 8 + (p.x & 7) - 4) / 8,
+		m10, m11, (m10 * rox + m11 * roy + cy / 8 + (p.y & 7) - 4) / 8
+	};
+
+	return ResampleOverlay(*pRefOverlay, m, p.x, p.y);
+}
+
 bool CWord::CreateOpaqueBox()
 {
 	if (m_pOpaqueBox) {
@@ -296,144 +411,263 @@ void CWord::Transform(const CPoint &org ) // Transform_C
 	}
 }
 #else
-void CWord::Transform(const CPoint &org ) // Transform_SSE2
-{
-	// SSE2 code
-	// speed up ~1.5-1.7x
-	const __m128 __xshift = _mm_set_ps1((float)m_style.fontShiftX);
-	const __m128 __yshift = _mm_set_ps1((float)m_style.fontShiftY);
-
-	const __m128 __xorg = _mm_set_ps1((float)org.x);
-	const __m128 __yorg = _mm_set_ps1((float)org.y);
-
-	const __m128 __xscale = _mm_set_ps1((float)(m_style.fontScaleX / 100.0));
-	const __m128 __yscale = _mm_set_ps1((float)(m_style.fontScaleY / 100.0));
-	const __m128 __xzoomf = _mm_set_ps1((float)(m_scalex * 20000.0));
-	const __m128 __yzoomf = _mm_set_ps1((float)(m_scaley * 20000.0));
-
-	const __m128 __caz = _mm_set_ps1((float)cos((M_PI / 180.0) * m_style.fontAngleZ));
-	const __m128 __saz = _mm_set_ps1((float)sin((M_PI / 180.0) * m_style.fontAngleZ));
-	const __m128 __cax = _mm_set_ps1((float)cos((M_PI / 180.0) * m_style.fontAngleX));
-	const __m128 __sax = _mm_set_ps1((float)sin((M_PI / 180.0) * m_style.fontAngleX));
-	const __m128 __cay = _mm_set_ps1((float)cos((M_PI / 180.0) * m_style.fontAngleY));
-	const __m128 __say = _mm_set_ps1((float)sin((M_PI / 180.0) * m_style.fontAngleY));
-
-	const __m128 __1000 = _mm_set_ps1(1000.0f);
-
-	int mPathPointsD4 = mPathPoints / 4;
-	int mPathPointsM4 = mPathPoints % 4;
-
-	for (ptrdiff_t i = 0; i < mPathPointsD4 + 1; i++) {
-		__m128 __pointx, __pointy, __tmpx, __tmpy;
-		// we can't use load .-.
-		if (i != mPathPointsD4) {
-			__pointx = _mm_set_ps((float)mpPathPoints[4 * i + 0].x, (float)mpPathPoints[4 * i + 1].x, (float)mpPathPoints[4 * i + 2].x, (float)mpPathPoints[4 * i + 3].x);
-			__pointy = _mm_set_ps((float)mpPathPoints[4 * i + 0].y, (float)mpPathPoints[4 * i + 1].y, (float)mpPathPoints[4 * i + 2].y, (float)mpPathPoints[4 * i + 3].y);
-		} else { // last cycle
-			switch (mPathPointsM4) {
-				default:
-				case 0:
-					continue;
-				case 1:
-					__pointx = _mm_set_ps((float)mpPathPoints[4 * i + 0].x, 0, 0, 0);
-					__pointy = _mm_set_ps((float)mpPathPoints[4 * i + 0].y, 0, 0, 0);
-					break;
-				case 2:
-					__pointx = _mm_set_ps((float)mpPathPoints[4 * i + 0].x, (float)mpPathPoints[4 * i + 1].x, 0, 0);
-					__pointy = _mm_set_ps((float)mpPathPoints[4 * i + 0].y, (float)mpPathPoints[4 * i + 1].y, 0, 0);
-					break;
-				case 3:
-					__pointx = _mm_set_ps((float)mpPathPoints[4 * i + 0].x, (float)mpPathPoints[4 * i + 1].x, (float)mpPathPoints[4 * i + 2].x, 0);
-					__pointy = _mm_set_ps((float)mpPathPoints[4 * i + 0].y, (float)mpPathPoints[4 * i + 1].y, (float)mpPathPoints[4 * i + 2].y, 0);
-					break;
-			}
-		}
+namespace
+{
+	// x' = m00 * x + m01 * y + m02, y' = m10 * x + m11 * y + m12
+	struct CAffineTransform {
+		float m00, m01, m02;
+		float m10, m11, m12;
+	};
 
-		// scale and shift
-		__tmpy = __pointx; // save a copy for calculating __pointy later
-		if (m_style.fontShiftX != 0) {
-			__tmpx = _mm_mul_ps(__xshift, __pointy);
-			__pointx = _mm_add_ps(__pointx, __tmpx);
-		}
-		__pointx = _mm_mul_ps(__pointx, __xscale);
-		__pointx = _mm_sub_ps(__pointx, __xorg);
+	struct C3DTransform {
+		float xshift, yshift;
+		float xorg, yorg;
+		float xscale, yscale;
+		float xzoomf, yzoomf;
+		float caz, saz, cax, sax, cay, say;
+	};
 
-		if (m_style.fontShiftY != 0) {
-			__tmpy = _mm_mul_ps(__yshift, __tmpy); // __tmpy is a copy of __pointx here, because it may otherwise be modified
-			__pointy = _mm_add_ps(__pointy, __tmpy);
+	// Process the points by blocks of N, the remainder goes through a zero padded block
+	template <int N, typename F>
+	__forceinline void TransformPoints(POINT* points, int count, F&& transform)
+	{
+		const int count0 = count & ~(N - 1);
+		for (int i = 0; i < count0; i += N) {
+			transform(points + i);
 		}
-		__pointy = _mm_mul_ps(__pointy, __yscale);
-		__pointy = _mm_sub_ps(__pointy, __yorg);
+		if (count0 < count) {
+			POINT tail[N] = {};
+			memcpy(tail, points + count0, (count - count0) * sizeof(POINT));
+			transform(tail);
+			memcpy(points + count0, tail, (count - count0) * sizeof(POINT));
+		}
+	}
+
+	// Load 4 points as separate x and y vectors
+	__forceinline void LoadPoints_SSE2(const POINT* p, __m128& x, __m128& y)
+	{
+		const __m128 p0 = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));     // x0 y0 x1 y1
+		const __m128 p1 = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 2))); // x2 y2 x3 y3
+		x = _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(2, 0, 2, 0));
+		y = _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(3, 1, 3, 1));
+	}
+
+	// Round and store 4 points
+	__forceinline void StorePoints_SSE2(POINT* p, __m128 x, __m128 y)
+	{
+		const __m128i xi = _mm_cvtps_epi32(x);
+		const __m128i yi = _mm_cvtps_epi32(y);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_unpacklo_epi32(xi, yi));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p + 2), _mm_unpackhi_epi32(xi, yi));
+	}
+
+	// Load 8 points as separate x and y vectors
+	__forceinline void LoadPoints_AVX2(const POINT* p, __m256& x, __m256& y)
+	{
+		const __m256i idx = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+		const __m256i p0 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), idx);     // x0..x3 y0..y3
+		const __m256i p1 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 4)), idx); // x4..x7 y4..y7
+		x = _mm256_cvtepi32_ps(_mm256_permute2x128_si256(p0, p1, 0x20));
+		y = _mm256_cvtepi32_ps(_mm256_permute2x128_si256(p0, p1, 0x31));
+	}
+
+	// Round and store 8 points
+	__forceinline void StorePoints_AVX2(POINT* p, __m256 x, __m256 y)
+	{
+		const __m256i xi = _mm256_cvtps_epi32(x);
+		const __m256i yi = _mm256_cvtps_epi32(y);
+		const __m256i lo = _mm256_unpacklo_epi32(xi, yi); // x0 y0 x1 y1 x4 y4 x5 y5
+		const __m256i hi = _mm256_unpackhi_epi32(xi, yi); // x2 y2 x3 y3 x6 y6 x7 y7
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(p + 4), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
 
-		// rotate
+	void TransformAffine_SSE2(POINT* points, int count, const CAffineTransform& t)
+	{
+		const __m128 m00 = _mm_set_ps1(t.m00), m01 = _mm_set_ps1(t.m01), m02 = _mm_set_ps1(t.m02);
+		const __m128 m10 = _mm_set_ps1(t.m10), m11 = _mm_set_ps1(t.m11), m12 = _mm_set_ps1(t.m12);
 
-		__m128 __xx, __yy;
-		__m128 __zz = _mm_setzero_ps();
+		TransformPoints<4>(points, count, [&](POINT* p) {
+			__m128 x, y;
+			LoadPoints_SSE2(p, x, y);
+			const __m128 xx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m00), _mm_mul_ps(y, m01)), m02);
+			const __m128 yy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m10), _mm_mul_ps(y, m11)), m12);
+			StorePoints_SSE2(p, xx, yy);
+		});
+	}
 
-		// xx = x * caz + y * saz
-		__tmpx   = _mm_mul_ps(__pointx, __caz);      // x * caz
-		__tmpy   = _mm_mul_ps(__pointy, __saz);      // y * saz
-		__xx     = _mm_add_ps(__tmpx, __tmpy);       // xx = x * caz + y * saz;
+	void TransformAffine_AVX2(POINT* points, int count, const CAffineTransform& t)
+	{
+		const __m256 m00 = _mm256_set1_ps(t.m00), m01 = _mm256_set1_ps(t.m01), m02 = _mm256_set1_ps(t.m02);
+		const __m256 m10 = _mm256_set1_ps(t.m10), m11 = _mm256_set1_ps(t.m11), m12 = _mm256_set1_ps(t.m12);
 
-		// yy = -(x * saz - y * caz)
-		__tmpx   = _mm_mul_ps(__pointx, __saz);      // x * saz
-		__tmpy   = _mm_mul_ps(__pointy, __caz);      // y * caz
-		__yy     = _mm_sub_ps(__tmpy, __tmpx);       // yy = -(x * saz - y * caz) = y * caz - x * saz
+		TransformPoints<8>(points, count, [&](POINT* p) {
+			__m256 x, y;
+			LoadPoints_AVX2(p, x, y);
+			const __m256 xx = _mm256_fmadd_ps(x, m00, _mm256_fmadd_ps(y, m01, m02));
+			const __m256 yy = _mm256_fmadd_ps(x, m10, _mm256_fmadd_ps(y, m11, m12));
+			StorePoints_AVX2(p, xx, yy);
+		});
 
-		__pointx = __xx;                             // x = xx
+		// Zero upper halves of YMM registers to avoid AVX/SSE translation penalties
+		_mm256_zeroupper();
+	}
 
-		// y = yy * cax + zz * sax
-		__tmpx   = _mm_mul_ps(__zz, __sax);          // zz * sax
-		__tmpy   = _mm_mul_ps(__yy, __cax);          // yy * cax
-		__pointy = _mm_add_ps(__tmpy, __tmpx);       // y = yy * cax + zz * sax
+	void Transform3D_SSE2(POINT* points, int count, const C3DTransform& t)
+	{
+		const __m128 __xshift = _mm_set_ps1(t.xshift);
+		const __m128 __yshift = _mm_set_ps1(t.yshift);
+		const __m128 __xorg = _mm_set_ps1(t.xorg);
+		const __m128 __yorg = _mm_set_ps1(t.yorg);
+		const __m128 __xscale = _mm_set_ps1(t.xscale);
+		const __m128 __yscale = _mm_set_ps1(t.yscale);
+		const __m128 __xzoomf = _mm_set_ps1(t.xzoomf);
+		const __m128 __yzoomf = _mm_set_ps1(t.yzoomf);
+		const __m128 __caz = _mm_set_ps1(t.caz);
+		const __m128 __saz = _mm_set_ps1(t.saz);
+		const __m128 __cax = _mm_set_ps1(t.cax);
+		const __m128 __sax = _mm_set_ps1(t.sax);
+		const __m128 __cay = _mm_set_ps1(t.cay);
+		const __m128 __say = _mm_set_ps1(t.say);
+		const __m128 __1000 = _mm_set_ps1(1000.0f);
+
+		TransformPoints<4>(points, count, [&](POINT* p) {
+			__m128 __pointx, __pointy;
+			LoadPoints_SSE2(p, __pointx, __pointy);
+
+			// scale and shift
+			const __m128 __x = __pointx;
+			__pointx = _mm_add_ps(__pointx, _mm_mul_ps(__xshift, __pointy));
+			__pointx = _mm_sub_ps(_mm_mul_ps(__pointx, __xscale), __xorg);
+			__pointy = _mm_add_ps(__pointy, _mm_mul_ps(__yshift, __x));
+			__pointy = _mm_sub_ps(_mm_mul_ps(__pointy, __yscale), __yorg);
+
+			// rotate around z, zz is 0 here
+			const __m128 __xx = _mm_add_ps(_mm_mul_ps(__pointx, __caz), _mm_mul_ps(__pointy, __saz)); // xx = x * caz + y * saz
+			const __m128 __yy = _mm_sub_ps(_mm_mul_ps(__pointy, __caz), _mm_mul_ps(__pointx, __saz)); // yy = y * caz - x * saz
+
+			// rotate around x
+			__pointy = _mm_mul_ps(__yy, __cax); // y = yy * cax
+			__m128 __z = _mm_mul_ps(__yy, __sax); // z = yy * sax
+
+			// rotate around y
+			const __m128 __xxx = _mm_add_ps(_mm_mul_ps(__xx, __cay), _mm_mul_ps(__z, __say));        // xx = x * cay + z * say
+			const __m128 __zz = _mm_sub_ps(_mm_mul_ps(__xx, __say), _mm_mul_ps(__z, __cay));         // zz = x * say - z * cay
+
+			// x = xx * xzoomf / std::max(zz + xzoomf, 1000.0) + org.x
+			// y = yy * yzoomf / std::max(zz + yzoomf, 1000.0) + org.y
+			__pointx = _mm_div_ps(_mm_mul_ps(__xxx, __xzoomf), _mm_max_ps(_mm_add_ps(__zz, __xzoomf), __1000));
+			__pointy = _mm_div_ps(_mm_mul_ps(__pointy, __yzoomf), _mm_max_ps(_mm_add_ps(__zz, __yzoomf), __1000));
+
+			StorePoints_SSE2(p, _mm_add_ps(__pointx, __xorg), _mm_add_ps(__pointy, __yorg));
+		});
+	}
+
+	void Transform3D_AVX2(POINT* points, int count, const C3DTransform& t)
+	{
+		const __m256 __xshift = _mm256_set1_ps(t.xshift);
+		const __m256 __yshift = _mm256_set1_ps(t.yshift);
+		const __m256 __xorg = _mm256_set1_ps(t.xorg);
+		const __m256 __yorg = _mm256_set1_ps(t.yorg);
+		const __m256 __xscale = _mm256_set1_ps(t.xscale);
+		const __m256 __yscale = _mm256_set1_ps(t.yscale);
+		const __m256 __xzoomf = _mm256_set1_ps(t.xzoomf);
+		const __m256 __yzoomf = _mm256_set1_ps(t.yzoomf);
+		const __m256 __caz = _mm256_set1_ps(t.caz);
+		const __m256 __saz = _mm256_set1_ps(t.saz);
+		const __m256 __cax = _mm256_set1_ps(t.cax);
+		const __m256 __sax = _mm256_set1_ps(t.sax);
+		const __m256 __cay = _mm256_set1_ps(t.cay);
+		const __m256 __say = _mm256_set1_ps(t.say);
+		const __m256 __1000 = _mm256_set1_ps(1000.0f);
 
-		// z = yy * sax - zz * cax
-		__tmpx   = _mm_mul_ps(__zz, __cax);          // zz * cax
-		__tmpy   = _mm_mul_ps(__yy, __sax);          // yy * sax
-		__zz     = _mm_sub_ps(__tmpy, __tmpx);       // z = yy * sax - zz * cax
+		TransformPoints<8>(points, count, [&](POINT* p) {
+			__m256 __pointx, __pointy;
+			LoadPoints_AVX2(p, __pointx, __pointy);
 
-		// xx = x * cay + z * say
-		__tmpx   = _mm_mul_ps(__pointx, __cay);      // x * cay
-		__tmpy   = _mm_mul_ps(__zz, __say);          // z * say
-		__xx     = _mm_add_ps(__tmpx, __tmpy);       // xx = x * cay + z * say
+			// scale and shift
+			const __m256 __x = __pointx;
+			__pointx = _mm256_fmsub_ps(_mm256_fmadd_ps(__xshift, __pointy, __pointx), __xscale, __xorg);
+			__pointy = _mm256_fmsub_ps(_mm256_fmadd_ps(__yshift, __x, __pointy), __yscale, __yorg);
 
-		__yy     = __pointy;                         // yy = y
+			// rotate around z, zz is 0 here
+			const __m256 __xx = _mm256_fmadd_ps(__pointx, __caz, _mm256_mul_ps(__pointy, __saz));  // xx = x * caz + y * saz
+			const __m256 __yy = _mm256_fmsub_ps(__pointy, __caz, _mm256_mul_ps(__pointx, __saz));  // yy = y * caz - x * saz
 
-		// zz = x * say - z * cay
-		__tmpx   = _mm_mul_ps(__pointx, __say);      // x * say
-		__zz     = _mm_mul_ps(__zz, __cay);          // z * cay
-		__zz     = _mm_sub_ps(__tmpx, __zz);         // zz = x * say - z * cay
+			// rotate around x
+			__pointy = _mm256_mul_ps(__yy, __cax); // y = yy * cax
+			const __m256 __z = _mm256_mul_ps(__yy, __sax); // z = yy * sax
 
-		// x = xx * xzoomf / std::max((zz + xzoomf), 1000.0);
-		// y = yy * yzoomf / std::max((zz + yzoomf), 1000.0);
-		__m128 __tmpzz = _mm_add_ps(__zz, __xzoomf); // zz + xzoomf
+			// rotate around y
+			const __m256 __xxx = _mm256_fmadd_ps(__xx, __cay, _mm256_mul_ps(__z, __say)); // xx = x * cay + z * say
+			const __m256 __zz = _mm256_fmsub_ps(__xx, __say, _mm256_mul_ps(__z, __cay));  // zz = x * say - z * cay
 
-		__xx     = _mm_mul_ps(__xx, __xzoomf);       // xx * xzoomf
-		__pointx = _mm_div_ps(__xx, _mm_max_ps(__tmpzz, __1000)); // x = (xx * xzoomf) / std::max((zz + xzoomf), 1000.0)
+			__pointx = _mm256_div_ps(_mm256_mul_ps(__xxx, __xzoomf), _mm256_max_ps(_mm256_add_ps(__zz, __xzoomf), __1000));
+			__pointy = _mm256_div_ps(_mm256_mul_ps(__pointy, __yzoomf), _mm256_max_ps(_mm256_add_ps(__zz, __yzoomf), __1000));
 
-		__tmpzz  = _mm_add_ps(__zz, __yzoomf);       // zz + yzoomf
+			StorePoints_AVX2(p, _mm256_add_ps(__pointx, __xorg), _mm256_add_ps(__pointy, __yorg));
+		});
 
-		__yy     = _mm_mul_ps(__yy, __yzoomf);       // yy * yzoomf
-		__pointy = _mm_div_ps(__yy, _mm_max_ps(__tmpzz, __1000)); // y = yy * yzoomf / std::max((zz + yzoomf), 1000.0);
+		// Zero upper halves of YMM registers to avoid AVX/SSE translation penalties
+		_mm256_zeroupper();
+	}
+}
 
-		__pointx = _mm_add_ps(__pointx, __xorg);     // x = x + org.x
-		__pointy = _mm_add_ps(__pointy, __yorg);     // y = y + org.y
+void CWord::Transform(const CPoint &org )
+{
+	const bool bUseAVX2 = m_bUseAVX2 && CPUInfo::HaveFMA3();
 
-		// round to integer
-		__m128i __pointxRounded = _mm_cvtps_epi32(__pointx);
-		__m128i __pointyRounded = _mm_cvtps_epi32(__pointy);
+	const double scalex = m_style.fontScaleX / 100.0;
+	const double scaley = m_style.fontScaleY / 100.0;
+	const double xzoomf = m_scalex * 20000.0;
+	const double yzoomf = m_scaley * 20000.0;
 
-		if (i == mPathPointsD4) { // last cycle
-			for (int k = 0; k < mPathPointsM4; k++) {
-				mpPathPoints[i * 4 + k].x = __pointxRounded.m128i_i32[3 - k];
-				mpPathPoints[i * 4 + k].y = __pointyRounded.m128i_i32[3 - k];
-			}
+	const double caz = cos((M_PI / 180.0) * m_style.fontAngleZ);
+	const double saz = sin((M_PI / 180.0) * m_style.fontAngleZ);
+
+	if (m_style.fontAngleX == 0 && m_style.fontAngleY == 0) {
+		// Without \frx and \fry the perspective projection is a constant scale,
+		// so the whole transformation reduces to an affine one.
+		const double kx = xzoomf / std::max(xzoomf, 1000.0);
+		const double ky = yzoomf / std::max(yzoomf, 1000.0);
+		const double ox = org.x, oy = org.y;
+
+		CAffineTransform t;
+		t.m00 = float(kx * (caz * scalex + saz * scaley * m_style.fontShiftY));
+		t.m01 = float(kx * (caz * scalex * m_style.fontShiftX + saz * scaley));
+		t.m02 = float(kx * (-caz * ox - saz * oy) + ox);
+		t.m10 = float(ky * (caz * scaley * m_style.fontShiftY - saz * scalex));
+		t.m11 = float(ky * (caz * scaley - saz * scalex * m_style.fontShiftX));
+		t.m12 = float(ky * (saz * ox - caz * oy) + oy);
+
+		if (bUseAVX2) {
+			TransformAffine_AVX2(mpPathPoints, mPathPoints, t);
 		} else {
-			for (int k = 0; k < 4; k++) {
-				mpPathPoints[i * 4 + k].x = __pointxRounded.m128i_i32[3 - k];
-				mpPathPoints[i * 4 + k].y = __pointyRounded.m128i_i32[3 - k];
-			}
+			TransformAffine_SSE2(mpPathPoints, mPathPoints, t);
 		}
+		return;
+	}
+
+	C3DTransform t;
+	t.xshift = (float)m_style.fontShiftX;
+	t.yshift = (float)m_style.fontShiftY;
+	t.xorg = (float)org.x;
+	t.yorg = (float)org.y;
+	t.xscale = (float)scalex;
+	t.yscale = (float)scaley;
+	t.xzoomf = (float)xzoomf;
+	t.yzoomf = (float)yzoomf;
+	t.caz = (float)caz;
+	t.saz = (float)saz;
+	t.cax = (float)cos((M_PI / 180.0) * m_style.fontAngleX);
+	t.sax = (float)sin((M_PI / 180.0) * m_style.fontAngleX);
+	t.cay = (float)cos((M_PI / 180.0) * m_style.fontAngleY);
+	t.say = (float)sin((M_PI / 180.0) * m_style.fontAngleY);
+
+	if (bUseAVX2) {
+		Transform3D_AVX2(mpPathPoints, mPathPoints, t);
+	} else {
+		Transform3D_SSE2(mpPathPoints, mPathPoints, t);
 	}
 }
 #endif
@@ -856,7 +1090,13 @@ CAlphaMaskSharedPtr CClipper::GetAlphaMask(const std::shared_ptr<CClipper>& clip
 		return NULL;
 	}
 
-	const size_t alphaMaskSize = size_t(m_size.cx) * m_size.cy;
+	// The mask is stored only for the bounding box of the clip, the effects need the whole frame
+	CRect maskRect(x, y, x + w, y + h);
+	if (m_effectType == EF_SCROLL || m_effectType == EF_BANNER) {
+		maskRect.SetRect(0, 0, m_size.cx, m_size.cy);
+	}
+	const int mask_w = maskRect.Width(), mask_h = maskRect.Height();
+	const size_t alphaMaskSize = size_t(mask_w) * mask_h;
 
 	try {
 		m_pAlphaMask = CAlphaMask::Alloc(m_renderingCaches.alphaMaskPool, alphaMaskSize);
@@ -865,33 +1105,36 @@ CAlphaMaskSharedPtr CClipper::GetAlphaMask(const std::shared_ptr<CClipper>& clip
 		m_pAlphaMask = NULL;
 		return NULL;
 	}
+	m_pAlphaMask->m_rect = maskRect;
+	m_pAlphaMask->m_inverse = m_inverse;
 
 	BYTE* pAlphaMask = m_pAlphaMask->get();
-	memset(pAlphaMask, (m_inverse ? 0x40 : 0), alphaMaskSize);
+	if (alphaMaskSize != size_t(w) * h) {
+		memset(pAlphaMask, (m_inverse ? 0x40 : 0), alphaMaskSize);
+	}
 
 	const BYTE* src = m_pOverlayData->mpOverlayBufferBody + m_pOverlayData->mOverlayPitch * yo + xo;
-	BYTE* dst = pAlphaMask + m_size.cx * y + x;
+	BYTE* dst = pAlphaMask + mask_w * (y - maskRect.top) + (x - maskRect.left);
 
-	memset(pAlphaMask, (m_inverse ? 0x40 : 0), m_size.cx * y + x);
 	if (m_inverse) {
 		for (ptrdiff_t i = 0; i < h; ++i) {
 			for (ptrdiff_t wt = 0; wt < w; ++wt) {
 				dst[wt] = 0x40 - src[wt];
 			}
 			src += m_pOverlayData->mOverlayPitch;
-			dst += m_size.cx;
+			dst += mask_w;
 		}
 	} else {
 		for (ptrdiff_t i = 0; i < h; ++i) {
 			memcpy(dst, src, w * sizeof(BYTE));
 			src += m_pOverlayData->mOverlayPitch;
-			dst += m_size.cx;
+			dst += mask_w;
 		}
 	}
 
 	if (m_effectType == EF_SCROLL) {
 		int height = m_effect.param[4];
-		int spd_w = m_size.cx, spd_h = m_size.cy;
+		int spd_w = mask_w, spd_h = mask_h;
 		int da = (64 << 8) / height;
 		int a = 0;
 		int k = m_effect.param[0] >> 3;
@@ -942,7 +1185,7 @@ CAlphaMaskSharedPtr CClipper::GetAlphaMask(const std::shared_ptr<CClipper>& clip
 		}
 	} else if (m_effectType == EF_BANNER)  {
 		int width = m_effect.param[2];
-		int spd_w = m_size.cx, spd_h = m_size.cy;
+		int spd_w = mask_w, spd_h = mask_h;
 		int da = (64 << 8) / width;
 		BYTE* am = pAlphaMask;
 
@@ -1058,7 +1301,7 @@ void CLine::Compact()
 	}
 }
 
-CRect CLine::PaintShadow(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoint p, CPoint org, int time, int alpha)
+CRect CLine::PaintShadow(SubPicDesc& spd, CRect& clipRect, const CClipMask* pAlphaMask, CPoint p, CPoint org, int time, int alpha)
 {
 	CRect bbox(0, 0, 0, 0);
 
@@ -1098,7 +1341,7 @@ CRect CLine::PaintShadow(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPo
 	return bbox;
 }
 
-CRect CLine::PaintOutline(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoint p, CPoint org, int time, int alpha)
+CRect CLine::PaintOutline(SubPicDesc& spd, CRect& clipRect, const CClipMask* pAlphaMask, CPoint p, CPoint org, int time, int alpha)
 {
 	CRect bbox(0, 0, 0, 0);
 
@@ -1136,7 +1379,7 @@ CRect CLine::PaintOutline(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CP
 	return bbox;
 }
 
-CRect CLine::PaintBody(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoint p, CPoint org, int time, int alpha)
+CRect CLine::PaintBody(SubPicDesc& spd, CRect& clipRect, const CClipMask* pAlphaMask, CPoint p, CPoint org, int time, int alpha)
 {
 	CRect bbox(0, 0, 0, 0);
 
@@ -1489,83 +1732,186 @@ void CSubtitle::MakeLines(CSize size, const CRect& marginRect)
 
 void CScreenLayoutAllocator::Empty()
 {
-	m_subrects.RemoveAll();
+	m_layers.clear();
+	m_entries.clear();
 }
 
 void CScreenLayoutAllocator::AdvanceToSegment(int segment, const CAtlArray<int>& sa)
 {
-	POSITION pos = m_subrects.GetHeadPosition();
-	while (pos) {
-		POSITION prev = pos;
+	std::vector<int> entries(sa.GetData(), sa.GetData() + sa.GetCount());
+	std::sort(entries.begin(), entries.end());
 
-		SubRect& sr = m_subrects.GetNext(pos);
+	for (auto it = m_entries.begin(); it != m_entries.end();) {
+		LayerRects& lr = m_layers[it->second.first];
+		SubRect& sr = it->second.second->second;
 
-		bool fFound = false;
+		// using abs() makes it possible to play the subs backwards, too :)
+		if (abs(sr.segment - segment) <= 1 && std::binary_search(entries.begin(), entries.end(), sr.entry)) {
+			sr.segment = segment;
+			++it;
+		} else {
+			lr.rects.erase(it->second.second);
+			it = m_entries.erase(it);
+		}
+	}
 
-		if (abs(sr.segment - segment) <= 1) { // using abs() makes it possible to play the subs backwards, too :)
-			for (size_t i = 0; i < sa.GetCount() && !fFound; i++) {
-				if (sa[i] == sr.entry) {
-					sr.segment = segment;
-					fFound = true;
-				}
-			}
+	for (auto it = m_layers.begin(); it != m_layers.end();) {
+		LayerRects& lr = it->second;
+		if (lr.rects.empty()) {
+			it = m_layers.erase(it);
+			continue;
 		}
 
-		if (!fFound) {
-			m_subrects.RemoveAt(prev);
+		lr.maxHeight = 0;
+		for (const auto& item : lr.rects) {
+			lr.maxHeight = std::max(lr.maxHeight, item.second.r.Height());
 		}
+		++it;
 	}
 }
 
-CRect CScreenLayoutAllocator::AllocRect(const CSubtitle* s, int segment, int entry, int layer, int collisions)
+void CScreenLayoutAllocator::RemapEntries(int nRemovedSegments, const std::vector<int>& entryMap)
 {
-	// TODO: handle collisions == 1 (reversed collisions)
+	std::map<int, std::pair<int, SubRectPos>> entries;
 
-	POSITION pos = m_subrects.GetHeadPosition();
-	while (pos) {
-		SubRect& sr = m_subrects.GetNext(pos);
-		if (sr.segment == segment && sr.entry == entry) {
-			return (sr.r + CRect(0, -s->m_topborder, 0, -s->m_bottomborder));
+	for (auto& [entry, pos] : m_entries) {
+		SubRect& sr = pos.second->second;
+		const int newEntry = entry < (int)entryMap.size() ? entryMap[entry] : -1;
+		if (newEntry >= 0) {
+			sr.segment -= nRemovedSegments;
+			sr.entry = newEntry;
+			entries.emplace(newEntry, pos);
+		} else {
+			// the empty layers are dropped by the next AdvanceToSegment()
+			m_layers[pos.first].rects.erase(pos.second);
 		}
 	}
 
-	CRect r = s->m_rect + CRect(0, s->m_topborder, 0, s->m_bottomborder);
-
-	bool fSearchDown = s->m_scrAlignment > 3;
-
-	bool fOK;
+	m_entries.swap(entries);
+}
 
-	do {
-		fOK = true;
+// Looks for the rectangles of the layer intersecting r. Returns the position r has to be moved to
+// in order to skip the nearest one: its bottom edge when searching down, its top edge otherwise.
+bool CScreenLayoutAllocator::FindCollision(const LayerRects& lr, const CRect& r, bool fSearchDown, int& pos)
+{
+	bool fFound = false;
 
-		pos = m_subrects.GetHeadPosition();
-		while (pos) {
-			SubRect& sr = m_subrects.GetNext(pos);
+	const auto end = lr.rects.lower_bound(r.bottom);
+	for (auto it = lr.rects.lower_bound(r.top - lr.maxHeight); it != end; ++it) {
+		const CRect& sr = it->second.r;
+		if (!(r & sr).IsRectEmpty()) {
+			if (!fFound) {
+				pos = fSearchDown ? sr.bottom : sr.top;
+				fFound = true;
+			} else {
+				pos = fSearchDown ? std::min(pos, (int)sr.bottom) : std::max(pos, (int)sr.top);
+			}
+		}
+	}
 
-			if (layer == sr.layer && !(r & sr.r).IsRectEmpty()) {
-				if (fSearchDown) {
-					r.bottom = sr.r.bottom + r.Height();
-					r.top = sr.r.bottom;
-				} else {
-					r.top = sr.r.top - r.Height();
-					r.bottom = sr.r.top;
-				}
+	return fFound;
+}
 
-				fOK = false;
-			}
+CRect CScreenLayoutAllocator::AllocRect(const CSubtitle* s, int segment, int entry, int layer, int collisions)
+{
+	auto it = m_entries.find(entry);
+	if (it != m_entries.end()) {
+		const SubRect& sr = it->second.second->second;
+		if (sr.segment == segment) {
+			return (sr.r + CRect(0, -s->m_topborder, 0, -s->m_bottomborder));
 		}
-	} while (!fOK);
+		m_layers[it->second.first].rects.erase(it->second.second);
+		m_entries.erase(it);
+	}
 
 	SubRect sr;
-	sr.r = r;
+	sr.r = s->m_rect + CRect(0, s->m_topborder, 0, s->m_bottomborder);
 	sr.segment = segment;
 	sr.entry = entry;
 	sr.layer = layer;
-	m_subrects.AddTail(sr);
+	sr.valign = s->m_scrAlignment > 6 ? 2 : s->m_scrAlignment > 3 ? 1 : 0;
+
+	LayerRects& lr = m_layers[layer];
+
+	if (collisions == 1) {
+		InsertRectReversed(lr, sr);
+	} else {
+		MoveOutOfCollisions(lr, sr.r, sr.valign > 0);
+		InsertRect(lr, sr);
+	}
 
 	return (sr.r + CRect(0, -s->m_topborder, 0, -s->m_bottomborder));
 }
 
+void CScreenLayoutAllocator::MoveOutOfCollisions(const LayerRects& lr, CRect& r, bool fSearchDown)
+{
+	// r only moves in one direction, so every iteration skips at least one rectangle
+	int pos;
+	while (FindCollision(lr, r, fSearchDown, pos)) {
+		const int height = r.Height();
+		if (fSearchDown) {
+			r.top = pos;
+			r.bottom = pos + height;
+		} else {
+			r.bottom = pos;
+			r.top = pos - height;
+		}
+	}
+}
+
+void CScreenLayoutAllocator::InsertRect(LayerRects& lr, const SubRect& sr)
+{
+	lr.maxHeight = std::max(lr.maxHeight, sr.r.Height());
+	m_entries[sr.entry] = { sr.layer, lr.rects.emplace(sr.r.top, sr) };
+}
+
+// Collisions: Reverse, the new line keeps its normal position and the lines of the same vertical
+// alignment it overlaps are moved away in the stacking direction, the nearest first, pushing in
+// turn the lines they overlap
+void CScreenLayoutAllocator::InsertRectReversed(LayerRects& lr, const SubRect& sr)
+{
+	const bool fSearchDown = sr.valign > 0;
+
+	InsertRect(lr, sr);
+
+	// the lines are queued by entry, their position changes when they are pushed
+	std::deque<int> pushers = { sr.entry };
+	std::vector<SubRectPos> pushed;
+
+	while (!pushers.empty()) {
+		const SubRectPos pusher = m_entries[pushers.front()].second;
+		const CRect pr = pusher->second.r;
+		pushers.pop_front();
+
+		pushed.clear();
+		const auto end = lr.rects.lower_bound(pr.bottom);
+		for (auto it = lr.rects.lower_bound(pr.top - lr.maxHeight); it != end; ++it) {
+			if (it != pusher && it->second.valign == sr.valign && !(pr & it->second.r).IsRectEmpty()) {
+				pushed.push_back(it);
+			}
+		}
+		std::sort(pushed.begin(), pushed.end(), [fSearchDown](const SubRectPos& a, const SubRectPos& b) {
+			return fSearchDown ? a->second.r.top < b->second.r.top : a->second.r.bottom > b->second.r.bottom;
+		});
+
+		for (const auto& it : pushed) {
+			SubRect other = it->second;
+			lr.rects.erase(it);
+
+			const int height = other.r.Height();
+			if (fSearchDown) {
+				other.r.top = pr.bottom;
+				other.r.bottom = pr.bottom + height;
+			} else {
+				other.r.bottom = pr.top;
+				other.r.top = pr.top - height;
+			}
+			InsertRect(lr, other);
+			pushers.push_back(other.entry);
+		}
+	}
+}
+
 // CRenderedTextSubtitle
 
 CAtlMap<CStringW, SSATagCmd, CStringElementTraits<CStringW>> CRenderedTextSubtitle::s_SSATagCmds;
@@ -1701,6 +2047,44 @@ void CRenderedTextSubtitle::OnChanged()
 	m_sla.Empty();
 }
 
+void CRenderedTextSubtitle::OnEntriesRemoved(size_t nSegments, const std::vector<int>& entryMap)
+{
+	__super::OnEntriesRemoved(nSegments, entryMap);
+
+	CAtlMap<int, CSubtitle*> subtitleCache;
+
+	POSITION pos = m_subtitleCache.GetStartPosition();
+	while (pos) {
+		int i;
+		CSubtitle* s;
+		m_subtitleCache.GetNextAssoc(pos, i, s);
+		if (i < (int)entryMap.size() && entryMap[i] >= 0) {
+			subtitleCache[entryMap[i]] = s;
+		} else {
+			delete s;
+		}
+	}
+
+	m_subtitleCache.RemoveAll();
+
+	pos = subtitleCache.GetStartPosition();
+	while (pos) {
+		int i;
+		CSubtitle* s;
+		subtitleCache.GetNextAssoc(pos, i, s);
+		m_subtitleCache[i] = s;
+	}
+
+	m_sla.RemapEntries((int)nSegments, entryMap);
+}
+
+void CRenderedTextSubtitle::GetMemoryStats(STSMemoryStats& stats)
+{
+	__super::GetMemoryStats(stats);
+
+	stats.cached = m_subtitleCache.GetCount();
+}
+
 bool CRenderedTextSubtitle::Init(CSize size, const CRect& vidrect)
 {
 	Deinit();
@@ -3054,6 +3438,47 @@ STDMETHODIMP CRenderedTextSubtitle::Render(SubPicDesc& spd, REFERENCE_TIME rt, d
 {
 	std::unique_lock<std::mutex> lock(m_mutexRender);
 
+	return RenderLocked(spd, rt, fps, bbox);
+}
+
+// Level 1 shortens the long blurs, level 2 also limits \be to one pass and
+// level 3 replaces \blur by a single \be pass
+STDMETHODIMP CRenderedTextSubtitle::SetRenderQuality(int nLevel)
+{
+	std::unique_lock<std::mutex> lock(m_mutexRender);
+
+	nLevel = std::clamp(nLevel, 0, 3);
+	if (m_renderingCaches.nQualityLevel != nLevel) {
+		m_renderingCaches.nQualityLevel = nLevel;
+		m_renderingCaches.overlayCache.Clear();
+	}
+
+	return S_OK;
+}
+
+HRESULT CRenderedTextSubtitle::RenderImages(CSize size, const CRect& vidrect, REFERENCE_TIME rt, double fps, CSubImageList& images, RECT& bbox)
+{
+	std::unique_lock<std::mutex> lock(m_mutexRender);
+
+	images.Clear();
+
+	// nothing is drawn on the surface, only its dimensions are needed
+	SubPicDesc spd;
+	spd.type = MSP_RGB32;
+	spd.w = size.cx;
+	spd.h = size.cy;
+	spd.bpp = 32;
+	spd.vidrect = vidrect;
+
+	m_renderingCaches.pImageList = &images;
+	HRESULT hr = RenderLocked(spd, rt, fps, bbox);
+	m_renderingCaches.pImageList = nullptr;
+
+	return hr;
+}
+
+HRESULT CRenderedTextSubtitle::RenderLocked(SubPicDesc& spd, REFERENCE_TIME rt, double fps, RECT& bbox)
+{
 	CRect bbox2;
 
 	if (m_size != CSize(spd.w*8, spd.h*8) || m_vidrect != CRect(spd.vidrect.left*8, spd.vidrect.top*8, spd.vidrect.right*8, spd.vidrect.bottom*8)) {
@@ -3096,6 +3521,24 @@ STDMETHODIMP CRenderedTextSubtitle::Render(SubPicDesc& spd, REFERENCE_TIME rt, d
 
 	std::sort(subs.GetData(), subs.GetData() + subs.GetCount());
 
+	// With reversed collisions a new line moves the lines placed before it,
+	// so all of them are placed before any is drawn
+	if (m_collisions == 1) {
+		for (size_t i = 0; i < subs.GetCount(); i++) {
+			const int entry = subs[i].idx;
+
+			const int start = TranslateStart(entry, fps);
+			m_time = time - start;
+			m_delay = TranslateEnd(entry, fps) - start;
+
+			CSubtitle* s = GetSubtitle(entry);
+			if (s && !s->m_fAnimated
+					&& !s->m_effects[EF_MOVE] && !s->m_effects[EF_ORG] && !s->m_effects[EF_BANNER] && !s->m_effects[EF_SCROLL]) {
+				m_sla.AllocRect(s, segment, entry, GetAt(entry).layer, m_collisions);
+			}
+		}
+	}
+
 	for (ptrdiff_t i = 0, j = subs.GetCount(); i < j; i++) {
 		int entry = subs[i].idx;
 
@@ -3125,7 +3568,8 @@ STDMETHODIMP CRenderedTextSubtitle::Render(SubPicDesc& spd, REFERENCE_TIME rt, d
 		CPoint org2;
 
 		const auto& ptrAlphaMask = s->m_pClipper ? s->m_pClipper->GetAlphaMask(s->m_pClipper) : NULL;
-		BYTE* pAlphaMask = ptrAlphaMask ? ptrAlphaMask->get() : NULL;
+		const CClipMask clipMask = ptrAlphaMask ? ptrAlphaMask->GetClipMask() : CClipMask(nullptr, CRect(), false);
+		const CClipMask* pAlphaMask = ptrAlphaMask ? &clipMask : nullptr;
 
 		for (int k = 0; k < EF_NUMBEROFEFFECTS; k++) {
 			if (!s->m_effects[k]) {
@@ -3385,3 +3829,75 @@ STDMETHODIMP CRenderedTextSubtitle::Reload()
 	}
 	return !m_path.IsEmpty() && Open(m_path, CP_ACP, false, m_name, {}) ? S_OK : E_FAIL;
 }
+
+bool CRenderedTextSubtitle::ReloadChanged(double fps, std::vector<std::pair<REFERENCE_TIME, REFERENCE_TIME>>& changed)
+{
+	changed.clear();
+
+	if (m_path.IsEmpty() || !::PathFileExistsW(m_path)) {
+		return false;
+	}
+
+	// parsed without holding the lock, the old script can be rendered meanwhile
+	CSimpleTextSubtitle sts;
+	if (!sts.Open(m_path, CP_ACP, false, m_name, {})) {
+		return false;
+	}
+
+	CAutoLock cAutoLock(m_pLock);
+	std::unique_lock<std::mutex> lock(m_mutexRender);
+
+	// keep the default style set by the application
+	STSStyle* pDefStyle;
+	STSStyle* pOldDefStyle;
+	if (sts.m_fUsingAutoGeneratedDefaultStyle && sts.m_styles.Lookup(L"Default", pDefStyle) && m_styles.Lookup(L"Default", pOldDefStyle)) {
+		*pDefStyle = *pOldDefStyle;
+	}
+
+	std::vector<int> entryMap;
+	std::vector<std::pair<int, int>> ranges;
+	if (!Update(sts, entryMap, ranges) || (m_mode == FRAME && fps <= 0)) {
+		OnChanged();
+		changed.emplace_back(0, MAXLONGLONG);
+		return true;
+	}
+
+	// the cached subtitles of the unchanged entries are moved to their new index
+	CAtlMap<int, CSubtitle*> subtitleCache;
+	for (size_t i = 0; i < entryMap.size(); i++) {
+		CSubtitle* s;
+		if (entryMap[i] >= 0 && m_subtitleCache.Lookup(entryMap[i], s)) {
+			subtitleCache[(int)i] = s;
+			m_subtitleCache.RemoveKey(entryMap[i]);
+		}
+	}
+
+	POSITION pos = m_subtitleCache.GetStartPosition();
+	while (pos) {
+		int i;
+		CSubtitle* s;
+		m_subtitleCache.GetNextAssoc(pos, i, s);
+		delete s;
+	}
+	m_subtitleCache.RemoveAll();
+
+	pos = subtitleCache.GetStartPosition();
+	while (pos) {
+		int i;
+		CSubtitle* s;
+		subtitleCache.GetNextAssoc(pos, i, s);
+		m_subtitleCache[i] = s;
+	}
+
+	m_sla.Empty();
+
+	for (const auto& [start, end] : ranges) {
+		if (m_mode == FRAME) {
+			changed.emplace_back((REFERENCE_TIME)(start * 10000000.0 / fps), (REFERENCE_TIME)std::ceil(end * 10000000.0 / fps));
+		} else {
+			changed.emplace_back(10000i64 * start, 10000i64 * end);
+		}
+	}
+
+	return true;
+}
@@ -54,12 +54,18 @@ struct CAlphaMask final : std::unique_ptr<BYTE[]> {
 	CAlphaMask& operator=(const CAlphaMask&) = delete;
 
 	size_t m_size;
+	CRect m_rect;
+	bool m_inverse = false;
 
 	explicit CAlphaMask(size_t size)
 		: std::unique_ptr<BYTE[]>(std::make_unique<BYTE[]>(size))
 		, m_size(size) {
 	}
 
+	CClipMask GetClipMask() const {
+		return CClipMask(get(), m_rect, m_inverse);
+	}
+
 	static std::shared_ptr<CAlphaMask> Alloc(std::list<CAlphaMask>& alphaMaskPool, size_t size) {
 		for (auto it = alphaMaskPool.begin(); it != alphaMaskPool.end(); ++it) {
 			auto& am = *it;
@@ -97,6 +103,15 @@ struct RenderingCaches {
 	std::list<CAlphaMask> alphaMaskPool;
 	CAlphaMaskCache alphaMaskCache;
 
+	// rotated and scaled words are resampled from a cached untransformed overlay
+	bool bResampleTransforms = false;
+
+	// see CRenderedTextSubtitle::SetRenderQuality()
+	int nQualityLevel = 0;
+
+	// when set, the words are added to this list instead of being drawn on the subpicture
+	CSubImageList* pImageList = nullptr;
+
 	RenderingCaches()
 		: textDimsCache(2048)
 		, polygonCache(2048)
@@ -124,11 +139,17 @@ class CPolygon;
 
 class CWord : public Rasterizer
 {
+	// resolution of the cached overlays used by PaintResampled()
+	static constexpr int RESAMPLE_FACTOR = 2;
+
 	bool m_fDrawn;
+	bool m_fResampleSource;
 	CPoint m_p;
 
 	void Transform(const CPoint &org );
 	bool CreateOpaqueBox();
+	bool PaintResampled(const CPoint& p, const CPoint& org);
+	bool RasterizeStyle(int xsub, int ysub);
 
 protected:
 	RenderingCaches& m_renderingCaches;
@@ -159,6 +180,10 @@ public:
 
 	void Paint(const CPoint& p, const CPoint& org);
 
+	CRect Draw(SubPicDesc& spd, CRect& clipRect, const CClipMask* pAlphaMask, int xsub, int ysub, const DWORD* switchpts, bool fBody, bool fBorder) const {
+		return Rasterizer::Draw(spd, clipRect, pAlphaMask, xsub, ysub, switchpts, fBody, fBorder, m_renderingCaches.pImageList);
+	}
+
 	friend class COutlineKey;
 
 	CString GetText() const { return m_str; }
@@ -285,9 +310,9 @@ public:
 
 	void Compact();
 
-	CRect PaintShadow(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoint p, CPoint org, int time, int alpha);
-	CRect PaintOutline(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoint p, CPoint org, int time, int alpha);
-	CRect PaintBody(SubPicDesc& spd, CRect& clipRect, BYTE* pAlphaMask, CPoint p, CPoint org, int time, int alpha);
+	CRect PaintShadow(SubPicDesc& spd, CRect& clipRect, const CClipMask* pAlphaMask, CPoint p, CPoint org, int time, int alpha);
+	CRect PaintOutline(SubPicDesc& spd, CRect& clipRect, const CClipMask* pAlphaMask, CPoint p, CPoint org, int time, int alpha);
+	CRect PaintBody(SubPicDesc& spd, CRect& clipRect, const CClipMask* pAlphaMask, CPoint p, CPoint org, int time, int alpha);
 };
 
 enum SSATagCmd {
@@ -427,15 +452,31 @@ class CScreenLayoutAllocator
 	struct SubRect {
 		CRect r;
 		int segment, entry, layer;
+		int valign; // 0 bottom, 1 middle, 2 top
+	};
+
+	// Rectangles of one layer ordered by their top edge. Any rectangle intersecting
+	// the vertical range [top, bottom) has its top edge in [top - maxHeight, bottom).
+	struct LayerRects {
+		std::multimap<int, SubRect> rects;
+		int maxHeight = 0;
 	};
+	using SubRectPos = std::multimap<int, SubRect>::iterator;
+
+	std::map<int, LayerRects> m_layers;
+	std::map<int, std::pair<int, SubRectPos>> m_entries; // entry -> (layer, position)
 
-	CAtlList<SubRect> m_subrects;
+	static bool FindCollision(const LayerRects& lr, const CRect& r, bool fSearchDown, int& pos);
+	static void MoveOutOfCollisions(const LayerRects& lr, CRect& r, bool fSearchDown);
+	void InsertRect(LayerRects& lr, const SubRect& sr);
+	void InsertRectReversed(LayerRects& lr, const SubRect& sr);
 
 public:
 	/*virtual*/
 	void Empty();
 
 	void AdvanceToSegment(int segment, const CAtlArray<int>& sa);
+	void RemapEntries(int nRemovedSegments, const std::vector<int>& entryMap);
 	CRect AllocRect(const CSubtitle* s, int segment, int entry, int layer, int collisions);
 };
 
@@ -479,8 +520,11 @@ class __declspec(uuid("537DCACA-2812-4a4f-B2C6-1A34C17ADEB0"))
 
 	std::mutex m_mutexRender;
 
+	HRESULT RenderLocked(SubPicDesc& spd, REFERENCE_TIME rt, double fps, RECT& bbox);
+
 protected:
 	virtual void OnChanged();
+	virtual void OnEntriesRemoved(size_t nSegments, const std::vector<int>& entryMap);
 
 public:
 	CRenderedTextSubtitle(CCritSec* pLock);
@@ -500,8 +544,18 @@ public:
 		m_overridePlacement.SetSize(lHorPos, lVerPos);
 	}
 
+	// faster but approximate rendering of \frz, \fscx and \fscy
+	void SetTransformResampling(bool bResample) {
+		if (m_renderingCaches.bResampleTransforms != bResample) {
+			m_renderingCaches.bResampleTransforms = bResample;
+			m_renderingCaches.overlayCache.Clear();
+		}
+	}
+
 	void SetName(const CString& name);
 
+	void GetMemoryStats(STSMemoryStats& stats);
+
 	const bool GetText(const REFERENCE_TIME rt, const double fps, CString& text);
 
 public:
@@ -521,6 +575,11 @@ public:
 	STDMETHODIMP_(REFERENCE_TIME) GetStop(POSITION pos, double fps);
 	STDMETHODIMP_(bool) IsAnimated(POSITION pos);
 	STDMETHODIMP Render(SubPicDesc& spd, REFERENCE_TIME rt, double fps, RECT& bbox);
+	STDMETHODIMP SetRenderQuality(int nLevel);
+
+	// Returns the subtitles as positioned coverage images with their colors instead of drawing them on a surface.
+	// The images stay valid until the list is cleared or rendered to again.
+	HRESULT RenderImages(CSize size, const CRect& vidrect, REFERENCE_TIME rt, double fps, CSubImageList& images, RECT& bbox);
 
 	STDMETHODIMP_(SUBTITLE_TYPE) GetType() { return ST_TEXT; };
 
@@ -533,4 +592,8 @@ public:
 	STDMETHODIMP_(int) GetStream();
 	STDMETHODIMP SetStream(int iStream);
 	STDMETHODIMP Reload();
+
+	// Reloads the file keeping the subtitles of the unchanged entries. changed receives the time ranges
+	// to re-render, all of them if the script header changed. Returns false if the file can't be loaded.
+	bool ReloadChanged(double fps, std::vector<std::pair<REFERENCE_TIME, REFERENCE_TIME>>& changed);
 };
@@ -921,6 +921,161 @@ bool Rasterizer::Rasterize(int xsub, int ysub, int fBlur, double fGaussianBlur)
 	return true;
 }
 
+namespace
+{
+	// Bilinear sampling of 4 points from the body and border planes of an overlay.
+	// Coordinates are in source pixels with pixel centers at integer positions,
+	// texels outside of the overlay are transparent.
+	__forceinline void SampleOverlay_SSE2(const COverlayData& src, __m128 u, __m128 v, __m128& body, __m128& border)
+	{
+		// the coordinates are kept close to the overlay, the bias makes truncation a floor
+		const __m128 bias = _mm_set_ps1(16.0f);
+		const __m128 lo = _mm_set_ps1(-8.0f);
+		u = _mm_max_ps(u, lo);
+		v = _mm_max_ps(v, lo);
+
+		const __m128i iu = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(u, bias)), _mm_set1_epi32(16));
+		const __m128i iv = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(v, bias)), _mm_set1_epi32(16));
+		const __m128 fu = _mm_sub_ps(u, _mm_cvtepi32_ps(iu));
+		const __m128 fv = _mm_sub_ps(v, _mm_cvtepi32_ps(iv));
+
+		alignas(16) int x[4], y[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(x), iu);
+		_mm_store_si128(reinterpret_cast<__m128i*>(y), iv);
+
+		alignas(16) float t[2][4][4]; // plane, tap, point
+		for (int k = 0; k < 4; k++) {
+			for (int tap = 0; tap < 4; tap++) {
+				const int tx = x[k] + (tap & 1);
+				const int ty = y[k] + (tap >> 1);
+				if (tx >= 0 && ty >= 0 && tx < src.mOverlayWidth && ty < src.mOverlayHeight) {
+					const size_t offset = size_t(src.mOverlayPitch) * ty + tx;
+					t[0][tap][k] = src.mpOverlayBufferBody[offset];
+					t[1][tap][k] = src.mpOverlayBufferBorder[offset];
+				} else {
+					t[0][tap][k] = t[1][tap][k] = 0.0f;
+				}
+			}
+		}
+
+		auto lerp = [](__m128 a, __m128 b, __m128 f) {
+			return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), f));
+		};
+
+		__m128 res[2];
+		for (int plane = 0; plane < 2; plane++) {
+			const __m128 top = lerp(_mm_load_ps(t[plane][0]), _mm_load_ps(t[plane][1]), fu);
+			const __m128 bottom = lerp(_mm_load_ps(t[plane][2]), _mm_load_ps(t[plane][3]), fu);
+			res[plane] = lerp(top, bottom, fv);
+		}
+		body = res[0];
+		border = res[1];
+	}
+}
+
+// Create the overlay from another one by an affine transformation.
+// m maps source pixel centers to destination pixel centers in 1/1 pixel units,
+// relative to the position the overlay will be drawn at minus (xsub, ysub) 1/8 pixels.
+// Each destination pixel averages 2x2 bilinear samples so that sources with a higher
+// resolution are filtered properly.
+bool Rasterizer::ResampleOverlay(const COverlayData& src, const double m[6], int xsub, int ysub)
+{
+	m_pOverlayData = std::make_shared<COverlayData>();
+
+	if (!src.mOverlayWidth || !src.mOverlayHeight || !src.mpOverlayBufferBody) {
+		return true;
+	}
+
+	const double det = m[0] * m[4] - m[1] * m[3];
+	if (std::abs(det) < 1e-6) {
+		return false;
+	}
+
+	// Bounding box of the transformed source
+	double minx = DBL_MAX, miny = DBL_MAX, maxx = -DBL_MAX, maxy = -DBL_MAX;
+	for (int k = 0; k < 4; k++) {
+		const double u = (k & 1) ? src.mOverlayWidth - 0.5 : -0.5;
+		const double v = (k & 2) ? src.mOverlayHeight - 0.5 : -0.5;
+		const double x = m[0] * u + m[1] * v + m[2];
+		const double y = m[3] * u + m[4] * v + m[5];
+		minx = std::min(minx, x);
+		maxx = std::max(maxx, x);
+		miny = std::min(miny, y);
+		maxy = std::max(maxy, y);
+	}
+
+	const int x0 = (int)std::floor(minx) - 1;
+	const int y0 = (int)std::floor(miny) - 1;
+	const int width = (int)std::ceil(maxx) + 2 - x0;
+	const int height = (int)std::ceil(maxy) + 2 - y0;
+
+	m_pOverlayData->mOffsetX = x0 * 8 - (xsub & 7);
+	m_pOverlayData->mOffsetY = y0 * 8 - (ysub & 7);
+	m_pOverlayData->mOverlayWidth = width;
+	m_pOverlayData->mOverlayHeight = height;
+	m_pOverlayData->mOverlayPitch = (width + 15) & ~15; // Round the next multiple of 16
+
+	m_pOverlayData->mpOverlayBufferBody = (byte*)_aligned_malloc(m_pOverlayData->mOverlayPitch * height, 16);
+	m_pOverlayData->mpOverlayBufferBorder = (byte*)_aligned_malloc(m_pOverlayData->mOverlayPitch * height, 16);
+	if (!m_pOverlayData->mpOverlayBufferBody || !m_pOverlayData->mpOverlayBufferBorder) {
+		m_pOverlayData = nullptr;
+		return false;
+	}
+
+	// Inverse transformation, destination pixel centers to source coordinates
+	const double i00 = m[4] / det, i01 = -m[1] / det;
+	const double i10 = -m[3] / det, i11 = m[0] / det;
+	const double i02 = -(i00 * m[2] + i01 * m[5]);
+	const double i12 = -(i10 * m[2] + i11 * m[5]);
+
+	const __m128 step_u = _mm_set_ps1(float(4 * i00));
+	const __m128 step_v = _mm_set_ps1(float(4 * i10));
+	const __m128 quarter = _mm_set_ps1(0.25f);
+	const __m128 half = _mm_set_ps1(0.5f);
+	const __m128 maxval = _mm_set_ps1(64.0f);
+
+	// 2x2 supersampling offsets in source pixels
+	__m128 tap_u[4], tap_v[4];
+	for (int tap = 0; tap < 4; tap++) {
+		const double dx = (tap & 1) ? 0.25 : -0.25;
+		const double dy = (tap & 2) ? 0.25 : -0.25;
+		tap_u[tap] = _mm_set_ps1(float(i00 * dx + i01 * dy));
+		tap_v[tap] = _mm_set_ps1(float(i10 * dx + i11 * dy));
+	}
+
+	for (int j = 0; j < height; j++) {
+		byte* body = m_pOverlayData->mpOverlayBufferBody + m_pOverlayData->mOverlayPitch * j;
+		byte* border = m_pOverlayData->mpOverlayBufferBorder + m_pOverlayData->mOverlayPitch * j;
+
+		const double y = y0 + j;
+		const double x = x0;
+		__m128 u = _mm_add_ps(_mm_set_ps1(float(i00 * x + i01 * y + i02)), _mm_setr_ps(0.0f, float(i00), float(2 * i00), float(3 * i00)));
+		__m128 v = _mm_add_ps(_mm_set_ps1(float(i10 * x + i11 * y + i12)), _mm_setr_ps(0.0f, float(i10), float(2 * i10), float(3 * i10)));
+
+		for (int i = 0; i < m_pOverlayData->mOverlayPitch; i += 4) {
+			__m128 sumBody = _mm_setzero_ps(), sumBorder = _mm_setzero_ps();
+			for (int tap = 0; tap < 4; tap++) {
+				__m128 b, o;
+				SampleOverlay_SSE2(src, _mm_add_ps(u, tap_u[tap]), _mm_add_ps(v, tap_v[tap]), b, o);
+				sumBody = _mm_add_ps(sumBody, b);
+				sumBorder = _mm_add_ps(sumBorder, o);
+			}
+
+			const __m128i ib = _mm_cvttps_epi32(_mm_min_ps(_mm_add_ps(_mm_mul_ps(sumBody, quarter), half), maxval));
+			const __m128i io = _mm_cvttps_epi32(_mm_min_ps(_mm_add_ps(_mm_mul_ps(sumBorder, quarter), half), maxval));
+			const __m128i pb = _mm_packus_epi16(_mm_packs_epi32(ib, ib), _mm_setzero_si128());
+			const __m128i po = _mm_packus_epi16(_mm_packs_epi32(io, io), _mm_setzero_si128());
+			*reinterpret_cast<int*>(body + i) = _mm_cvtsi128_si32(pb);
+			*reinterpret_cast<int*>(border + i) = _mm_cvtsi128_si32(po);
+
+			u = _mm_add_ps(u, step_u);
+			v = _mm_add_ps(v, step_v);
+		}
+	}
+
+	return true;
+}
+
 namespace
 {
 	struct C {
@@ -1688,66 +1843,63 @@ namespace
 	}
 }
 
-// Render a subpicture onto a surface.
-// spd is the surface to render on.
-// clipRect is a rectangular clip region to render inside.
-// pAlphaMask is an alpha clipping mask.
-// xsub and ysub ???
-// switchpts seems to be an array of fill colours interlaced with coordinates.
-//	switchpts[i*2] contains a colour and switchpts[i*2+1] contains the coordinate to use that colour from
-// fBody tells whether to render the body of the subs.
-// fBorder tells whether to render the border of the subs.
-CRect Rasterizer::Draw(SubPicDesc& spd, CRect& clipRect, byte* pAlphaMask, int xsub, int ysub,
-					   const DWORD* switchpts, bool fBody, bool fBorder) const
+// Copy a part of the overlay as a single color coverage image, the arguments match DrawPart().
+void Rasterizer::AddImagePart(CSubImageList& images, int x, int y, int w, int h, int xo, int yo,
+							  const BYTE* alphaMask, int alphaPitch, DWORD color, bool fBody, bool fBorder) const
 {
-	CRect bbox(0, 0, 0, 0);
-
-	if (!m_pOverlayData || !switchpts || (!fBody && !fBorder)) {
-		return bbox;
+	if (w <= 0 || h <= 0 || !(color >> 24)) {
+		return;
 	}
 
-	// Limit drawn area to intersection of rendering surface and rectangular clip area
-	CRect r(0, 0, spd.w, spd.h);
-	r &= clipRect;
+	const int pitch = m_pOverlayData->mOverlayPitch;
+	const BYTE* srcBody = m_pOverlayData->mpOverlayBufferBody + pitch * yo + xo;
+	const BYTE* srcBorder = m_pOverlayData->mpOverlayBufferBorder + pitch * yo + xo;
+	const BYTE* s = fBorder ? srcBorder : srcBody;
 
-	// Remember that all subtitle coordinates are specified in 1/8 pixels
-	// (x+4)>>3 rounds to nearest whole pixel.
-	// ??? What is xsub, ysub, mOffsetX and mOffsetY ?
-	int x = (xsub + m_pOverlayData->mOffsetX + 4)>>3;
-	int y = (ysub + m_pOverlayData->mOffsetY + 4)>>3;
-	int w = m_pOverlayData->mOverlayWidth;
-	int h = m_pOverlayData->mOverlayHeight;
-	int xo = 0, yo = 0;
+	BYTE* bitmap = images.AllocBitmap(size_t(w) * h);
+	BYTE* dst = bitmap;
 
-	// Again, limiting?
-	if (x < r.left) {
-		xo = r.left-x;
-		w -= r.left-x;
-		x = r.left;
-	}
-	if (y < r.top) {
-		yo = r.top-y;
-		h -= r.top-y;
-		y = r.top;
-	}
-	if (x+w > r.right) {
-		w = r.right-x;
-	}
-	if (y+h > r.bottom) {
-		h = r.bottom-y;
+	for (int j = 0; j < h; j++, s += pitch, srcBody += pitch, dst += w) {
+		for (int i = 0; i < w; i++) {
+			// the overlay values are 6 bit, as is the clipping mask
+			DWORD a = s[i];
+			if (!fBody) {
+				a = a > srcBody[i] ? a - srcBody[i] : 0;
+			}
+			a = alphaMask ? (a * alphaMask[i] * 255 + (1 << 11)) >> 12 : (a * 255 + (1 << 5)) >> 6;
+			dst[i] = (BYTE)std::min<DWORD>(a, 255);
+		}
+		if (alphaMask) {
+			alphaMask += alphaPitch;
+		}
 	}
 
-	// Check if there's actually anything to render
-	if (w <= 0 || h <= 0) {
-		return bbox;
-	}
+	images.Add({ x, y, w, h, w, bitmap, color });
+}
 
-	bbox.SetRect(x, y, x+w, y+h);
-	bbox &= CRect(0, 0, spd.w, spd.h);
+// Blend a part of the overlay onto a surface.
+// (x, y, w, h) is the destination rectangle, (xo, yo) is the matching offset in the overlay.
+// alphaMask points to the mask value for (x, y) or is NULL when no clipping mask is needed.
+// With pImages the part is added to the image list instead, spd is not touched.
+void Rasterizer::DrawPart(SubPicDesc& spd, int x, int y, int w, int h, int xo, int yo,
+						  const BYTE* alphaMask, int alphaPitch, const DWORD* switchpts, bool fBody, bool fBorder,
+						  CSubImageList* pImages) const
+{
+	if (pImages) {
+		if (switchpts[1] == DWORD_MAX) {
+			AddImagePart(*pImages, x, y, w, h, xo, yo, alphaMask, alphaPitch, switchpts[0], fBody, fBorder);
+		} else {
+			// one image on each side of the switch point
+			const int len = std::max(0, std::min(int(switchpts[3]) - xo, w));
+			AddImagePart(*pImages, x, y, len, h, xo, yo, alphaMask, alphaPitch, switchpts[0], fBody, fBorder);
+			AddImagePart(*pImages, x + len, y, w - len, h, xo + len, yo, alphaMask ? alphaMask + len : nullptr, alphaPitch,
+						 switchpts[2], fBody, fBorder);
+		}
+		return;
+	}
 
 	BYTE* srcBody = m_pOverlayData->mpOverlayBufferBody + m_pOverlayData->mOverlayPitch * yo + xo;
 	BYTE* srcBorder = m_pOverlayData->mpOverlayBufferBorder + m_pOverlayData->mOverlayPitch * yo + xo;
-	BYTE* alphaMask = pAlphaMask + spd.w * y + x;
 	BYTE* dst = (BYTE*)((DWORD*)(spd.bits + spd.pitch * y) + x);
 	BYTE* s = fBorder ? srcBorder : srcBody;
 
@@ -1759,7 +1911,7 @@ CRect Rasterizer::Draw(SubPicDesc& spd, CRect& clipRect, byte* pAlphaMask, int x
 	};
 
 	int draw_op = 0;
-	draw_op |= pAlphaMask ? ALPHA : 0;
+	draw_op |= alphaMask ? ALPHA : 0;
 	draw_op |= fBody ? BODY : 0;
 	draw_op |= switchpts[1] != DWORD_MAX ? SWITCHPOINT : 0;
 
@@ -1791,28 +1943,125 @@ CRect Rasterizer::Draw(SubPicDesc& spd, CRect& clipRect, byte* pAlphaMask, int x
 			ASSERT(s == srcBorder);
 			__assume(s == srcBorder);
 			DrawInternal(m_bUseAVX2, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts, srcBorder,
-						 srcBody, alphaMask, spd.w);
+						 srcBody, alphaMask, alphaPitch);
 			break;
 		case ALPHA | BODY:
 			// Draw single color fill or shadow with alpha mask
 			DrawInternal(m_bUseAVX2, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts, alphaMask,
-						 spd.w);
+						 alphaPitch);
 			break;
 		case ALPHA | SWITCHPOINT:
 			// Draw multi color border with alpha mask
 			ASSERT(s == srcBorder);
 			__assume(s == srcBorder);
 			DrawInternal(m_bUseAVX2, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts, srcBorder,
-						 srcBody, alphaMask, spd.w, xo);
+						 srcBody, alphaMask, alphaPitch, xo);
 			break;
 		case ALPHA | BODY | SWITCHPOINT:
 			// Draw multi color fill or shadow with alpha mask
 			DrawInternal(m_bUseAVX2, dst, spd.pitch, s, m_pOverlayData->mOverlayPitch, w, h, switchpts, alphaMask,
-						 spd.w, xo);
+						 alphaPitch, xo);
 			break;
 		default:
 			ASSERT(FALSE);
 	}
+}
+
+// Render a subpicture onto a surface.
+// spd is the surface to render on.
+// clipRect is a rectangular clip region to render inside.
+// pAlphaMask is an alpha clipping mask, it only covers its own bounding rectangle.
+// xsub and ysub ???
+// switchpts seems to be an array of fill colours interlaced with coordinates.
+//	switchpts[i*2] contains a colour and switchpts[i*2+1] contains the coordinate to use that colour from
+// fBody tells whether to render the body of the subs.
+// fBorder tells whether to render the border of the subs.
+// pImages receives the coverage images instead of drawing them on spd, only spd.w and spd.h are used then.
+CRect Rasterizer::Draw(SubPicDesc& spd, CRect& clipRect, const CClipMask* pAlphaMask, int xsub, int ysub,
+					   const DWORD* switchpts, bool fBody, bool fBorder, CSubImageList* pImages) const
+{
+	CRect bbox(0, 0, 0, 0);
+
+	if (!m_pOverlayData || !switchpts || (!fBody && !fBorder)) {
+		return bbox;
+	}
+
+	// Limit drawn area to intersection of rendering surface and rectangular clip area
+	CRect r(0, 0, spd.w, spd.h);
+	r &= clipRect;
+
+	// Remember that all subtitle coordinates are specified in 1/8 pixels
+	// (x+4)>>3 rounds to nearest whole pixel.
+	// ??? What is xsub, ysub, mOffsetX and mOffsetY ?
+	int x = (xsub + m_pOverlayData->mOffsetX + 4)>>3;
+	int y = (ysub + m_pOverlayData->mOffsetY + 4)>>3;
+	int w = m_pOverlayData->mOverlayWidth;
+	int h = m_pOverlayData->mOverlayHeight;
+	int xo = 0, yo = 0;
+
+	// Again, limiting?
+	if (x < r.left) {
+		xo = r.left-x;
+		w -= r.left-x;
+		x = r.left;
+	}
+	if (y < r.top) {
+		yo = r.top-y;
+		h -= r.top-y;
+		y = r.top;
+	}
+	if (x+w > r.right) {
+		w = r.right-x;
+	}
+	if (y+h > r.bottom) {
+		h = r.bottom-y;
+	}
+
+	// Check if there's actually anything to render
+	if (w <= 0 || h <= 0) {
+		return bbox;
+	}
+
+	const CRect drawRect(x, y, x + w, y + h);
+
+	if (!pAlphaMask) {
+		DrawPart(spd, x, y, w, h, xo, yo, nullptr, 0, switchpts, fBody, fBorder, pImages);
+		bbox = drawRect;
+		return bbox;
+	}
+
+	CRect maskRect;
+	maskRect.IntersectRect(drawRect, pAlphaMask->rect);
+
+	if (!maskRect.IsRectEmpty()) {
+		const int alphaPitch = pAlphaMask->rect.Width();
+		const BYTE* alphaMask = pAlphaMask->pMask
+								+ alphaPitch * (maskRect.top - pAlphaMask->rect.top)
+								+ (maskRect.left - pAlphaMask->rect.left);
+		DrawPart(spd, maskRect.left, maskRect.top, maskRect.Width(), maskRect.Height(),
+				 xo + maskRect.left - x, yo + maskRect.top - y, alphaMask, alphaPitch, switchpts, fBody, fBorder, pImages);
+		bbox = maskRect;
+	}
+
+	if (pAlphaMask->bInverse) {
+		// Outside of its rectangle an inverse mask is fully opaque, so the rest is drawn without mask
+		auto drawUnmasked = [&](const CRect& part) {
+			if (part.left < part.right && part.top < part.bottom) {
+				DrawPart(spd, part.left, part.top, part.Width(), part.Height(),
+						 xo + part.left - x, yo + part.top - y, nullptr, 0, switchpts, fBody, fBorder, pImages);
+				bbox |= part;
+			}
+		};
+
+		if (maskRect.IsRectEmpty()) {
+			drawUnmasked(drawRect);
+		} else {
+			drawUnmasked(CRect(drawRect.left, drawRect.top, drawRect.right, maskRect.top));
+			drawUnmasked(CRect(drawRect.left, maskRect.top, maskRect.left, maskRect.bottom));
+			drawUnmasked(CRect(maskRect.right, maskRect.top, drawRect.right, maskRect.bottom));
+			drawUnmasked(CRect(drawRect.left, maskRect.bottom, drawRect.right, drawRect.bottom));
+		}
+	}
 
 	return bbox;
 }
@@ -127,6 +127,48 @@ struct COverlayData {
 
 typedef std::shared_ptr<COverlayData> COverlayDataSharedPtr;
 
+// Alpha clipping mask stored only for its bounding rectangle (in surface coordinates).
+// Outside of the rectangle the mask is 0, or 0x40 for an inverse mask.
+struct CClipMask {
+	const BYTE* pMask;
+	CRect rect;
+	bool bInverse;
+
+	CClipMask(const BYTE* mask, const CRect& r, bool inverse)
+		: pMask(mask)
+		, rect(r)
+		, bInverse(inverse) {}
+};
+
+// Coverage image of a part of the subtitles, filled with a single color.
+// bitmap holds w x h 8-bit coverage values, color is 0xAARRGGBB with AA as opacity.
+struct SubImage {
+	int x, y, w, h;
+	int stride;
+	const BYTE* bitmap;
+	DWORD color;
+};
+
+// Positioned images of the rendered subtitles, in drawing order, for callers that composite them on their own
+class CSubImageList
+{
+	std::vector<SubImage> m_images;
+	std::vector<std::unique_ptr<BYTE[]>> m_buffers;
+
+public:
+	BYTE* AllocBitmap(size_t size) {
+		m_buffers.emplace_back(DNew BYTE[size]);
+		return m_buffers.back().get();
+	}
+	void Add(const SubImage& image) { m_images.emplace_back(image); }
+	void Clear() {
+		m_images.clear();
+		m_buffers.clear();
+	}
+
+	const std::vector<SubImage>& GetImages() const { return m_images; }
+};
+
 class Rasterizer
 {
 	bool fFirstSet;
@@ -169,6 +211,11 @@ private:
 	template<int flag> __forceinline void _EvaluateLine(int x0, int y0, int x1, int y1);
 	static void _OverlapRegion(tSpanBuffer& dst, const tSpanBuffer& src, int dx, int dy);
 	void CreateWidenedRegionFast(const int borderY);
+	void DrawPart(SubPicDesc& spd, int x, int y, int w, int h, int xo, int yo,
+				  const BYTE* alphaMask, int alphaPitch, const DWORD* switchpts, bool fBody, bool fBorder,
+				  CSubImageList* pImages) const;
+	void AddImagePart(CSubImageList& images, int x, int y, int w, int h, int xo, int yo,
+					  const BYTE* alphaMask, int alphaPitch, DWORD color, bool fBody, bool fBorder) const;
 
 public:
 	Rasterizer();
@@ -181,8 +228,10 @@ public:
 	bool ScanConvert();
 	bool CreateWidenedRegion(int borderX, int borderY);
 	bool Rasterize(int xsub, int ysub, int fBlur, double fGaussianBlur);
+	bool ResampleOverlay(const COverlayData& src, const double m[6], int xsub, int ysub);
 	int getOverlayWidth() const;
 
-	CRect Draw(SubPicDesc& spd, CRect& clipRect, byte* pAlphaMask, int xsub, int ysub, const DWORD* switchpts, bool fBody, bool fBorder) const;
+	CRect Draw(SubPicDesc& spd, CRect& clipRect, const CClipMask* pAlphaMask, int xsub, int ysub, const DWORD* switchpts, bool fBody, bool fBorder,
+			   CSubImageList* pImages = nullptr) const;
 	void FillSolidRect(SubPicDesc& spd, int x, int y, int nWidth, int nHeight, DWORD lColor) const;
 };
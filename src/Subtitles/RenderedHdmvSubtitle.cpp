@@ -89,6 +89,10 @@ STDMETHODIMP_(POSITION) CRenderedHdmvSubtitle::GetStartPosition(REFERENCE_TIME r
 {
 	CAutoLock cAutoLock(&m_csCritSec);
 
+	if (m_bIndexed) {
+		LoadDisplaySets(rt);
+	}
+
 	return m_pSub->GetStartPosition(rt, fps, CleanOld);
 }
 
@@ -126,6 +130,10 @@ STDMETHODIMP CRenderedHdmvSubtitle::Render(SubPicDesc& spd, REFERENCE_TIME rt, d
 
 	if (!m_bLoadFromFile) {
 		m_pSub->CleanOld(rt - 60*10000000i64); // Cleanup subtitles older than 1 minute ...
+	} else if (m_bIndexed) {
+		// The evicted display sets are decoded again from the file when seeking back
+		m_pSub->CleanOld(rt - INDEX_LOOKBEHIND);
+		m_rtLoadedFrom = std::max(m_rtLoadedFrom, rt - INDEX_LOOKBEHIND);
 	}
 
 	return hr;
@@ -238,7 +246,7 @@ HRESULT CRenderedHdmvSubtitle::EndOfStream()
 	return m_pSub->EndOfStream();
 }
 
-bool CRenderedHdmvSubtitle::Open(const CString& fn, const CString& name, const CString& videoName)
+bool CRenderedHdmvSubtitle::Open(const CString& fn, const CString& name, const CString& videoName, bool bIndexed)
 {
 	CFile f;
 	if (!f.Open(fn, CFile::modeRead | CFile::typeBinary | CFile::shareDenyNone)) {
@@ -258,7 +266,56 @@ bool CRenderedHdmvSubtitle::Open(const CString& fn, const CString& name, const C
 	}
 	m_pSub = DNew CHdmvSub();
 
-	m_parsingThread = std::thread([this, fn] { ParseFile(fn); });
+	if (bIndexed) {
+		if (!m_file.Open(fn, CFile::modeRead | CFile::typeBinary | CFile::shareDenyNone)) {
+			return false;
+		}
+
+		m_bIndexed = true;
+		m_parsingThread = std::thread([this, fn] { IndexFile(fn); });
+	} else {
+		m_parsingThread = std::thread([this, fn] { ParseFile(fn); });
+	}
+
+	return true;
+}
+
+bool CRenderedHdmvSubtitle::ParseSegment(CFile& f, std::vector<BYTE>& segBuff)
+{
+	// Header: Sync code | start time | stop time | segment type | segment size
+	std::array<BYTE, 2 + 2 * 4 + 1 + 2> header;
+	const unsigned nExtraSize = 1 + 2; // segment type + segment size
+
+	if (f.Read(header.data(), header.size()) != header.size()) {
+		return false;
+	}
+
+	// Parse the header
+	CGolombBuffer headerBuffer(header.data(), (int)header.size());
+
+	if (WORD(headerBuffer.ReadShort()) != PGS_SYNC_CODE) {
+		return false;
+	}
+
+	const REFERENCE_TIME rtStart = REFERENCE_TIME(headerBuffer.ReadDword()) * 1000 / 9;
+	const REFERENCE_TIME rtStop = REFERENCE_TIME(headerBuffer.ReadDword()) * 1000 / 9;
+	headerBuffer.ReadByte(); // segment type
+	const WORD wLenSegment = (WORD)headerBuffer.ReadShort();
+
+	// Leave some room to add the segment type and size
+	unsigned nLenData = nExtraSize + wLenSegment;
+	if (nLenData > segBuff.size()) {
+		segBuff.resize(nLenData);
+	}
+	memcpy(segBuff.data(), &header[header.size() - nExtraSize], nExtraSize);
+
+	// Read the segment
+	if (wLenSegment && f.Read(&segBuff[nExtraSize], wLenSegment) != wLenSegment) {
+		return false;
+	}
+
+	// Parse the data (even if the segment size is 0 because the header itself is important)
+	m_pSub->ParseSample(segBuff.data(), nLenData, rtStart, rtStop);
 
 	return true;
 }
@@ -270,37 +327,100 @@ void CRenderedHdmvSubtitle::ParseFile(const CString& fn)
 		return;
 	}
 
-	// Header: Sync code | start time | stop time | segment type | segment size
-	std::array<BYTE, 2 + 2 * 4 + 1 + 2> header;
-	const unsigned nExtraSize = 1 + 2; // segment type + segment size
 	std::vector<BYTE> segBuff;
 
-	while (!m_bStopParsing && f.Read(header.data(), header.size()) == header.size()) {
-		// Parse the header
-		CGolombBuffer headerBuffer(header.data(), (int)header.size());
+	while (!m_bStopParsing && ParseSegment(f, segBuff)) {
+	}
+}
 
-		if (WORD(headerBuffer.ReadShort()) != PGS_SYNC_CODE) {
-			break;
+void CRenderedHdmvSubtitle::IndexFile(const CString& fn)
+{
+	CFile f;
+	if (f.Open(fn, CFile::modeRead | CFile::typeBinary | CFile::shareDenyNone)) {
+		// Header: Sync code | start time | stop time | segment type | segment size
+		std::array<BYTE, 2 + 2 * 4 + 1 + 2> header;
+		// Presentation segment: video descriptor | composition number | composition state
+		std::array<BYTE, 5 + 2 + 1> presentation;
+
+		while (!m_bStopParsing) {
+			const ULONGLONG pos = f.GetPosition();
+			if (f.Read(header.data(), header.size()) != header.size()) {
+				break;
+			}
+
+			CGolombBuffer headerBuffer(header.data(), (int)header.size());
+
+			if (WORD(headerBuffer.ReadShort()) != PGS_SYNC_CODE) {
+				break;
+			}
+
+			const REFERENCE_TIME rtStart = REFERENCE_TIME(headerBuffer.ReadDword()) * 1000 / 9;
+			headerBuffer.ReadDword(); // stop time
+			const BYTE segType = headerBuffer.ReadByte();
+			UINT nSkip = (WORD)headerBuffer.ReadShort();
+
+			// Every display set starts with a presentation segment
+			if (segType == CHdmvSub::PRESENTATION_SEG && nSkip >= presentation.size()) {
+				if (f.Read(presentation.data(), presentation.size()) != presentation.size()) {
+					break;
+				}
+				nSkip -= (UINT)presentation.size();
+
+				const bool bRandomAccess = (presentation.back() & 0xC0) != 0;
+
+				CAutoLock cAutoLock(&m_csCritSec);
+				m_displaySets.push_back({ rtStart, pos, bRandomAccess });
+			}
+
+			f.Seek(nSkip, CFile::current);
 		}
 
-		const REFERENCE_TIME rtStart = REFERENCE_TIME(headerBuffer.ReadDword()) * 1000 / 9;
-		const REFERENCE_TIME rtStop = REFERENCE_TIME(headerBuffer.ReadDword()) * 1000 / 9;
-		headerBuffer.ReadByte(); // segment type
-		const WORD wLenSegment = (WORD)headerBuffer.ReadShort();
+		CAutoLock cAutoLock(&m_csCritSec);
+		m_fileSize = f.GetLength();
+	}
 
-		// Leave some room to add the segment type and size
-		unsigned nLenData = nExtraSize + wLenSegment;
-		if (nLenData > segBuff.size()) {
-			segBuff.resize(nLenData);
-		}
-		memcpy(segBuff.data(), &header[header.size() - nExtraSize], nExtraSize);
+	CAutoLock cAutoLock(&m_csCritSec);
+	m_bIndexComplete = true;
+}
+
+void CRenderedHdmvSubtitle::LoadDisplaySets(REFERENCE_TIME rt)
+{
+	if (m_displaySets.empty()) {
+		return;
+	}
+
+	// The display set shown at rt and the random access point it depends on
+	auto it = std::upper_bound(m_displaySets.cbegin(), m_displaySets.cend(), rt, [](REFERENCE_TIME value, const DisplaySet& ds) {
+		return value < ds.rtStart;
+	});
+	size_t nRandomAccess = it == m_displaySets.cbegin() ? 0 : it - m_displaySets.cbegin() - 1;
+	while (nRandomAccess > 0 && !m_displaySets[nRandomAccess].bRandomAccess) {
+		nRandomAccess--;
+	}
+
+	if (rt < m_rtLoadedFrom || nRandomAccess > m_nNextToLoad) {
+		// Seeking outside of the decoded range, restart from the random access point
+		m_pSub->Reset();
+		m_nNextToLoad  = nRandomAccess;
+		m_rtLoadedFrom = nRandomAccess ? m_displaySets[nRandomAccess].rtStart : _I64_MIN;
+	}
 
-		// Read the segment
-		if (wLenSegment && f.Read(&segBuff[nExtraSize], wLenSegment) != wLenSegment) {
+	// Decode one display set past the window, it gives the stop time of the previous one
+	const REFERENCE_TIME rtLoadUntil = rt + INDEX_LOOKAHEAD;
+	const size_t nCount = m_displaySets.size();
+
+	while (m_nNextToLoad < nCount && (m_nNextToLoad == 0 || m_displaySets[m_nNextToLoad - 1].rtStart <= rtLoadUntil)) {
+		const bool bLast = m_nNextToLoad + 1 == nCount;
+		if (bLast && !m_bIndexComplete) {
+			// The end of the last display set is not known yet
 			break;
 		}
 
-		// Parse the data (even if the segment size is 0 because the header itself is important)
-		m_pSub->ParseSample(segBuff.data(), nLenData, rtStart, rtStop);
+		const ULONGLONG end = bLast ? m_fileSize : m_displaySets[m_nNextToLoad + 1].pos;
+		m_file.Seek(m_displaySets[m_nNextToLoad].pos, CFile::begin);
+		while (m_file.GetPosition() < end && ParseSegment(m_file, m_segBuff)) {
+		}
+
+		m_nNextToLoad++;
 	}
 }
@@ -61,7 +61,7 @@ public:
 	HRESULT	NewSegment(REFERENCE_TIME tStart, REFERENCE_TIME tStop, double dRate);
 	HRESULT	EndOfStream();
 
-	bool Open(const CString& fn, const CString& name, const CString& videoName);
+	bool Open(const CString& fn, const CString& name, const CString& videoName, bool bIndexed = false);
 
 private :
 	CString			m_name;
@@ -79,5 +79,27 @@ private :
 
 	bool m_bLoadFromFile = false;
 
+	// Indexed loading: only the display sets around the playback position are decoded
+	struct DisplaySet {
+		REFERENCE_TIME rtStart;
+		ULONGLONG      pos;
+		bool           bRandomAccess; // epoch start or acquisition point
+	};
+
+	static const REFERENCE_TIME INDEX_LOOKBEHIND = 60 * 10000000i64;
+	static const REFERENCE_TIME INDEX_LOOKAHEAD  = 90 * 10000000i64;
+
+	bool                    m_bIndexed       = false;
+	bool                    m_bIndexComplete = false;
+	ULONGLONG               m_fileSize       = 0;
+	std::vector<DisplaySet> m_displaySets;
+	size_t                  m_nNextToLoad    = 0;
+	REFERENCE_TIME          m_rtLoadedFrom   = _I64_MIN;
+	CFile                   m_file;
+	std::vector<BYTE>       m_segBuff;
+
 	void ParseFile(const CString& fn);
+	void IndexFile(const CString& fn);
+	void LoadDisplaySets(REFERENCE_TIME rt);
+	bool ParseSegment(CFile& f, std::vector<BYTE>& segBuff);
 };
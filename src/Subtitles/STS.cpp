@@ -22,7 +22,10 @@
 #include "stdafx.h"
 #include "STS.h"
 #include <fstream>
+#include <mutex>
 #include <regex>
+#include <string_view>
+#include <unordered_map>
 #include "RealTextParser.h"
 #include "USFSubtitles.h"
 #include "RegexUtil.h"
@@ -1648,7 +1651,52 @@ static double GetFloat(LPCWSTR& pszBuff, int& nLength, WCHAR sep = L',')
 	return ret;
 }
 
-static bool LoadFont(const CString& font)
+class CEmbeddedFont
+{
+	const std::pair<size_t, int> m_key;
+	HANDLE m_hFont = nullptr; // memory font
+	CString m_fn;             // or a temporary font file if the memory font could not be added
+
+public:
+	CEmbeddedFont(const std::pair<size_t, int>& key, HANDLE hFont, const CString& fn)
+		: m_key(key)
+		, m_hFont(hFont)
+		, m_fn(fn) {}
+	~CEmbeddedFont();
+
+	const std::pair<size_t, int>& GetKey() const { return m_key; }
+};
+
+// Keyed by the hash and length of the encoded font data, so a font already loaded is neither decoded nor added again
+class CEmbeddedFontRegistry
+{
+	std::mutex m_mutex;
+	std::map<std::pair<size_t, int>, std::weak_ptr<CEmbeddedFont>> m_fonts;
+
+	static bool DecodeFont(const CString& font, std::unique_ptr<BYTE[]>& pData, int& datalen);
+
+public:
+	static CEmbeddedFontRegistry& Instance() {
+		static CEmbeddedFontRegistry registry;
+		return registry;
+	}
+
+	CEmbeddedFontSharedPtr Load(const CString& font);
+	void Remove(const CEmbeddedFont* pFont);
+};
+
+CEmbeddedFont::~CEmbeddedFont()
+{
+	if (m_hFont) {
+		RemoveFontMemResourceEx(m_hFont);
+	} else {
+		RemoveFontResourceW(m_fn);
+	}
+
+	CEmbeddedFontRegistry::Instance().Remove(this);
+}
+
+bool CEmbeddedFontRegistry::DecodeFont(const CString& font, std::unique_ptr<BYTE[]>& pData, int& datalen)
 {
 	int len = font.GetLength();
 
@@ -1656,7 +1704,7 @@ static bool LoadFont(const CString& font)
 		return false;
 	}
 
-	auto pData = std::make_unique<BYTE[]>(len);
+	pData = std::make_unique<BYTE[]>(len);
 
 	const WCHAR* s = font;
 	const WCHAR* e = s + len;
@@ -1670,7 +1718,7 @@ static bool LoadFont(const CString& font)
 		pData[j + 2] = ((pData[i + 2] &  3) << 6) | ((pData[i + 3] >> 0) & 63);
 	}
 
-	int datalen = (len & ~3) * 3 / 4;
+	datalen = (len & ~3) * 3 / 4;
 
 	if ((len & 3) == 2) {
 		pData[datalen++] = ((pData[(len & ~3) + 0] & 63) << 2) | ((pData[(len & ~3) + 1] >> 4) & 3);
@@ -1679,11 +1727,34 @@ static bool LoadFont(const CString& font)
 		pData[datalen++] = ((pData[(len & ~3) + 1] & 15) << 4) | ((pData[(len & ~3) + 2] >> 2) & 15);
 	}
 
-	HANDLE hFont = INVALID_HANDLE_VALUE;
+	return true;
+}
+
+CEmbeddedFontSharedPtr CEmbeddedFontRegistry::Load(const CString& font)
+{
+	const std::pair<size_t, int> key(std::hash<std::wstring_view>()(std::wstring_view(font, font.GetLength())), font.GetLength());
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	auto it = m_fonts.find(key);
+	if (it != m_fonts.end()) {
+		if (auto pFont = it->second.lock()) {
+			return pFont;
+		}
+	}
+
+	std::unique_ptr<BYTE[]> pData;
+	int datalen;
+	if (!DecodeFont(font, pData, datalen)) {
+		return nullptr;
+	}
+
+	// GDI keeps its own copy of a memory font, the decoded data is not needed afterwards
 	DWORD cFonts;
-	hFont = AddFontMemResourceEx(pData.get(), datalen, NULL, &cFonts);
+	HANDLE hFont = AddFontMemResourceEx(pData.get(), datalen, NULL, &cFonts);
+	CString fn;
 
-	if (hFont == INVALID_HANDLE_VALUE) {
+	if (!hFont) {
 		WCHAR path[MAX_PATH] = { 0 };
 		GetTempPathW(MAX_PATH, path);
 
@@ -1692,7 +1763,6 @@ static bool LoadFont(const CString& font)
 			chksum += ((DWORD*)pData.get())[i];
 		}
 
-		CString fn;
 		fn.Format(L"%sfont%08lx.ttf", path, chksum);
 
 		if (!::PathFileExistsW(fn)) {
@@ -1703,14 +1773,39 @@ static bool LoadFont(const CString& font)
 			}
 		}
 
-		return !!AddFontResourceW(fn);
+		if (!AddFontResourceW(fn)) {
+			return nullptr;
+		}
 	}
 
-	return true;
+	CEmbeddedFontSharedPtr pFont(DNew CEmbeddedFont(key, hFont, fn));
+	m_fonts[key] = pFont;
+
+	return pFont;
+}
+
+void CEmbeddedFontRegistry::Remove(const CEmbeddedFont* pFont)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	// the font may have been loaded again in the meantime
+	auto it = m_fonts.find(pFont->GetKey());
+	if (it != m_fonts.end() && it->second.expired()) {
+		m_fonts.erase(it);
+	}
 }
 
-static bool LoadUUEFont(CTextFile* file)
+static bool LoadUUEFont(CTextFile* file, CSimpleTextSubtitle& ret)
 {
+	auto LoadFont = [&ret](const CString& font) {
+		if (auto pFont = CEmbeddedFontRegistry::Instance().Load(font)) {
+			ret.m_embeddedFonts.emplace_back(pFont);
+			return true;
+		}
+		return false;
+	};
+
+
 	CString s, font;
 	int cnt = 0;
 	while (file->ReadString(s)) {
@@ -1978,6 +2073,11 @@ static bool OpenSubStationAlpha(CTextFile* file, CSimpleTextSubtitle& ret)
 				buff.MakeLower();
 				ret.m_fScaledBAS = buff.Find(L"yes") >= 0;
 			}
+		} else if (entry == L"ycbcr matrix") {
+			if (script_info) {
+				ret.m_yuvMatrix = GetStrW(pszBuff, nBuffLength);
+				ret.m_yuvMatrix.Trim();
+			}
 		} else if (entry == L"[script info]") {
 			bRet = true;
 			script_info = true;
@@ -1997,7 +2097,7 @@ static bool OpenSubStationAlpha(CTextFile* file, CSimpleTextSubtitle& ret)
 			bRet = true;
 			events = true;
 		} else if (entry == L"fontname") {
-			if (LoadUUEFont(file)) {
+			if (LoadUUEFont(file, ret)) {
 				bRet = true;
 			}
 		}
@@ -2139,7 +2239,7 @@ static bool OpenXombieSub(CTextFile* file, CSimpleTextSubtitle& ret)
 				return false;
 			}
 		} else if (entry == L"fontname") {
-			LoadUUEFont(file);
+			LoadUUEFont(file, ret);
 		}
 	}
 
@@ -2273,9 +2373,11 @@ void CSimpleTextSubtitle::Copy(CSimpleTextSubtitle& sts)
 		m_defaultWrapStyle = sts.m_defaultWrapStyle;
 		m_collisions = sts.m_collisions;
 		m_fScaledBAS = sts.m_fScaledBAS;
+		m_yuvMatrix = sts.m_yuvMatrix;
 		m_encoding = sts.m_encoding;
 		m_fUsingAutoGeneratedDefaultStyle = sts.m_fUsingAutoGeneratedDefaultStyle;
 		CopyStyles(sts.m_styles);
+		m_embeddedFonts = sts.m_embeddedFonts;
 		m_segments.Copy(sts.m_segments);
 		__super::Copy(sts);
 	}
@@ -2295,6 +2397,7 @@ void CSimpleTextSubtitle::Append(CSimpleTextSubtitle& sts, int timeoff)
 	}
 
 	CopyStyles(sts.m_styles, true);
+	m_embeddedFonts.insert(m_embeddedFonts.end(), sts.m_embeddedFonts.begin(), sts.m_embeddedFonts.end());
 
 	for (size_t i = 0, j = sts.GetCount(); i < j; i++) {
 		STSEntry stse = sts.GetAt(i);
@@ -2307,6 +2410,138 @@ void CSimpleTextSubtitle::Append(CSimpleTextSubtitle& sts, int timeoff)
 	CreateSegments();
 }
 
+static ULONG HashEntry(const STSEntry& stse)
+{
+	return CStringElementTraits<CStringW>::Hash(stse.str) ^ (ULONG)stse.start ^ ((ULONG)stse.end << 16);
+}
+
+static bool IsEntryEqual(const STSEntry& a, const STSEntry& b)
+{
+	return a.start == b.start && a.end == b.end && a.layer == b.layer && a.marginRect == b.marginRect
+		   && a.str == b.str && a.style == b.style && a.actor == b.actor && a.effect == b.effect;
+}
+
+bool CSimpleTextSubtitle::Update(CSimpleTextSubtitle& sts, std::vector<int>& entryMap, std::vector<std::pair<int, int>>& changed)
+{
+	entryMap.assign(sts.GetCount(), -1);
+	changed.clear();
+
+	const bool bSameHeader = m_subtitleType == sts.m_subtitleType
+							 && m_mode == sts.m_mode
+							 && m_dstScreenSize == sts.m_dstScreenSize
+							 && m_defaultWrapStyle == sts.m_defaultWrapStyle
+							 && m_collisions == sts.m_collisions
+							 && m_fScaledBAS == sts.m_fScaledBAS;
+
+	if (bSameHeader) {
+		CAtlMap<CString, bool, CStringElementTraits<CString>> changedStyles;
+
+		POSITION pos = m_styles.GetStartPosition();
+		while (pos) {
+			CString key;
+			STSStyle* val;
+			m_styles.GetNextAssoc(pos, key, val);
+			STSStyle* val2;
+			if (!sts.m_styles.Lookup(key, val2) || *val != *val2) {
+				changedStyles[key] = true;
+			}
+		}
+		pos = sts.m_styles.GetStartPosition();
+		while (pos) {
+			CString key;
+			STSStyle* val;
+			sts.m_styles.GetNextAssoc(pos, key, val);
+			if (!m_styles.Lookup(key)) {
+				changedStyles[key] = true;
+			}
+		}
+
+		std::unordered_multimap<ULONG, size_t> oldEntries;
+		oldEntries.reserve(GetCount());
+		for (size_t i = 0; i < GetCount(); i++) {
+			oldEntries.emplace(HashEntry(GetAt(i)), i);
+		}
+
+		for (size_t j = 0; j < sts.GetCount(); j++) {
+			const STSEntry& stse = sts.GetAt(j);
+
+			// \r can switch to any style
+			const bool bStyleChanged = changedStyles.Lookup(stse.style)
+									   || (!changedStyles.IsEmpty() && stse.str.Find(L"\\r") >= 0);
+			if (!bStyleChanged) {
+				auto range = oldEntries.equal_range(HashEntry(stse));
+				for (auto it = range.first; it != range.second; ++it) {
+					if (IsEntryEqual(GetAt(it->second), stse)) {
+						entryMap[j] = (int)it->second;
+						oldEntries.erase(it);
+						break;
+					}
+				}
+			}
+
+			if (entryMap[j] < 0) {
+				changed.emplace_back(stse.start, stse.end);
+			}
+		}
+
+		for (const auto& [hash, i] : oldEntries) {
+			changed.emplace_back(GetAt(i).start, GetAt(i).end);
+		}
+
+		std::sort(changed.begin(), changed.end());
+
+		// The collision positions depend on the lines displayed together, so a range goes on to
+		// the end of the events overlapping it, and of the events overlapping those
+		std::vector<std::pair<int, int>> events;
+		events.reserve(sts.GetCount());
+		for (size_t j = 0; j < sts.GetCount(); j++) {
+			events.emplace_back(sts.GetAt(j).start, sts.GetAt(j).end);
+		}
+		std::sort(events.begin(), events.end());
+
+		size_t k = 0;
+		int maxEnd = INT_MIN;
+		for (auto& [start, end] : changed) {
+			for (;;) {
+				while (k < events.size() && events[k].first < end) {
+					maxEnd = std::max(maxEnd, events[k].second);
+					k++;
+				}
+				if (maxEnd <= end) {
+					break;
+				}
+				end = maxEnd;
+			}
+		}
+
+		size_t n = 0;
+		for (size_t i = 0; i < changed.size(); i++) {
+			if (n > 0 && changed[i].first <= changed[n - 1].second) {
+				changed[n - 1].second = std::max(changed[n - 1].second, changed[i].second);
+			} else {
+				changed[n++] = changed[i];
+			}
+		}
+		changed.resize(n);
+	}
+
+	m_subtitleType = sts.m_subtitleType;
+	m_mode = sts.m_mode;
+	m_encoding = sts.m_encoding;
+	m_dstScreenSize = sts.m_dstScreenSize;
+	m_defaultWrapStyle = sts.m_defaultWrapStyle;
+	m_collisions = sts.m_collisions;
+	m_fScaledBAS = sts.m_fScaledBAS;
+	m_yuvMatrix = sts.m_yuvMatrix;
+	m_fUsingAutoGeneratedDefaultStyle = sts.m_fUsingAutoGeneratedDefaultStyle;
+	CopyStyles(sts.m_styles);
+	m_embeddedFonts = sts.m_embeddedFonts;
+	m_segments.Copy(sts.m_segments);
+	__super::Copy(sts);
+
+	return bSameHeader;
+}
+
 void CSTSStyleMap::Free()
 {
 	POSITION pos = GetStartPosition();
@@ -2348,9 +2583,12 @@ bool CSimpleTextSubtitle::CopyStyles(const CSTSStyleMap& styles, bool fAppend)
 void CSimpleTextSubtitle::Empty()
 {
 	m_dstScreenSize = CSize(0, 0);
+	m_yuvMatrix.Empty();
 	m_styles.Free();
+	m_embeddedFonts.clear();
 	m_segments.RemoveAll();
 	RemoveAll();
+	m_nEvicted = 0;
 }
 
 static bool SegmentCompStart(const STSSegment& segment, int start)
@@ -2381,6 +2619,13 @@ void CSimpleTextSubtitle::Add(CStringW str, int start, int end, CString style, C
 	}
 	style.TrimLeft(L'*');
 
+	if (m_retention > 0 && !m_segments.IsEmpty()) {
+		const int horizon = std::max(end, m_segments[m_segments.GetCount() - 1].end) - m_retention;
+		if (m_segments[0].end <= horizon - m_retention / 4) {
+			RemoveOldEntries(horizon);
+		}
+	}
+
 	STSEntry sub;
 	sub.str = str;
 	sub.style = style;
@@ -2390,7 +2635,7 @@ void CSimpleTextSubtitle::Add(CStringW str, int start, int end, CString style, C
 	sub.layer = layer;
 	sub.start = start;
 	sub.end = end;
-	sub.readorder = readorder < 0 ? (int)GetCount() : readorder;
+	sub.readorder = readorder < 0 ? int(GetCount() + m_nEvicted) : readorder;
 
 	int n = (int)__super::Add(sub);
 
@@ -2491,6 +2736,65 @@ void CSimpleTextSubtitle::Add(CStringW str, int start, int end, CString style, C
 	}
 }
 
+void CSimpleTextSubtitle::RemoveOldEntries(int horizon)
+{
+	// the segments are sorted and don't overlap
+	size_t nSegments = 0;
+	while (nSegments < m_segments.GetCount() && m_segments[nSegments].end <= horizon) {
+		nSegments++;
+	}
+	m_segments.RemoveAt(0, nSegments);
+
+	// An entry of a remaining segment covers the whole segment, so it ends after the horizon
+	// and is kept. The entries can arrive out of order, hence the compaction of the array.
+	std::vector<int> entryMap(GetCount(), -1);
+	size_t n = 0;
+	for (size_t i = 0; i < GetCount(); i++) {
+		if (GetAt(i).end > horizon) {
+			if (n != i) {
+				GetAt(n) = GetAt(i);
+			}
+			entryMap[i] = (int)n++;
+		}
+	}
+
+	m_nEvicted += GetCount() - n;
+	SetCount(n);
+
+	for (size_t i = 0; i < m_segments.GetCount(); i++) {
+		CAtlArray<int>& subs = m_segments[i].subs;
+		for (size_t j = 0; j < subs.GetCount(); j++) {
+			ASSERT(entryMap[subs[j]] >= 0);
+			subs[j] = entryMap[subs[j]];
+		}
+	}
+
+	OnEntriesRemoved(nSegments, entryMap);
+}
+
+void CSimpleTextSubtitle::SetRetention(int retention)
+{
+	m_retention = std::max(retention, 0);
+}
+
+void CSimpleTextSubtitle::GetMemoryStats(STSMemoryStats& stats)
+{
+	stats = {};
+
+	stats.entries = GetCount();
+	stats.segments = m_segments.GetCount();
+	stats.evicted = m_nEvicted;
+
+	stats.bytes = GetCount() * sizeof(STSEntry) + m_segments.GetCount() * sizeof(STSSegment);
+	for (size_t i = 0; i < GetCount(); i++) {
+		const STSEntry& stse = GetAt(i);
+		stats.bytes += (stse.str.GetLength() + stse.style.GetLength() + stse.actor.GetLength() + stse.effect.GetLength()) * sizeof(WCHAR);
+	}
+	for (size_t i = 0; i < m_segments.GetCount(); i++) {
+		stats.bytes += m_segments[i].subs.GetCount() * sizeof(int);
+	}
+}
+
 STSStyle* CSimpleTextSubtitle::CreateDefaultStyle(int CharSet)
 {
 	CString def(L"Default");
@@ -3206,6 +3510,11 @@ bool CSimpleTextSubtitle::SaveAs(CString fn, Subtitle::SubType type, double fps,
 		if (type == Subtitle::ASS && m_fScaledBAS) {
 			str += L"ScaledBorderAndShadow: Yes\n";
 		}
+		if (type == Subtitle::ASS && !m_yuvMatrix.IsEmpty()) {
+			CString yuvMatrix = m_yuvMatrix;
+			yuvMatrix.Replace(L"%", L"%%"); // str is a format string
+			str += L"YCbCr Matrix: " + yuvMatrix + L"\n";
+		}
 		str += L"PlayResX: %d\n";
 		str += L"PlayResY: %d\n";
 		str += L"Timer: 100.0000\n";
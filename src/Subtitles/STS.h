@@ -22,6 +22,8 @@
 #pragma once
 
 #include <atlcoll.h>
+#include <memory>
+#include <vector>
 #include <../external/BaseClasses/wxutil.h>
 #include "TextFile.h"
 #include "SubtitleHelpers.h"
@@ -123,6 +125,19 @@ public:
 	}
 };
 
+// Memory used by a streamed script, see CSimpleTextSubtitle::SetRetention()
+struct STSMemoryStats {
+	size_t entries  = 0;
+	size_t segments = 0;
+	size_t bytes    = 0; // approximate size of the entries and segments
+	size_t evicted  = 0; // entries evicted since the script was emptied
+	size_t cached   = 0; // parsed subtitles kept by the renderer
+};
+
+// Font embedded in a script, registered once per process and shared by all scripts embedding the same data
+class CEmbeddedFont;
+typedef std::shared_ptr<CEmbeddedFont> CEmbeddedFontSharedPtr;
+
 class CSimpleTextSubtitle : public CAtlArray<STSEntry>
 {
 	friend class CSubtitleEditorDlg;
@@ -131,6 +146,14 @@ protected:
 	CAtlArray<STSSegment> m_segments;
 	virtual void OnChanged() {}
 
+	// streaming mode, 0 keeps every entry
+	int m_retention = 0;
+	size_t m_nEvicted = 0;
+
+	void RemoveOldEntries(int horizon);
+	// nSegments segments were removed at the beginning, entryMap gives the new index of every old entry or -1
+	virtual void OnEntriesRemoved(size_t nSegments, const std::vector<int>& entryMap) {}
+
 public:
 	CString m_name;
 	LCID m_lcid;
@@ -144,11 +167,15 @@ public:
 	int m_defaultWrapStyle;
 	int m_collisions;
 	bool m_fScaledBAS;
+	CString m_yuvMatrix; // "YCbCr Matrix" header of the ASS scripts, empty if absent
 
 	bool m_fUsingAutoGeneratedDefaultStyle;
 
 	CSTSStyleMap m_styles;
 
+	// the fonts stay registered as long as a script uses them
+	std::vector<CEmbeddedFontSharedPtr> m_embeddedFonts;
+
 	enum EPARCompensationType {
 		EPCTDisabled,
 		EPCTDownscale,
@@ -172,12 +199,22 @@ public:
 
 	void Append(CSimpleTextSubtitle& sts, int timeoff = -1);
 
+	// Replaces the script by sts without calling OnChanged(). entryMap receives for every new entry the index
+	// of the identical old entry or -1, changed the merged [start, end) ranges of the added, removed or modified
+	// entries. Returns false if the script header changed, everything has to be considered as changed then.
+	bool Update(CSimpleTextSubtitle& sts, std::vector<int>& entryMap, std::vector<std::pair<int, int>>& changed);
+
 	bool Open(const CString& fn, UINT codePage, bool bAutoDetectCodePage, CString name, CString videoName);
 	bool Open(CTextFile* f, const CString& name);
 	bool Open(BYTE* data, int len, UINT codePage, CString name);
 	bool SaveAs(CString fn, Subtitle::SubType type, double fps = -1, int delay = 0, UINT e = CP_ASCII, bool bCreateExternalStyleFile = true);
 
 	void Add(CStringW str, int start, int end, CString style = L"Default", CString actor = L"", CString effect = L"", const CRect& marginRect = CRect(0,0,0,0), int layer = 0, int readorder = -1);
+
+	// Streaming mode for endless streams: Add() evicts the entries which ended more than retention ms before
+	// the end of the newest one, the arrays are compacted once the oldest segment is a quarter retention older.
+	void SetRetention(int retention);
+	void GetMemoryStats(STSMemoryStats& stats);
 	STSStyle* CreateDefaultStyle(int CharSet);
 	void ChangeUnknownStylesToDefault();
 	void AddStyle(CString name, STSStyle* style); // style will be stored and freed in Empty() later
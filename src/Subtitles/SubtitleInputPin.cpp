@@ -98,6 +98,8 @@ HRESULT CSubtitleInputPin::CompleteConnect(IPin* pReceivePin)
 {
 	InvalidateSamples();
 
+	bool bStreaming = false;
+
 	if (m_mt.majortype == MEDIATYPE_Text) {
 		if (!(m_pSubStream = DNew CRenderedTextSubtitle(m_pSubLock))) {
 			return E_FAIL;
@@ -106,6 +108,8 @@ HRESULT CSubtitleInputPin::CompleteConnect(IPin* pReceivePin)
 		pRTS->SetName(CString(GetPinName(pReceivePin)) + L" (embeded)");
 		pRTS->m_dstScreenSize = DEFSCREENSIZE;
 		pRTS->CreateDefaultStyle(DEFAULT_CHARSET);
+		pRTS->SetRetention(m_retention);
+		bStreaming = m_retention > 0;
 	} else if (IsHdmvSub(&m_mt)
 			|| m_mt.majortype == MEDIATYPE_Subtitle
 			|| (m_mt.majortype == MEDIATYPE_Video && (m_mt.subtype == MEDIASUBTYPE_DVD_SUBPICTURE || m_mt.subtype == MEDIASUBTYPE_XSUB))) {
@@ -160,6 +164,8 @@ HRESULT CSubtitleInputPin::CompleteConnect(IPin* pReceivePin)
 			pRTS->m_lcid = lcid;
 			pRTS->m_dstScreenSize = DEFSCREENSIZE;
 			pRTS->CreateDefaultStyle(DEFAULT_CHARSET);
+			pRTS->SetRetention(m_retention);
+			bStreaming = m_retention > 0;
 
 			if (dwOffset > 0 && m_mt.cbFormat != dwOffset) {
 				CMediaType mt = m_mt;
@@ -211,6 +217,13 @@ HRESULT CSubtitleInputPin::CompleteConnect(IPin* pReceivePin)
 		}
 	}
 
+	{
+		std::lock_guard<std::mutex> lock(m_mutexQueue);
+		m_bStreaming = bStreaming;
+		m_memoryStats = {};
+		m_decodeStats = {};
+	}
+
 	AddSubStream(m_pSubStream);
 
 	return __super::CompleteConnect(pReceivePin);
@@ -223,6 +236,11 @@ HRESULT CSubtitleInputPin::BreakConnect()
 	RemoveSubStream(m_pSubStream);
 	m_pSubStream = NULL;
 
+	{
+		std::lock_guard<std::mutex> lock(m_mutexQueue);
+		m_bStreaming = false;
+	}
+
 	ASSERT(IsStopped());
 
 	return __super::BreakConnect();
@@ -338,9 +356,27 @@ STDMETHODIMP CSubtitleInputPin::Receive(IMediaSample* pSample)
 			return hr;
 		}
 
+		std::unique_ptr<SubtitleSample> pSubtitleSample;
+		{
+			std::lock_guard<std::mutex> lock(m_mutexQueue);
+			if (!m_samplePool.empty()) {
+				pSubtitleSample = std::move(m_samplePool.back());
+				m_samplePool.pop_back();
+			}
+		}
+		if (!pSubtitleSample) {
+			pSubtitleSample.reset(DNew SubtitleSample);
+		}
+
+		pSubtitleSample->rtStart = tStart;
+		pSubtitleSample->rtStop = tStop;
+		pSubtitleSample->data.assign(pData, pData + len);
+		pSubtitleSample->received = std::chrono::steady_clock::now();
+
 		{
 			std::unique_lock<std::mutex> lock(m_mutexQueue);
-			m_sampleQueue.emplace_back(DNew SubtitleSample(tStart, tStop, pData, (size_t)len));
+			m_sampleQueue.emplace_back(std::move(pSubtitleSample));
+			m_decodeStats.maxQueueDepth = std::max(m_decodeStats.maxQueueDepth, m_sampleQueue.size());
 			lock.unlock();
 			m_condQueueReady.notify_one();
 		}
@@ -353,6 +389,10 @@ void  CSubtitleInputPin::DecodeSamples()
 {
 	SetThreadName((DWORD)-1, "Subtitle Input Pin Thread");
 
+	// the pending invalidation, sent once the window is elapsed
+	REFERENCE_TIME rtInvalidate = -1;
+	std::chrono::steady_clock::time_point invalidateTime;
+
 	while(!m_bExitDecodingThread) {
 		std::unique_lock<std::mutex> lock(m_mutexQueue);
 
@@ -364,23 +404,40 @@ void  CSubtitleInputPin::DecodeSamples()
 			return !m_sampleQueue.empty() || needStopProcessing();
 		};
 
-		m_condQueueReady.wait(lock, isQueueReady);
+		bool bQueueReady = true;
+		if (rtInvalidate >= 0) {
+			bQueueReady = m_condQueueReady.wait_until(lock, invalidateTime, isQueueReady);
+		} else {
+			m_condQueueReady.wait(lock, isQueueReady);
+		}
 		lock.unlock(); // Release this lock until we can acquire the other one
 
-		REFERENCE_TIME rtInvalidate = -1;
-
-		if (!needStopProcessing()) {
+		if (bQueueReady && !needStopProcessing()) {
 			CAutoLock cAutoLock(m_pSubLock);
 			lock.lock(); // Reacquire the lock
 
 			while (!m_sampleQueue.empty() && !needStopProcessing()) {
-				const auto& pSample = m_sampleQueue.front();
+				auto& pSample = m_sampleQueue.front();
 
 				if (pSample) {
 					const REFERENCE_TIME rtSampleInvalidate = DecodeSample(pSample);
 					if (rtSampleInvalidate >= 0 && (rtSampleInvalidate < rtInvalidate || rtInvalidate < 0)) {
+						if (rtInvalidate < 0) {
+							invalidateTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_invalidateWindow);
+						}
 						rtInvalidate = rtSampleInvalidate;
 					}
+
+					const double latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pSample->received).count();
+					m_decodeStats.decoded++;
+					m_decodeStats.lastLatency = latency;
+					m_decodeStats.avgLatency += (latency - m_decodeStats.avgLatency) / m_decodeStats.decoded;
+					m_decodeStats.maxLatency = std::max(m_decodeStats.maxLatency, latency);
+
+					// huge samples are not worth keeping
+					if (m_samplePool.size() < 16 && pSample->data.capacity() <= 1024 * 1024) {
+						m_samplePool.emplace_back(std::move(pSample));
+					}
 				} else { // marker for end of stream
 					if (IsHdmvSub(&m_mt)) {
 						CRenderedHdmvSubtitle* pHdmvSubtitle = (CRenderedHdmvSubtitle*)m_pSubStream.p;
@@ -390,14 +447,23 @@ void  CSubtitleInputPin::DecodeSamples()
 
 				m_sampleQueue.pop_front();
 			}
+
+			if (m_bStreaming && rtInvalidate >= 0) {
+				CRenderedTextSubtitle* pRTS = (CRenderedTextSubtitle*)m_pSubStream.p;
+				pRTS->GetMemoryStats(m_memoryStats);
+			}
+
+			// the filter locks its queue before reading the stats
+			lock.unlock();
 		}
 
-		if (rtInvalidate >= 0) {
+		if (rtInvalidate >= 0 && std::chrono::steady_clock::now() >= invalidateTime) {
 #if (FALSE)
 			DLog(L"InvalidateSubtitle() : %I64d", rtInvalidate);
 #endif
 			// IMPORTANT: m_pSubLock must not be locked when calling this
 			InvalidateSubtitle(rtInvalidate, m_pSubStream);
+			rtInvalidate = -1;
 		}
 	}
 }
@@ -539,6 +605,24 @@ REFERENCE_TIME CSubtitleInputPin::DecodeSample(const std::unique_ptr<SubtitleSam
 	return bInvalidate ? tStart : -1;
 }
 
+bool CSubtitleInputPin::GetMemoryStats(STSMemoryStats& stats)
+{
+	std::lock_guard<std::mutex> lock(m_mutexQueue);
+
+	stats = m_memoryStats;
+
+	return m_bStreaming;
+}
+
+void CSubtitleInputPin::GetDecodeStats(SubtitleDecodeStats& stats)
+{
+	std::lock_guard<std::mutex> lock(m_mutexQueue);
+
+	stats = m_decodeStats;
+	stats.queueDepth = m_sampleQueue.size();
+	stats.pooled = m_samplePool.size();
+}
+
 void CSubtitleInputPin::InvalidateSamples()
 {
 	m_bStopDecoding = true;
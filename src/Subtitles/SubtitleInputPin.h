@@ -23,8 +23,19 @@
 
 #include <thread>
 #include <condition_variable>
+#include <chrono>
+#include <deque>
 
 #include "SubPic/ISubPic.h"
+#include "STS.h"
+
+// Decoding queue of a subtitle input pin
+struct SubtitleDecodeStats {
+	size_t queueDepth = 0, maxQueueDepth = 0;
+	size_t pooled = 0;
+	size_t decoded = 0;
+	double lastLatency = 0.0, avgLatency = 0.0, maxLatency = 0.0; // ms between Receive() and the end of the decoding
+};
 
 //
 // CSubtitleInputPin
@@ -38,22 +49,27 @@ class CSubtitleInputPin : public CBaseInputPin
 	CComPtr<ISubStream> m_pSubStream;
 
 	struct SubtitleSample {
-		REFERENCE_TIME rtStart, rtStop;
+		REFERENCE_TIME rtStart = 0, rtStop = 0;
 		std::vector<BYTE> data;
-
-		SubtitleSample(REFERENCE_TIME rtStart, REFERENCE_TIME rtStop, BYTE* pData, size_t len)
-			: rtStart(rtStart)
-			, rtStop(rtStop)
-			, data(pData, pData + len) {}
+		std::chrono::steady_clock::time_point received;
 	};
 
-	std::list<std::unique_ptr<SubtitleSample>> m_sampleQueue;
+	std::deque<std::unique_ptr<SubtitleSample>> m_sampleQueue;
+	// the decoded samples are reused, their buffers keep their capacity
+	std::vector<std::unique_ptr<SubtitleSample>> m_samplePool;
 
 	bool m_bExitDecodingThread, m_bStopDecoding;
 	std::thread m_decodeThread;
-	std::mutex m_mutexQueue; // to protect m_sampleQueue
+	std::mutex m_mutexQueue; // to protect m_sampleQueue, m_samplePool and the stats
 	std::condition_variable m_condQueueReady;
 
+	int m_retention = 0;
+	bool m_bStreaming = false;
+	STSMemoryStats m_memoryStats;
+
+	int m_invalidateWindow = 0;
+	SubtitleDecodeStats m_decodeStats;
+
 	void DecodeSamples();
 	REFERENCE_TIME DecodeSample(const std::unique_ptr<SubtitleSample>& pSample);
 	void InvalidateSamples();
@@ -76,4 +92,13 @@ public:
 	STDMETHODIMP EndOfStream();
 
 	ISubStream* GetSubStream() { return m_pSubStream; }
+
+	// the text streams connected afterwards only keep the last retention ms, 0 keeps everything
+	void SetRetention(int retention) { m_retention = retention; }
+	// returns false if the stream is not a text stream with a retention
+	bool GetMemoryStats(STSMemoryStats& stats);
+
+	// the invalidations of the samples decoded within window ms are merged, 0 invalidates after every batch
+	void SetInvalidateWindow(int window) { m_invalidateWindow = window; }
+	void GetDecodeStats(SubtitleDecodeStats& stats);
 };
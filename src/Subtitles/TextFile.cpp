@@ -21,8 +21,10 @@
 
 #include "stdafx.h"
 #include <afxinet.h>
+#include <tmmintrin.h>
 #include "TextFile.h"
 #include <Utf8.h>
+#include "DSUtil/CPUInfo.h"
 #include "DSUtil/FileHandle.h"
 #include "DSUtil/HTTPAsync.h"
 
@@ -49,6 +51,215 @@ const static struct {
 };
 
 #define TEXTFILE_BUFFER_SIZE (64 * 1024)
+#define TEXTFILE_DETECT_SIZE (64 * 1024)        // compact_enc_det only looks at the beginning of the file
+#define TEXTFILE_MEMORY_SIZE (512 * 1024 * 1024) // larger files are decoded line by line
+
+// Returns the code page detected by compact_enc_det or 0 if it is not one of the supported encodings.
+static UINT DetectCodePage(const char* buf, int len)
+{
+	bool is_reliable;
+	int bytes_consumed;
+	auto encoding = CompactEncDet::DetectEncoding(
+		buf, len,
+		nullptr, nullptr, nullptr,
+		UNKNOWN_ENCODING,
+		UNKNOWN_LANGUAGE,
+		CompactEncDet::QUERY_CORPUS,
+		false,
+		&bytes_consumed,
+		&is_reliable);
+	switch (encoding) {
+		// TODO - Add more encodings to the list.
+		case MSFT_CP1250:        return 1250;
+		case RUSSIAN_CP1251:     return 1251;
+		case RUSSIAN_KOI8_R:     return 21866;
+		case RUSSIAN_CP866:      return 866;
+		case MSFT_CP1252:        return 1252;
+		case MSFT_CP1253:        return 1253;
+		case MSFT_CP1254:        return 1254;
+		case MSFT_CP1255:        return 1255;
+		case MSFT_CP1256:        return 1256;
+		case MSFT_CP1257:        return 1257;
+		case MSFT_CP874:         return 874;
+		case JAPANESE_CP932:     return 932;
+		case CHINESE_GB:         return 936;
+		case KOREAN_EUC_KR:      return 949;
+		case CHINESE_BIG5:       return 950;
+		case GB18030:            return 54936;
+		case JAPANESE_SHIFT_JIS: return 932;
+	}
+
+	return 0;
+}
+
+// Strict UTF-8 validation: overlong forms, surrogates and code points above U+10FFFF are rejected.
+
+static bool IsValidUTF8_C(const uint8_t* p, size_t len)
+{
+	const uint8_t* end = p + len;
+
+	while (p < end) {
+		// skip ASCII 16 bytes at a time
+		while (end - p >= 16 && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p))) {
+			p += 16;
+		}
+		if (p == end) {
+			break;
+		}
+
+		const uint8_t c = *p;
+		if (c < 0x80) {
+			p++;
+			continue;
+		}
+
+		int n;
+		uint8_t lo = 0x80, hi = 0xBF; // range of the second byte
+		if (c >= 0xC2 && c <= 0xDF) {
+			n = 1;
+		} else if (c >= 0xE0 && c <= 0xEF) {
+			n = 2;
+			if (c == 0xE0) {
+				lo = 0xA0;
+			} else if (c == 0xED) {
+				hi = 0x9F;
+			}
+		} else if (c >= 0xF0 && c <= 0xF4) {
+			n = 3;
+			if (c == 0xF0) {
+				lo = 0x90;
+			} else if (c == 0xF4) {
+				hi = 0x8F;
+			}
+		} else {
+			return false;
+		}
+
+		if (end - p <= n || p[1] < lo || p[1] > hi) {
+			return false;
+		}
+		for (int i = 2; i <= n; i++) {
+			if (!Utf8::isContinuation(p[i])) {
+				return false;
+			}
+		}
+		p += n + 1;
+	}
+
+	return true;
+}
+
+// Lookup table validator of Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction
+// Per Byte": the high and low nibbles of a byte and the high nibble of the next one index three
+// tables of error bits, the errors of a pair are the bits common to the three lookups.
+
+static bool IsValidUTF8_SSSE3(const uint8_t* p, size_t len)
+{
+	enum : uint8_t {
+		TOO_SHORT  = 1 << 0, // 11______ 0_______ or 11______ 11______
+		TOO_LONG   = 1 << 1, // 0_______ 10______
+		OVERLONG_3 = 1 << 2, // 11100000 100_____
+		TOO_LARGE  = 1 << 3, // 11110100 1001____, 11110100 101_____, 11110101+ 10______
+		SURROGATE  = 1 << 4, // 11101101 101_____
+		OVERLONG_2 = 1 << 5, // 1100000_ 10______
+		TOO_LARGE_1000 = 1 << 6, // 11110100 1000____, 11110101+ 1000____
+		OVERLONG_4 = 1 << 6, // 11110000 1000____
+		TWO_CONTS  = 1 << 7, // 10______ 10______
+		CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS,
+	};
+
+	const __m128i byte_1_high_tbl = _mm_setr_epi8(
+		TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+		(char)TWO_CONTS, (char)TWO_CONTS, (char)TWO_CONTS, (char)TWO_CONTS,
+		TOO_SHORT | OVERLONG_2,
+		TOO_SHORT,
+		TOO_SHORT | OVERLONG_3 | SURROGATE,
+		TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+	const __m128i byte_1_low_tbl = _mm_setr_epi8(
+		(char)(CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4),
+		(char)(CARRY | OVERLONG_2),
+		(char)CARRY,
+		(char)CARRY,
+		(char)(CARRY | TOO_LARGE),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000),
+		(char)(CARRY | TOO_LARGE | TOO_LARGE_1000));
+	const __m128i byte_2_high_tbl = _mm_setr_epi8(
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+		(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4),
+		(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE),
+		(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE),
+		(char)(TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE),
+		TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+	// the last 3 bytes of a block must not start a sequence longer than what is left
+	const __m128i max_value = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		(char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+	const __m128i mask_0f = _mm_set1_epi8(0x0F);
+
+	__m128i error = _mm_setzero_si128();
+	__m128i prev_input = _mm_setzero_si128();
+	__m128i prev_incomplete = _mm_setzero_si128();
+
+	auto check_block = [&](const __m128i input) {
+		if (!_mm_movemask_epi8(input)) {
+			// an ASCII block is valid unless the previous one ended in the middle of a sequence
+			error = _mm_or_si128(error, prev_incomplete);
+			return;
+		}
+
+		const __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+		const __m128i byte_1_high = _mm_shuffle_epi8(byte_1_high_tbl, _mm_and_si128(_mm_srli_epi16(prev1, 4), mask_0f));
+		const __m128i byte_1_low  = _mm_shuffle_epi8(byte_1_low_tbl, _mm_and_si128(prev1, mask_0f));
+		const __m128i byte_2_high = _mm_shuffle_epi8(byte_2_high_tbl, _mm_and_si128(_mm_srli_epi16(input, 4), mask_0f));
+		const __m128i special_cases = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+		// the 3rd and 4th bytes of a sequence must be continuations, the tables flagged TWO_CONTS
+		const __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+		const __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+		const __m128i is_third_byte  = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80)));
+		const __m128i is_fourth_byte = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80)));
+		const __m128i must23_80 = _mm_and_si128(_mm_or_si128(is_third_byte, is_fourth_byte), _mm_set1_epi8((char)0x80));
+		error = _mm_or_si128(error, _mm_xor_si128(must23_80, special_cases));
+
+		prev_incomplete = _mm_subs_epu8(input, max_value);
+		prev_input = input;
+	};
+
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		check_block(_mm_loadu_si128((const __m128i*)(p + i)));
+		if ((i & 0xfff) == 0 && _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) != 0xffff) {
+			return false;
+		}
+	}
+	if (i < len) {
+		// the padding is ASCII and catches a sequence truncated by the end of the file
+		alignas(16) uint8_t tail[16] = {};
+		memcpy(tail, p + i, len - i);
+		check_block(_mm_load_si128((const __m128i*)tail));
+	}
+	error = _mm_or_si128(error, prev_incomplete);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xffff;
+}
+
+static bool IsValidUTF8(const char* buf, size_t len)
+{
+	static const bool bUseSSSE3 = CPUInfo::HaveSSSE3();
+
+	return bUseSSSE3
+		? IsValidUTF8_SSSE3((const uint8_t*)buf, len)
+		: IsValidUTF8_C((const uint8_t*)buf, len);
+}
 
 CTextFile::CTextFile(UINT encoding/* = ASCII*/, UINT defaultencoding/* = ASCII*/, bool bAutoDetectCodePage/* = false*/)
 	: m_encoding(encoding)
@@ -113,37 +324,15 @@ bool CTextFile::Open(LPCWSTR lpszFileName)
 		}
 	}
 
-	if (!m_offset && m_bAutoDetectCodePage && FillBuffer()) {
-		bool is_reliable;
-		int bytes_consumed;
-		auto encoding = CompactEncDet::DetectEncoding(
-			m_buffer.get(), m_nInBuffer,
-			nullptr, nullptr, nullptr,
-			UNKNOWN_ENCODING,
-			UNKNOWN_LANGUAGE,
-			CompactEncDet::QUERY_CORPUS,
-			false,
-			&bytes_consumed,
-			&is_reliable);
-		switch (encoding) {
-			// TODO - Add more encodings to the list.
-			case MSFT_CP1250:        m_encoding = 1250;  break;
-			case RUSSIAN_CP1251:     m_encoding = 1251;  break;
-			case RUSSIAN_KOI8_R:     m_encoding = 21866; break;
-			case RUSSIAN_CP866:      m_encoding = 866;   break;
-			case MSFT_CP1252:        m_encoding = 1252;  break;
-			case MSFT_CP1253:        m_encoding = 1253;  break;
-			case MSFT_CP1254:        m_encoding = 1254;  break;
-			case MSFT_CP1255:        m_encoding = 1255;  break;
-			case MSFT_CP1256:        m_encoding = 1256;  break;
-			case MSFT_CP1257:        m_encoding = 1257;  break;
-			case MSFT_CP874:         m_encoding = 874;   break;
-			case JAPANESE_CP932:     m_encoding = 932;   break;
-			case CHINESE_GB:         m_encoding = 936;   break;
-			case KOREAN_EUC_KR:      m_encoding = 949;   break;
-			case CHINESE_BIG5:       m_encoding = 950;   break;
-			case GB18030:            m_encoding = 54936; break;
-			case JAPANESE_SHIFT_JIS: m_encoding = 932;   break;
+	if (!m_offset && m_bAutoDetectCodePage) {
+		if (m_pStdioFile->GetLength() <= TEXTFILE_MEMORY_SIZE) {
+			if (LoadText()) {
+				return true;
+			}
+		} else if (FillBuffer()) {
+			if (UINT codepage = DetectCodePage(m_buffer.get(), (int)m_nInBuffer)) {
+				m_encoding = codepage;
+			}
 		}
 	}
 
@@ -159,6 +348,57 @@ bool CTextFile::Open(LPCWSTR lpszFileName)
 	return true;
 }
 
+bool CTextFile::LoadText()
+{
+	const UINT len = (UINT)m_pStdioFile->GetLength();
+	if (!len) {
+		return false;
+	}
+
+	std::unique_ptr<char[]> data(new(std::nothrow) char[len]);
+	if (!data) {
+		return false;
+	}
+
+	m_pStdioFile->SeekToBegin();
+	if (m_pStdioFile->Read(data.get(), len) != len) {
+		return false;
+	}
+
+	// Most scripts are UTF-8, in which case validating the whole file is much cheaper than
+	// running the detection. The detection only needs the beginning of the file.
+	UINT codepage = CP_UTF8;
+	if (!IsValidUTF8(data.get(), len)) {
+		codepage = DetectCodePage(data.get(), std::min(len, (UINT)TEXTFILE_DETECT_SIZE));
+		if (!codepage) {
+			// keep decoding line by line, invalid UTF-8 lines fall back to the default encoding
+			return false;
+		}
+	}
+
+	// a character never takes more UTF-16 code units than bytes
+	std::unique_ptr<WCHAR[]> text(new(std::nothrow) WCHAR[len]);
+	if (!text) {
+		return false;
+	}
+
+	int nChars = MultiByteToWideChar(codepage, 0, data.get(), len, text.get(), len);
+	if (nChars <= 0) {
+		return false;
+	}
+	data.reset();
+
+	// ReadString skips \r everywhere, not only at the end of the lines
+	nChars = int(std::remove(text.get(), text.get() + nChars, L'\r') - text.get());
+
+	m_encoding = codepage;
+	m_text = std::move(text);
+	m_nText = nChars;
+	m_posInText = 0;
+
+	return true;
+}
+
 bool CTextFile::ReopenAsText()
 {
 	auto fileName = m_strFileName;
@@ -204,6 +444,9 @@ void CTextFile::Close()
 		m_pFile.reset();
 		m_strFileName.Empty();
 	}
+
+	m_text.reset();
+	m_nText = m_posInText = 0;
 }
 
 UINT CTextFile::GetEncoding() const
@@ -225,11 +468,19 @@ CStringW CTextFile::GetFilePath() const
 
 ULONGLONG CTextFile::GetPosition() const
 {
+	if (m_text) {
+		return m_posInText;
+	}
+
 	return m_pStdioFile ? (m_pStdioFile->GetPosition() - m_offset - (m_nInBuffer - m_posInBuffer)) : 0ULL;
 }
 
 ULONGLONG CTextFile::GetLength() const
 {
+	if (m_text) {
+		return m_nText;
+	}
+
 	return m_pStdioFile ? (m_pStdioFile->GetLength() - m_offset) : 0ULL;
 }
 
@@ -239,6 +490,24 @@ ULONGLONG CTextFile::Seek(LONGLONG lOff, UINT nFrom)
 		return 0ULL;
 	}
 
+	if (m_text) {
+		switch (nFrom) {
+			default:
+			case CStdioFile::begin:
+				break;
+			case CStdioFile::current:
+				lOff = (LONGLONG)m_posInText + lOff;
+				break;
+			case CStdioFile::end:
+				lOff = (LONGLONG)m_nText - lOff;
+				break;
+		}
+
+		m_posInText = (size_t)std::clamp(lOff, 0LL, (LONGLONG)m_nText);
+
+		return m_posInText;
+	}
+
 	ULONGLONG newPos;
 
 	// Try to reuse the buffer if any
@@ -378,6 +647,23 @@ bool CTextFile::ReadString(CStringW& str)
 		return false;
 	}
 
+	if (m_text) {
+		if (m_posInText >= m_nText) {
+			str.Truncate(0);
+			return false;
+		}
+
+		const WCHAR* line = &m_text[m_posInText];
+		const size_t left = m_nText - m_posInText;
+		const WCHAR* eol = wmemchr(line, L'\n', left);
+		const size_t len = eol ? size_t(eol - line) : left;
+
+		str.SetString(line, (int)len);
+		m_posInText += eol ? len + 1 : len;
+
+		return true;
+	}
+
 	bool fEOF = true;
 
 	str.Truncate(0);
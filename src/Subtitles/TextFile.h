@@ -53,6 +53,11 @@ private:
 	LONGLONG m_posInBuffer = 0;
 	LONGLONG m_nInBuffer = 0;
 
+	// Text decoded at once by Open(), the positions are then in characters
+	std::unique_ptr<WCHAR[]> m_text;
+	size_t m_nText = 0;
+	size_t m_posInText = 0;
+
 	std::unique_ptr<FILE, std::integral_constant<decltype(&fclose), &fclose>> m_pFile;
 	std::unique_ptr<CStdioFile> m_pStdioFile;
 	CStringW m_strFileName;
@@ -84,6 +89,7 @@ public:
 
 protected:
 	bool ReopenAsText();
+	bool LoadText();
 	bool FillBuffer();
 	ULONGLONG GetPositionFastBuffered() const;
 };
@@ -21,6 +21,7 @@
 
 #include "stdafx.h"
 #include <winioctl.h>
+#include <emmintrin.h>
 #include "TextFile.h"
 #include "unrar.h"
 #include "VobSubFile.h"
@@ -262,9 +263,10 @@ bool CVobSubFile::Copy(CVobSubFile& vsf)
 		dst.id = src.id;
 		dst.name = src.name;
 		dst.alt = src.alt;
+		dst.packets = src.packets;
 
 		for (size_t j = 0; j < src.subpos.size(); j++) {
-			SubPos& sp = src.subpos[j];
+			SubPos sp = src.subpos[j];
 			if (!sp.bValid) {
 				continue;
 			}
@@ -343,6 +345,8 @@ bool CVobSubFile::Open(CString fn)
 
 		m_title = fn;
 
+		IndexPackets();
+
 		for (int i = 0; i < (int)std::size(m_langs); i++) {
 			std::vector<SubPos>& sp = m_langs[i].subpos;
 
@@ -351,7 +355,7 @@ bool CVobSubFile::Open(CString fn)
 				sp[j].bForced = false;
 
 				int packetsize = 0, datasize = 0;
-				BYTE* buff = GetPacket(j, packetsize, datasize, i);
+				const BYTE* buff = GetPacket(j, packetsize, datasize, i);
 				if (!buff) {
 					sp[j].bValid = false;
 					continue;
@@ -370,8 +374,6 @@ bool CVobSubFile::Open(CString fn)
 				if (j > 0 && sp[j-1].stop > sp[j].start) {
 					sp[j-1].stop = sp[j].start;
 				}
-
-				delete [] buff;
 			}
 		}
 
@@ -420,6 +422,7 @@ void CVobSubFile::Close()
 		sl.name.Empty();
 		sl.alt.Empty();
 		sl.subpos.clear();
+		sl.packets.reset();
 	}
 }
 
@@ -1109,68 +1112,93 @@ bool CVobSubFile::WriteSub(CString fn)
 
 //
 
-BYTE* CVobSubFile::GetPacket(size_t idx, int& packetsize, int& datasize, int nLang)
+bool CVobSubFile::ReadPacket(__int64 filepos, int nLang, std::vector<BYTE>& packets, int& packetsize, int& datasize)
 {
-	BYTE* ret = nullptr;
+	if ((__int64)m_sub.Seek(filepos, CFile::begin) != filepos) {
+		return false;
+	}
 
-	if (nLang < 0 || nLang >= (int)std::size(m_langs)) {
-		nLang = m_nLang;
+	BYTE buff[0x800];
+	if (sizeof(buff) != m_sub.Read(buff, sizeof(buff))) {
+		return false;
 	}
-	std::vector<SubPos>& sp = m_langs[nLang].subpos;
 
-	do {
-		if (idx >= sp.size()) {
-			break;
-		}
+	// let's check a few things to make sure...
+	if (GETU32(&buff[0x00]) != 0xba010000
+			|| GETU32(&buff[0x0e]) != 0xbd010000
+			|| !(buff[0x15] & 0x80)
+			|| (buff[0x17] & 0xf0) != 0x20
+			|| (buff[buff[0x16] + 0x17] & 0xe0) != 0x20
+			|| (buff[buff[0x16] + 0x17] & 0x1f) != nLang) {
+		return false;
+	}
 
-		if ((__int64)m_sub.Seek(sp[idx].filepos, CFile::begin) != sp[idx].filepos) {
-			break;
-		}
+	packetsize = (buff[buff[0x16] + 0x18] << 8) + buff[buff[0x16] + 0x19];
+	datasize = (buff[buff[0x16] + 0x1a] << 8) + buff[buff[0x16] + 0x1b];
 
-		BYTE buff[0x800];
-		if (sizeof(buff) != m_sub.Read(buff, sizeof(buff))) {
-			break;
-		}
+	const size_t offset = packets.size();
+	packets.resize(offset + packetsize);
+	BYTE* ret = &packets[offset];
 
-		// let's check a few things to make sure...
-		if (GETU32(&buff[0x00]) != 0xba010000
-				|| GETU32(&buff[0x0e]) != 0xbd010000
-				|| !(buff[0x15] & 0x80)
-				|| (buff[0x17] & 0xf0) != 0x20
-				|| (buff[buff[0x16] + 0x17] & 0xe0) != 0x20
-				|| (buff[buff[0x16] + 0x17] & 0x1f) != nLang) {
-			break;
+	int i = 0, sizeleft = packetsize;
+	for (int size; i < packetsize; i += size, sizeleft -= size) {
+		int hsize = 0x18 + buff[0x16];
+		size = std::min(sizeleft, 0x800 - hsize);
+		memcpy(&ret[i], &buff[hsize], size);
+
+		if (size != sizeleft) {
+			while (m_sub.Read(buff, sizeof(buff))) {
+				if (/*!(buff[0x15] & 0x80) &&*/ buff[buff[0x16] + 0x17] == (nLang|0x20)) {
+					break;
+				}
+			}
 		}
+	}
 
-		packetsize = (buff[buff[0x16] + 0x18] << 8) + buff[buff[0x16] + 0x19];
-		datasize = (buff[buff[0x16] + 0x1a] << 8) + buff[buff[0x16] + 0x1b];
+	if (i != packetsize || sizeleft > 0) {
+		packets.resize(offset);
+		return false;
+	}
 
-		ret = DNew BYTE[packetsize];
-		if (!ret) {
-			break;
-		}
+	return true;
+}
 
-		int i = 0, sizeleft = packetsize;
-		for (int size; i < packetsize; i += size, sizeleft -= size) {
-			int hsize = 0x18 + buff[0x16];
-			size = std::min(sizeleft, 0x800 - hsize);
-			memcpy(&ret[i], &buff[hsize], size);
+// Collects the continuation sectors of every subpicture once, so that
+// fetching a packet later is a plain lookup without seeking and scanning.
+void CVobSubFile::IndexPackets()
+{
+	for (int i = 0; i < (int)std::size(m_langs); i++) {
+		SubLang& sl = m_langs[i];
 
-			if (size != sizeleft) {
-				while (m_sub.Read(buff, sizeof(buff))) {
-					if (/*!(buff[0x15] & 0x80) &&*/ buff[buff[0x16] + 0x17] == (nLang|0x20)) {
-						break;
-					}
-				}
+		auto packets = std::make_shared<std::vector<BYTE>>();
+		for (auto& sp : sl.subpos) {
+			sp.packetoffset = packets->size();
+			if (!ReadPacket(sp.filepos, i, *packets, sp.packetsize, sp.datasize)) {
+				sp.packetsize = sp.datasize = 0;
 			}
 		}
+		packets->shrink_to_fit();
 
-		if (i != packetsize || sizeleft > 0) {
-			SAFE_DELETE_ARRAY(ret);
-		}
-	} while (false);
+		sl.packets = std::move(packets);
+	}
+}
 
-	return ret;
+const BYTE* CVobSubFile::GetPacket(size_t idx, int& packetsize, int& datasize, int nLang) const
+{
+	if (nLang < 0 || nLang >= (int)std::size(m_langs)) {
+		nLang = m_nLang;
+	}
+	const SubLang& sl = m_langs[nLang];
+
+	if (idx >= sl.subpos.size() || !sl.packets || sl.subpos[idx].packetsize <= 0) {
+		return nullptr;
+	}
+
+	const SubPos& sp = sl.subpos[idx];
+	packetsize = sp.packetsize;
+	datasize = sp.datasize;
+
+	return sl.packets->data() + sp.packetoffset;
 }
 
 const CVobSubFile::SubPos* CVobSubFile::GetFrameInfo(size_t idx, int iLang /*= -1*/) const
@@ -1203,14 +1231,14 @@ bool CVobSubFile::GetFrame(size_t idx, int iLang /*= -1*/, REFERENCE_TIME rt /*=
 	if (m_img.nLang != iLang || m_img.nIdx != idx
 			|| (sp[idx].bAnimated && sp[idx].start + m_img.tCurrent <= rt)) {
 		int packetsize = 0, datasize = 0;
-		std::unique_ptr<BYTE[]> buff(GetPacket(idx, packetsize, datasize, iLang));
+		const BYTE* buff = GetPacket(idx, packetsize, datasize, iLang);
 		if (!buff || packetsize <= 0 || datasize <= 0) {
 			return false;
 		}
 
 		m_img.start = sp[idx].start;
 
-		bool ret = m_img.Decode(buff.get(), packetsize, datasize, rt >= 0 ? int(rt - sp[idx].start) : INT_MAX,
+		bool ret = m_img.Decode(buff, packetsize, datasize, rt >= 0 ? int(rt - sp[idx].start) : INT_MAX,
 								m_bCustomPal, m_tridx, m_orgpal, m_cuspal, true);
 
 		m_img.delay = sp[idx].stop - sp[idx].start;
@@ -1452,108 +1480,96 @@ STDMETHODIMP CVobSubFile::Reload()
 	return !m_title.IsEmpty() && Open(m_title) ? S_OK : E_FAIL;
 }
 
-// StretchBlt
+// CVobSubScaledImage
 
-static void PixelAtBiLinear(RGBQUAD& c, int x, int y, CVobSubImage& src)
+static void PremultiplyAlpha(DWORD* dst, const DWORD* src, size_t count)
 {
-	int w = src.rect.Width(),
-		h = src.rect.Height();
+	const __m128i zero      = _mm_setzero_si128();
+	const __m128i rounding  = _mm_set1_epi16(128);
+	const __m128i alphaMask = _mm_set1_epi32(0xFF000000);
 
-	int x1 = (x >> 16),
-		y1 = (y >> 16) * w,
-		x2 = std::min(x1 + 1, w - 1),
-		y2 = std::min(y1 + w, (h - 1) * w);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m128i p = _mm_loadu_si128((const __m128i*)&src[i]);
+		__m128i lo = _mm_unpacklo_epi8(p, zero);
+		__m128i hi = _mm_unpackhi_epi8(p, zero);
+		const __m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+		const __m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
 
-	RGBQUAD* ptr = src.lpPixels;
+		// x * a / 255 with rounding
+		lo = _mm_add_epi16(_mm_mullo_epi16(lo, alo), rounding);
+		hi = _mm_add_epi16(_mm_mullo_epi16(hi, ahi), rounding);
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
 
-	RGBQUAD c11 = ptr[y1 + x1],	c12 = ptr[y1 + x2],
-			c21 = ptr[y2 + x1],	c22 = ptr[y2 + x2];
-
-	__int64 u2 = x & 0xffff,
-			v2 = y & 0xffff,
-			u1 = 0x10000 - u2,
-			v1 = 0x10000 - v2;
-
-	int v1u1 = int(v1*u1 >> 16) * c11.rgbReserved,
-		v1u2 = int(v1*u2 >> 16) * c12.rgbReserved,
-		v2u1 = int(v2*u1 >> 16) * c21.rgbReserved,
-		v2u2 = int(v2*u2 >> 16) * c22.rgbReserved;
-
-	c.rgbRed = (c11.rgbRed * v1u1 + c12.rgbRed * v1u2
-				+ c21.rgbRed * v2u1 + c22.rgbRed * v2u2) >> 24;
-	c.rgbGreen = (c11.rgbGreen * v1u1 + c12.rgbGreen * v1u2
-				  + c21.rgbGreen * v2u1 + c22.rgbGreen * v2u2) >> 24;
-	c.rgbBlue = (c11.rgbBlue * v1u1 + c12.rgbBlue * v1u2
-				 + c21.rgbBlue * v2u1 + c22.rgbBlue * v2u2) >> 24;
-	c.rgbReserved = (v1u1 + v1u2
-					 + v2u1 + v2u2) >> 16;
-}
-
-static void StretchBlt(SubPicDesc& spd, CRect dstrect, CVobSubImage& src)
-{
-	if (dstrect.IsRectEmpty()) {
-		return;
+		const __m128i rgb = _mm_andnot_si128(alphaMask, _mm_packus_epi16(lo, hi));
+		_mm_storeu_si128((__m128i*)&dst[i], _mm_or_si128(rgb, _mm_and_si128(p, alphaMask)));
 	}
 
-	if ((dstrect & CRect(0, 0, spd.w, spd.h)).IsRectEmpty()) {
-		return;
+	for (; i < count; i++) {
+		const DWORD a = src[i] >> 24;
+		DWORD ret = src[i] & 0xFF000000;
+		for (int shift = 0; shift < 24; shift += 8) {
+			const DWORD x = ((src[i] >> shift) & 0xff) * a + 128;
+			ret |= ((x + (x >> 8)) >> 8) << shift;
+		}
+		dst[i] = ret;
 	}
+}
 
-	int sw = src.rect.Width(),
-		sh = src.rect.Height(),
-		dw = dstrect.Width(),
-		dh = dstrect.Height();
-
-	int srcx = 0,
-		srcy = 0,
-		srcdx = (sw << 16) / dw >> 1,
-		srcdy = (sh << 16) / dh >> 1;
+static void InvertAlpha(DWORD* p, size_t count)
+{
+	const __m128i alphaMask = _mm_set1_epi32(0xFF000000);
 
-	if (dstrect.left < 0) {
-		srcx = -dstrect.left * (srcdx << 1);
-		dstrect.left = 0;
-	}
-	if (dstrect.top < 0) {
-		srcy = -dstrect.top * (srcdy << 1);
-		dstrect.top = 0;
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_si128((__m128i*)&p[i], _mm_xor_si128(_mm_loadu_si128((const __m128i*)&p[i]), alphaMask));
 	}
-	if (dstrect.right > spd.w) {
-		dstrect.right = spd.w;
-	}
-	if (dstrect.bottom > spd.h) {
-		dstrect.bottom = spd.h;
+	for (; i < count; i++) {
+		p[i] ^= 0xFF000000;
 	}
+}
+
+void CVobSubScaledImage::Draw(SubPicDesc& spd, const CRect& dstrect, const CVobSubImage& src)
+{
+	const CRect visible = dstrect & CRect(0, 0, spd.w, spd.h);
+	const int sw = src.rect.Width(),
+			  sh = src.rect.Height(),
+			  dw = dstrect.Width(),
+			  dh = dstrect.Height();
 
-	if ((dstrect & CRect(0, 0, spd.w, spd.h)).IsRectEmpty()) {
+	if (visible.IsRectEmpty() || sw <= 0 || sh <= 0 || !src.lpPixels) {
 		return;
 	}
 
-	dw = dstrect.Width();
-	dh = dstrect.Height();
+	if (!m_bValid || m_version != src.nVersion || m_size != CSize(dw, dh)) {
+		m_bValid = false;
 
-	for (int y = dstrect.top; y < dstrect.bottom; y++, srcy += (srcdy<<1)) {
-		RGBQUAD* ptr = (RGBQUAD*)&(spd.bits)[y*spd.pitch] + dstrect.left;
-		RGBQUAD* endptr = ptr + dw;
+		// The bilinear filter works on premultiplied colors, so transparent
+		// pixels don't bleed their color into the edges of the text
+		m_premultiplied.resize((size_t)sw * sh);
+		m_scaled.resize((size_t)dw * dh);
+		PremultiplyAlpha(m_premultiplied.data(), (const DWORD*)src.lpPixels, m_premultiplied.size());
 
-		for (int sx = srcx; ptr < endptr; sx += (srcdx<<1), ptr++) {
-			RGBQUAD cc[4];
+		HRESULT hr = m_resample.SetParameters(dw, dh, sw, sh, CResampleRGB32::FILTER_BILINEAR, true);
+		if (S_OK == hr) {
+			hr = m_resample.Process((BYTE*)m_scaled.data(), (const BYTE*)m_premultiplied.data());
+		}
+		if (S_OK != hr) {
+			return;
+		}
 
-			PixelAtBiLinear(cc[0],	sx,			srcy,		src);
-			PixelAtBiLinear(cc[1],	sx+srcdx,	srcy,		src);
-			PixelAtBiLinear(cc[2],	sx,			srcy+srcdy,	src);
-			PixelAtBiLinear(cc[3],	sx+srcdx,	srcy+srcdy,	src);
+		InvertAlpha(m_scaled.data(), m_scaled.size());
 
-			ptr->rgbRed = (cc[0].rgbRed + cc[1].rgbRed + cc[2].rgbRed + cc[3].rgbRed) >> 2;
-			ptr->rgbGreen = (cc[0].rgbGreen + cc[1].rgbGreen + cc[2].rgbGreen + cc[3].rgbGreen) >> 2;
-			ptr->rgbBlue = (cc[0].rgbBlue + cc[1].rgbBlue + cc[2].rgbBlue + cc[3].rgbBlue) >> 2;
-			ptr->rgbReserved = (cc[0].rgbReserved + cc[1].rgbReserved + cc[2].rgbReserved + cc[3].rgbReserved) >> 2;
-			////
-			ptr->rgbRed = ptr->rgbRed * ptr->rgbReserved >> 8;
-			ptr->rgbGreen = ptr->rgbGreen * ptr->rgbReserved >> 8;
-			ptr->rgbBlue = ptr->rgbBlue * ptr->rgbReserved >> 8;
-			ptr->rgbReserved = ~ptr->rgbReserved;
+		m_version = src.nVersion;
+		m_size    = CSize(dw, dh);
+		m_bValid  = true;
+	}
 
-		}
+	for (int y = visible.top; y < visible.bottom; y++) {
+		memcpy((DWORD*)&spd.bits[y * spd.pitch] + visible.left,
+			   &m_scaled[(size_t)(y - dstrect.top) * dw + (visible.left - dstrect.left)],
+			   visible.Width() * sizeof(DWORD));
 	}
 }
 
@@ -1676,7 +1692,7 @@ HRESULT CVobSubSettings::Render(SubPicDesc& spd, RECT& bbox)
 {
 	CRect r;
 	GetDestrect(r, spd.w, spd.h);
-	StretchBlt(spd, r, m_img);
+	m_scaledImg.Draw(spd, r, m_img);
 	/*
 		CRenderedTextSubtitle rts(nullptr);
 		rts.CreateDefaultStyle(DEFAULT_CHARSET);
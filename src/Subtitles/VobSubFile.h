@@ -24,6 +24,7 @@
 #include <atlcoll.h>
 #include "VobSubImage.h"
 #include "SubPic/SubPicProviderImpl.h"
+#include "DSUtil/ResampleRGB32.h"
 
 #define VOBSUBIDXVER 7
 
@@ -42,11 +43,31 @@
 
 extern CString FindLangFromId(WORD id);
 
+// Image scaled to the destination rectangle, kept until the image or the size change
+class CVobSubScaledImage
+{
+	CResampleRGB32     m_resample;
+	std::vector<DWORD> m_premultiplied;
+	std::vector<DWORD> m_scaled;
+	CSize              m_size;
+	UINT               m_version = 0;
+	bool               m_bValid  = false;
+
+public:
+	CVobSubScaledImage() = default;
+	CVobSubScaledImage(const CVobSubScaledImage&) {}
+	CVobSubScaledImage& operator=(const CVobSubScaledImage&) { m_bValid = false; return *this; }
+
+	void Draw(SubPicDesc& spd, const CRect& dstrect, const CVobSubImage& src);
+};
+
 class CVobSubSettings
 {
 protected:
 	HRESULT Render(SubPicDesc& spd, RECT& bbox);
 
+	CVobSubScaledImage m_scaledImg;
+
 public:
 	CSize m_size;
 	int m_x, m_y;
@@ -91,12 +112,16 @@ public:
 		char cellid           = 0;
 		__int64 celltimestamp = 0i64;
 		bool bValid           = false;
+		size_t packetoffset   = 0; // SPU packet in SubLang::packets
+		int packetsize        = 0;
+		int datasize          = 0;
 	};
 
 	struct SubLang {
 		int id = 0;
 		CString name, alt;
 		std::vector<SubPos> subpos;
+		std::shared_ptr<const std::vector<BYTE>> packets; // reassembled SPU packets of subpos
 	};
 protected:
 	CString m_title;
@@ -107,7 +132,9 @@ protected:
 
 	CMemFile m_sub;
 
-	BYTE* GetPacket(size_t idx, int& packetsize, int& datasize, int nLang = -1);
+	bool ReadPacket(__int64 filepos, int nLang, std::vector<BYTE>& packets, int& packetsize, int& datasize);
+	void IndexPackets();
+	const BYTE* GetPacket(size_t idx, int& packetsize, int& datasize, int nLang = -1) const;
 	const SubPos* GetFrameInfo(size_t idx, int iLang = -1) const;
 	bool GetFrame(size_t idx, int iLang = -1, REFERENCE_TIME rt = -1);
 	bool GetFrameByTimeStamp(__int64 time);
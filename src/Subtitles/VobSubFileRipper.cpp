@@ -807,6 +807,8 @@ bool CVobSubFileRipper::Create()
 	Log(LOG_INFO, L"Indexing finished");
 	Progress(1);
 
+	IndexPackets();
+
 	for (size_t i = 0; i < std::size(m_langs); i++) {
 		if (m_nLang == -1 && m_langs[i].subpos.size() > 0) {
 			m_nLang = (int)i;
@@ -826,10 +828,9 @@ bool CVobSubFileRipper::Create()
 
 				sp[j].bValid = false;
 				int packetsize = 0, datasize = 0;
-				if (BYTE* buff = GetPacket((int)j, packetsize, datasize, (int)i)) {
+				if (const BYTE* buff = GetPacket((int)j, packetsize, datasize, (int)i)) {
 					m_img.GetPacketInfo(buff, packetsize, datasize);
 					sp[j].bValid = m_img.bForced;
-					delete [] buff;
 				}
 			}
 
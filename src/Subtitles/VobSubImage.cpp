@@ -29,7 +29,6 @@ CVobSubImage::CVobSubImage()
 	, lpTemp2(nullptr)
 	, nPlane(0)
 	, bCustomPal(false)
-	, bAligned(1)
 	, tridx(0)
 	, orgpal(nullptr)
 	, cuspal(nullptr)
@@ -42,6 +41,7 @@ CVobSubImage::CVobSubImage()
 	, delay(0)
 	, rect(CRect(0, 0, 0, 0))
 	, lpPixels(nullptr)
+	, nVersion(0)
 {
 	ZeroMemory(&pal, sizeof(pal));
 }
@@ -101,7 +101,7 @@ void CVobSubImage::Free()
 	lpPixels = nullptr;
 }
 
-bool CVobSubImage::Decode(BYTE* _lpData, int _packetSize, int _dataSize, int _t,
+bool CVobSubImage::Decode(const BYTE* _lpData, int _packetSize, int _dataSize, int _t,
 						  bool _bCustomPal,
 						  int _tridx,
 						  RGBQUAD* _orgpal /*[16]*/, RGBQUAD* _cuspal /*[4]*/,
@@ -114,49 +114,77 @@ bool CVobSubImage::Decode(BYTE* _lpData, int _packetSize, int _dataSize, int _t,
 	}
 
 	lpPixels = lpTemp1;
+	nVersion++;
 
 	nPlane = 0;
-	bAligned = 1;
 
 	bCustomPal = _bCustomPal;
 	orgpal = _orgpal;
 	tridx = _tridx;
 	cuspal = _cuspal;
 
-	CPoint p = rect.TopLeft();
+	DWORD colors[4];
+	for (int i = 0; i < 4; i++) {
+		RGBQUAD c;
+		if (!bCustomPal) {
+			c = orgpal[pal[i].pal];
+			c.rgbReserved = (pal[i].tr<<4)|pal[i].tr;
+		} else {
+			c = cuspal[i];
+		}
+		colors[i] = *(DWORD*)&c;
+	}
 
-	int end0 = nOffset[1];
-	int end1 = _dataSize;
+	// Code length in nibbles, indexed by the first byte of the code: run lengths
+	// 1-3 take 1 nibble, 4-15 take 2, 16-63 take 3, 64-255 and end of line take 4
+	static const BYTE codeLength[256] = {
+#define L4(n) n, n, n, n
+#define L16(n) L4(n), L4(n), L4(n), L4(n)
+		L4(4), L4(3), L4(3), L4(3), L16(2), L16(2), L16(2),
+		L16(1), L16(1), L16(1), L16(1), L16(1), L16(1), L16(1), L16(1), L16(1), L16(1), L16(1), L16(1)
+#undef L16
+#undef L4
+	};
 
+	int end[2] = { nOffset[1], _dataSize };
 	if (nOffset[0] > nOffset[1]) {
-		end1 = nOffset[0];
-		end0 = _dataSize;
+		end[0] = _dataSize;
+		end[1] = nOffset[0];
 	}
 
-	while ((nPlane == 0 && nOffset[0] < end0) || (nPlane == 1 && nOffset[1] < end1)) {
-		DWORD code;
+	// Positions are counted in nibbles, each plane holds every second line
+	int nibble[2] = { nOffset[0] * 2, nOffset[1] * 2 };
+	const int w = rect.Width();
+	int x = 0, y = 0;
 
-		if ((code = GetNibble(_lpData)) >= 0x4
-				|| (code = (code << 4) | GetNibble(_lpData)) >= 0x10
-				|| (code = (code << 4) | GetNibble(_lpData)) >= 0x40
-				|| (code = (code << 4) | GetNibble(_lpData)) >= 0x100) {
-			DrawPixels(p, code >> 2, code & 3);
-			if ((p.x += code >> 2) < rect.right) {
-				continue;
-			}
+	while ((nibble[nPlane] >> 1) < end[nPlane]) {
+		// Read the next 16 bits of the plane, the longest code is 4 nibbles
+		const int off = nibble[nPlane] >> 1;
+		DWORD bits = 0;
+		for (int i = 0; i < 3; i++) {
+			bits = (bits << 8) | (off + i < _packetSize ? _lpData[off + i] : 0);
 		}
+		bits = (bits >> ((nibble[nPlane] & 1) ? 4 : 8)) & 0xffff;
 
-		DrawPixels(p, rect.right - p.x, code & 3);
+		const int len = codeLength[bits >> 8];
+		const DWORD code = bits >> (16 - len * 4);
+		nibble[nPlane] += len;
 
-		if (!bAligned) {
-			GetNibble(_lpData);	// align to byte
+		const int run = (len == 4 && code < 0x100) ? w - x : std::min(int(code >> 2), w - x);
+		if (run > 0 && y < rect.Height()) {
+			fill_u32(&lpPixels[w * y + x], colors[code & 3], run);
 		}
+		x += run;
 
-		p.x = rect.left;
-		p.y++;
-		nPlane = 1 - nPlane;
+		if (x >= w) {
+			nibble[nPlane] = (nibble[nPlane] + 1) & ~1; // align to byte
+			x = 0;
+			y++;
+			nPlane = 1 - nPlane;
+		}
 	}
 
+	const CPoint p(rect.left, rect.top + y);
 	rect.bottom = std::min(p.y, rect.bottom);
 
 	if (_bTrim) {
@@ -284,54 +312,6 @@ void CVobSubImage::GetPacketInfo(const BYTE* lpData, int packetSize, int dataSiz
 	bAnimated = (nPal > 1 || nTr > 1);
 }
 
-BYTE CVobSubImage::GetNibble(const BYTE* lpData)
-{
-	WORD& off = nOffset[nPlane];
-	BYTE ret = lpData[off];
-	if (bAligned) {
-		ret >>= 4;
-	}
-	ret &= 0x0f;
-	bAligned = !bAligned;
-	if (bAligned) {
-		off++;
-	}
-	return ret;
-}
-
-void CVobSubImage::DrawPixels(CPoint p, int length, int colorId)
-{
-	if (length <= 0
-			|| p.x + length < rect.left
-			|| p.x >= rect.right
-			|| p.y < rect.top
-			|| p.y >= rect.bottom) {
-		return;
-	}
-
-	if (p.x < rect.left) {
-		p.x = rect.left;
-	}
-	if (p.x + length >= rect.right) {
-		length = rect.right - p.x;
-	}
-
-	RGBQUAD* ptr = &lpPixels[rect.Width() * (p.y - rect.top) + (p.x - rect.left)];
-
-	RGBQUAD c;
-
-	if (!bCustomPal) {
-		c = orgpal[pal[colorId].pal];
-		c.rgbReserved = (pal[colorId].tr<<4)|pal[colorId].tr;
-	} else {
-		c = cuspal[colorId];
-	}
-
-	while (length-- > 0) {
-		*ptr++ = c;
-	}
-}
-
 void CVobSubImage::TrimSubImage()
 {
 	CRect r;
@@ -1369,5 +1349,7 @@ void CVobSubImage::Scale2x()
 		memcpy(src, dst, w*h*4);
 
 		delete [] dst;
+
+		nVersion++;
 	}
 }
@@ -47,15 +47,12 @@ private:
 
 	WORD nOffset[2], nPlane;
 	bool bCustomPal;
-	char bAligned; // we are also using this for calculations, that's why it is char instead of bool...
 	int tridx;
 	RGBQUAD* orgpal /*[16]*/,* cuspal /*[4]*/;
 
 	bool Alloc(int w, int h);
 	void Free();
 
-	BYTE GetNibble(const BYTE* lpData);
-	void DrawPixels(CPoint p, int length, int colorId);
 	void TrimSubImage();
 
 public:
@@ -70,6 +67,7 @@ public:
 	};
 	SubPal pal[4];
 	RGBQUAD* lpPixels;
+	UINT nVersion; // changes whenever lpPixels is decoded or modified
 
 	CVobSubImage();
 	virtual ~CVobSubImage();
@@ -77,7 +75,7 @@ public:
 	void Invalidate();
 
 	void GetPacketInfo(const BYTE* lpData, int packetSize, int dataSize, int t = INT_MAX);
-	bool Decode(BYTE* lpData, int packetSize, int dataSize, int t,
+	bool Decode(const BYTE* lpData, int packetSize, int dataSize, int t,
 				bool bCustomPal,
 				int tridx,
 				RGBQUAD* orgpal /*[16]*/, RGBQUAD* cuspal /*[4]*/,
@@ -20,8 +20,10 @@
  */
 
 #include "stdafx.h"
+#include <emmintrin.h>
 #include <moreuuids.h>
 #include "DirectVobSubFilter.h"
+#include "TextInputPin.h"
 
 extern int c2y_yb[256];
 extern int c2y_yg[256];
@@ -37,12 +39,64 @@ union pixrgba {
 	};
 };
 
+// The BltLine functions process 16 pixels at a time and skip blocks without any visible pixel,
+// the OSD bitmap is mostly transparent (alpha 0xff).
+
+static __forceinline bool IsTransparent16(const __m128i p0, const __m128i p1, const __m128i p2, const __m128i p3)
+{
+	const __m128i a = _mm_and_si128(_mm_and_si128(p0, p1), _mm_and_si128(p2, p3));
+	return _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_srli_epi32(a, 24), _mm_set1_epi32(0xff))) == 0xffff;
+}
+
+// -1 for the visible pixels (alpha < 0xff)
+static __forceinline __m128i VisibleMask4(const __m128i p)
+{
+	return _mm_xor_si128(_mm_cmpeq_epi32(_mm_srli_epi32(p, 24), _mm_set1_epi32(0xff)), _mm_set1_epi32(-1));
+}
+
+struct CYCoefs {
+	__m128i br, g;
+
+	CYCoefs() {
+		// the tables are linear, c2y_yg[1] does not fit into a signed 16-bit word so it is split in two halves
+		const int cg = c2y_yg[1];
+		br = _mm_set1_epi32((c2y_yr[1] << 16) | c2y_yb[1]);
+		g = _mm_set1_epi32(((cg - cg / 2) << 16) | (cg / 2));
+	}
+
+	// c2y_yb[r] + c2y_yg[g] + c2y_yr[b] + 0x108000 of 4 pixels
+	__forceinline __m128i Y4(const __m128i p) const {
+		const __m128i bytes02 = _mm_and_si128(p, _mm_set1_epi32(0x00ff00ff));
+		__m128i byte1 = _mm_and_si128(_mm_srli_epi32(p, 8), _mm_set1_epi32(0xff));
+		byte1 = _mm_or_si128(byte1, _mm_slli_epi32(byte1, 16));
+		return _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(bytes02, br), _mm_madd_epi16(byte1, g)), _mm_set1_epi32(0x108000));
+	}
+};
+
 void BltLineRGB32(uint8_t* dst, const uint32_t* src, const int w)
 {
 	uint32_t* dst32 = (uint32_t*)dst;
 	uint32_t* end = dst32 + w;
 	pixrgba pix;
 
+	for (uint32_t* end16 = dst32 + (w & ~15); dst32 < end16; dst32 += 16, src += 16) {
+		const __m128i p0 = _mm_loadu_si128((const __m128i*)src);
+		const __m128i p1 = _mm_loadu_si128((const __m128i*)(src + 4));
+		const __m128i p2 = _mm_loadu_si128((const __m128i*)(src + 8));
+		const __m128i p3 = _mm_loadu_si128((const __m128i*)(src + 12));
+		if (IsTransparent16(p0, p1, p2, p3)) {
+			continue;
+		}
+
+		const __m128i p[4] = { p0, p1, p2, p3 };
+		for (int i = 0; i < 4; i++) {
+			__m128i* d = (__m128i*)(dst32 + i * 4);
+			const __m128i m = VisibleMask4(p[i]);
+			const __m128i rgb = _mm_and_si128(p[i], _mm_set1_epi32(0x00ffffff));
+			_mm_storeu_si128(d, _mm_or_si128(_mm_and_si128(m, rgb), _mm_andnot_si128(m, _mm_loadu_si128(d))));
+		}
+	}
+
 	for (; dst32 < end; dst32++) {
 		pix.u32 = *src++;
 		if (pix.a < 0xff) {
@@ -56,6 +110,27 @@ void BltLineRGB24(uint8_t* dst, const uint32_t* src, const int w)
 	uint8_t* end = dst + w * 3;
 	pixrgba pix;
 
+	for (uint8_t* end16 = dst + (w & ~15) * 3; dst < end16; ) {
+		const __m128i p0 = _mm_loadu_si128((const __m128i*)src);
+		const __m128i p1 = _mm_loadu_si128((const __m128i*)(src + 4));
+		const __m128i p2 = _mm_loadu_si128((const __m128i*)(src + 8));
+		const __m128i p3 = _mm_loadu_si128((const __m128i*)(src + 12));
+		if (IsTransparent16(p0, p1, p2, p3)) {
+			dst += 16 * 3;
+			src += 16;
+			continue;
+		}
+
+		for (uint8_t* block_end = dst + 16 * 3; dst < block_end; dst += 3) {
+			pix.u32 = *src++;
+			if (pix.a < 0xff) {
+				dst[0] = pix.r;
+				dst[1] = pix.g;
+				dst[2] = pix.b;
+			}
+		}
+	}
+
 	for (; dst < end; dst += 3) {
 		pix.u32 = *src++;
 		if (pix.a < 0xff) {
@@ -72,6 +147,27 @@ void BltLineYUY2(uint8_t* dst, const uint32_t* src, const int w)
 	uint16_t* end = dst16 + w;
 	pixrgba pix;
 
+	const CYCoefs coefs;
+
+	for (uint16_t* end16 = dst16 + (w & ~15); dst16 < end16; dst16 += 16, src += 16) {
+		const __m128i p0 = _mm_loadu_si128((const __m128i*)src);
+		const __m128i p1 = _mm_loadu_si128((const __m128i*)(src + 4));
+		const __m128i p2 = _mm_loadu_si128((const __m128i*)(src + 8));
+		const __m128i p3 = _mm_loadu_si128((const __m128i*)(src + 12));
+		if (IsTransparent16(p0, p1, p2, p3)) {
+			continue;
+		}
+
+		const __m128i p[4] = { p0, p1, p2, p3 };
+		for (int i = 0; i < 4; i += 2) {
+			__m128i* d = (__m128i*)(dst16 + i * 4);
+			const __m128i y = _mm_packs_epi32(_mm_srli_epi32(coefs.Y4(p[i]), 16), _mm_srli_epi32(coefs.Y4(p[i + 1]), 16));
+			const __m128i m = _mm_packs_epi32(VisibleMask4(p[i]), VisibleMask4(p[i + 1]));
+			const __m128i v = _mm_or_si128(y, _mm_set1_epi16((short)0x8000)); // w/o colors
+			_mm_storeu_si128(d, _mm_or_si128(_mm_and_si128(m, v), _mm_andnot_si128(m, _mm_loadu_si128(d))));
+		}
+	}
+
 	for (; dst16 < end; dst16++) {
 		pix.u32 = *src++;
 		if (pix.a < 0xff) {
@@ -87,6 +183,26 @@ void BltLineAYUV(uint8_t* dst, const uint32_t* src, const int w)
 	uint32_t* end = dst32 + w;
 	pixrgba pix;
 
+	const CYCoefs coefs;
+
+	for (uint32_t* end16 = dst32 + (w & ~15); dst32 < end16; dst32 += 16, src += 16) {
+		const __m128i p0 = _mm_loadu_si128((const __m128i*)src);
+		const __m128i p1 = _mm_loadu_si128((const __m128i*)(src + 4));
+		const __m128i p2 = _mm_loadu_si128((const __m128i*)(src + 8));
+		const __m128i p3 = _mm_loadu_si128((const __m128i*)(src + 12));
+		if (IsTransparent16(p0, p1, p2, p3)) {
+			continue;
+		}
+
+		const __m128i p[4] = { p0, p1, p2, p3 };
+		for (int i = 0; i < 4; i++) {
+			__m128i* d = (__m128i*)(dst32 + i * 4);
+			const __m128i m = VisibleMask4(p[i]);
+			const __m128i v = _mm_or_si128(_mm_and_si128(coefs.Y4(p[i]), _mm_set1_epi32(0x00ff0000)), _mm_set1_epi32(0x00008080)); // w/o colors
+			_mm_storeu_si128(d, _mm_or_si128(_mm_and_si128(m, v), _mm_andnot_si128(m, _mm_loadu_si128(d))));
+		}
+	}
+
 	for (; dst32 < end; dst32++) {
 		pix.u32 = *src++;
 		if (pix.a < 0xff) {
@@ -101,6 +217,27 @@ void BltLineYUVxxxP(uint8_t* dst, const uint32_t* src, const int w)
 	uint8_t* end = dst + w;
 	pixrgba pix;
 
+	const CYCoefs coefs;
+
+	for (uint8_t* end16 = dst + (w & ~15); dst < end16; dst += 16, src += 16) {
+		const __m128i p0 = _mm_loadu_si128((const __m128i*)src);
+		const __m128i p1 = _mm_loadu_si128((const __m128i*)(src + 4));
+		const __m128i p2 = _mm_loadu_si128((const __m128i*)(src + 8));
+		const __m128i p3 = _mm_loadu_si128((const __m128i*)(src + 12));
+		if (IsTransparent16(p0, p1, p2, p3)) {
+			continue;
+		}
+
+		const __m128i y01 = _mm_packs_epi32(_mm_srli_epi32(coefs.Y4(p0), 16), _mm_srli_epi32(coefs.Y4(p1), 16));
+		const __m128i y23 = _mm_packs_epi32(_mm_srli_epi32(coefs.Y4(p2), 16), _mm_srli_epi32(coefs.Y4(p3), 16));
+		const __m128i y = _mm_packus_epi16(y01, y23);
+		const __m128i m01 = _mm_packs_epi32(VisibleMask4(p0), VisibleMask4(p1));
+		const __m128i m23 = _mm_packs_epi32(VisibleMask4(p2), VisibleMask4(p3));
+		const __m128i m = _mm_packs_epi16(m01, m23);
+		__m128i* d = (__m128i*)dst;
+		_mm_storeu_si128(d, _mm_or_si128(_mm_and_si128(m, y), _mm_andnot_si128(m, _mm_loadu_si128(d)))); // w/o colors
+	}
+
 	for (; dst < end; dst++) {
 		pix.u32 = *src++;
 		if (pix.a < 0xff) {
@@ -116,6 +253,31 @@ void BltLineYUVxxxP16(uint8_t* dst, const uint32_t* src, const int w)
 	uint16_t* end = dst16 + w;
 	pixrgba pix;
 
+	const CYCoefs coefs;
+	// _mm_packs_epi32 is signed, the values are moved to the signed range and back
+	const __m128i offset32 = _mm_set1_epi32(0x8000);
+	const __m128i offset16 = _mm_set1_epi16((short)0x8000);
+
+	for (uint16_t* end16 = dst16 + (w & ~15); dst16 < end16; dst16 += 16, src += 16) {
+		const __m128i p0 = _mm_loadu_si128((const __m128i*)src);
+		const __m128i p1 = _mm_loadu_si128((const __m128i*)(src + 4));
+		const __m128i p2 = _mm_loadu_si128((const __m128i*)(src + 8));
+		const __m128i p3 = _mm_loadu_si128((const __m128i*)(src + 12));
+		if (IsTransparent16(p0, p1, p2, p3)) {
+			continue;
+		}
+
+		const __m128i p[4] = { p0, p1, p2, p3 };
+		for (int i = 0; i < 4; i += 2) {
+			__m128i* d = (__m128i*)(dst16 + i * 4);
+			const __m128i y0 = _mm_sub_epi32(_mm_srli_epi32(coefs.Y4(p[i]), 8), offset32);
+			const __m128i y1 = _mm_sub_epi32(_mm_srli_epi32(coefs.Y4(p[i + 1]), 8), offset32);
+			const __m128i y = _mm_xor_si128(_mm_packs_epi32(y0, y1), offset16);
+			const __m128i m = _mm_packs_epi32(VisibleMask4(p[i]), VisibleMask4(p[i + 1]));
+			_mm_storeu_si128(d, _mm_or_si128(_mm_and_si128(m, y), _mm_andnot_si128(m, _mm_loadu_si128(d)))); // w/o colors
+		}
+	}
+
 	for (; dst16 < end; dst16++) {
 		pix.u32 = *src++;
 		if (pix.a < 0xff) {
@@ -125,7 +287,32 @@ void BltLineYUVxxxP16(uint8_t* dst, const uint32_t* src, const int w)
 	}
 }
 
-void CDirectVobSubFilter::CopyPlane(BYTE* pSub, BYTE* pIn, CSize sub, CSize in, uint32_t black)
+// Copy with non-temporal stores, for frames too large to stay in the cache anyway
+static void CopyRowStream(BYTE* dst, const BYTE* src, size_t size)
+{
+	const size_t head = std::min(size, (16 - ((uintptr_t)dst & 15)) & 15);
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	size -= head;
+
+	for (; size >= 64; size -= 64, src += 64, dst += 64) {
+		const __m128i r0 = _mm_loadu_si128((const __m128i*)src);
+		const __m128i r1 = _mm_loadu_si128((const __m128i*)(src + 16));
+		const __m128i r2 = _mm_loadu_si128((const __m128i*)(src + 32));
+		const __m128i r3 = _mm_loadu_si128((const __m128i*)(src + 48));
+		_mm_stream_si128((__m128i*)dst, r0);
+		_mm_stream_si128((__m128i*)(dst + 16), r1);
+		_mm_stream_si128((__m128i*)(dst + 32), r2);
+		_mm_stream_si128((__m128i*)(dst + 48), r3);
+	}
+
+	memcpy(dst, src, size);
+}
+
+// The black borders are only written for the rows from fillTop to fillBottom,
+// the other rows keep the borders of the previous frames.
+void CDirectVobSubFilter::CopyPlane(BYTE* pSub, BYTE* pIn, CSize sub, CSize in, uint32_t black, int fillTop, int fillBottom)
 {
 	auto& packsize = m_pInputVFormat->packsize;
 
@@ -152,13 +339,19 @@ void CDirectVobSubFilter::CopyPlane(BYTE* pSub, BYTE* pIn, CSize sub, CSize in,
 
 	ASSERT(wSub >= wIn);
 
+	auto fillRow = [&](int i) {
+		return i >= fillTop && i < fillBottom;
+	};
+
 	{
 		int i = 0, j = 0;
 
 		j += (hSub - hIn) >> 1;
 
 		for (; i < j; i++, pSub += pitchSub) {
-			memset_u32(pSub, black, dpLeft+dpMid+dpRight);
+			if (fillRow(i)) {
+				memset_u32(pSub, black, dpLeft+dpMid+dpRight);
+			}
 		}
 
 		j += hIn;
@@ -167,6 +360,8 @@ void CDirectVobSubFilter::CopyPlane(BYTE* pSub, BYTE* pIn, CSize sub, CSize in,
 			pIn += pitchIn * ((hIn - hSub) >> (fScale2x?2:1));
 		}
 
+		const bool bFillSides = dpLeft + dpRight > 0;
+
 		if (fScale2x) {
 			if (m_fnScale2x) {
 				m_fnScale2x(in.cx, (std::min(j, hSub) - i) >> 1,
@@ -174,27 +369,45 @@ void CDirectVobSubFilter::CopyPlane(BYTE* pSub, BYTE* pIn, CSize sub, CSize in,
 			}
 
 			for (int k = std::min(j, hSub); i < k; i++, pIn += pitchIn, pSub += pitchSub) {
-				memset_u32(pSub, black, dpLeft);
-				memset_u32(pSub + dpLeft+dpMid, black, dpRight);
+				if (bFillSides && fillRow(i)) {
+					memset_u32(pSub, black, dpLeft);
+					memset_u32(pSub + dpLeft+dpMid, black, dpRight);
+				}
 			}
 		} else {
-			for (int k = std::min(j, hSub); i < k; i++, pIn += pitchIn, pSub += pitchSub) {
-				memset_u32(pSub, black, dpLeft);
-				memcpy(pSub + dpLeft, pIn, dpMid);
-				memset_u32(pSub + dpLeft+dpMid, black, dpRight);
+			const int k = std::min(j, hSub);
+			const bool bStream = (size_t)dpMid * (k - i) >= STREAM_COPY_MIN_SIZE;
+
+			for (; i < k; i++, pIn += pitchIn, pSub += pitchSub) {
+				if (bFillSides && fillRow(i)) {
+					memset_u32(pSub, black, dpLeft);
+					memset_u32(pSub + dpLeft+dpMid, black, dpRight);
+				}
+				if (bStream) {
+					CopyRowStream(pSub + dpLeft, pIn, dpMid);
+				} else {
+					memcpy(pSub + dpLeft, pIn, dpMid);
+				}
+			}
+
+			if (bStream) {
+				_mm_sfence();
 			}
 		}
 
 		j = hSub;
 
 		for (; i < j; i++, pSub += pitchSub) {
-			memset_u32(pSub, black, dpLeft+dpMid+dpRight);
+			if (fillRow(i)) {
+				memset_u32(pSub, black, dpLeft+dpMid+dpRight);
+			}
 		}
 	}
 }
 
 void CDirectVobSubFilter::SetupInputFunc()
 {
+	m_bBordersFilled = false;
 	m_fnScale2x = nullptr;
 	m_black   = 0;
 	m_blackUV = 0;
@@ -304,6 +517,26 @@ void CDirectVobSubFilter::PrintMessages(BYTE* pOut)
 			tmp.Format(L"queue stats: %I64d - %I64d [ms]\n", rtStart/10000, rtStop/10000);
 			msg += tmp;
 
+			int nQualityLevel;
+			double renderLoad;
+			if (SUCCEEDED(m_pSubPicQueue->GetQualityStats(nQualityLevel, renderLoad))) {
+				tmp.Format(L"quality level: %d%s, render load: %.0f%%\n",
+						   nQualityLevel, m_bAdaptiveQuality ? L"" : L" (fixed)", renderLoad * 100.0);
+				msg += tmp;
+			}
+
+			UINT64 nFrames, nMispredicted, nDropped;
+			if (SUCCEEDED(m_pSubPicQueue->GetFrameStats(nFrames, nMispredicted, nDropped))) {
+				tmp.Format(L"frames: %I64u, mispredicted: %I64u, dropped: %I64u\n", nFrames, nMispredicted, nDropped);
+				msg += tmp;
+			}
+
+			size_t nPooled, nHighWater;
+			if (SUCCEEDED(m_pSubPicQueue->GetPoolStats(nPooled, nHighWater))) {
+				tmp.Format(L"subpic pool: %Iu pooled, %Iu max in use\n", nPooled, nHighWater);
+				msg += tmp;
+			}
+
 			for (int i = 0; i < nSubPics; i++) {
 				m_pSubPicQueue->GetStats(i, rtStart, rtStop);
 				tmp.Format(L"%d: %I64d - %I64d [ms]\n", i, rtStart/10000, rtStop/10000);
@@ -311,6 +544,26 @@ void CDirectVobSubFilter::PrintMessages(BYTE* pOut)
 			}
 
 		}
+
+		for (const auto& pTextInput : m_pTextInputs) {
+			if (!pTextInput->IsConnected()) {
+				continue;
+			}
+
+			SubtitleDecodeStats decodeStats;
+			pTextInput->GetDecodeStats(decodeStats);
+			tmp.Format(L"input queue: %Iu (max %Iu), %Iu pooled, latency: %.1f (avg %.1f, max %.1f) [ms]\n",
+					   decodeStats.queueDepth, decodeStats.maxQueueDepth, decodeStats.pooled,
+					   decodeStats.lastLatency, decodeStats.avgLatency, decodeStats.maxLatency);
+			msg += tmp;
+
+			STSMemoryStats stats;
+			if (pTextInput->GetMemoryStats(stats)) {
+				tmp.Format(L"stream: %Iu entries, %Iu segments, %Iu KB, %Iu cached, %Iu evicted\n",
+						   stats.entries, stats.segments, stats.bytes / 1024, stats.cached, stats.evicted);
+				msg += tmp;
+			}
+		}
 	}
 
 	if (msg.IsEmpty()) {
@@ -54,6 +54,11 @@ CDirectVobSub::CDirectVobSub()
 	m_bOSD                   = theApp.GetProfileBool(IDS_R_GENERAL, IDS_RG_SHOWOSDSTATS, false);
 	m_bSaveFullPath          = theApp.GetProfileBool(IDS_R_GENERAL, IDS_RG_SAVEFULLPATH, false);
 	m_nReloaderDisableCount  = theApp.GetProfileBool(IDS_R_GENERAL, IDS_RG_DISABLERELOADER, false) ? 1 : 0;
+	m_bResampleTransforms    = theApp.GetProfileBool(IDS_R_GENERAL, IDS_RG_RESAMPLETRANSFORMS, false);
+	m_bPGSIndexedLoading     = theApp.GetProfileBool(IDS_R_GENERAL, IDS_RG_PGSINDEXEDLOADING, false);
+	m_nStreamingRetention    = std::clamp((int)theApp.GetProfileInt(IDS_R_GENERAL, IDS_RG_STREAMINGRETENTION, 0), 0, INT_MAX / 1000);
+	m_nInvalidateWindow      = std::clamp((int)theApp.GetProfileInt(IDS_R_GENERAL, IDS_RG_INVALIDATEWINDOW, 20), 0, 1000);
+	m_bAdaptiveQuality       = theApp.GetProfileBool(IDS_R_GENERAL, IDS_RG_ADAPTIVEQUALITY, false);
 	m_SubtitleDelay          = theApp.GetProfileInt(IDS_R_TIMING, ResStr(IDS_RTM_SUBTITLEDELAY), 0);
 	m_SubtitleSpeedMul       = theApp.GetProfileInt(IDS_R_TIMING, ResStr(IDS_RTM_SUBTITLESPEEDMUL), 1000);
 	m_SubtitleSpeedDiv       = theApp.GetProfileInt(IDS_R_TIMING, ResStr(IDS_RTM_SUBTITLESPEEDDIV), 1000);
@@ -572,6 +577,11 @@ STDMETHODIMP CDirectVobSub::UpdateRegistry()
 	theApp.WriteProfileBool(IDS_R_GENERAL, IDS_RG_FLIPSUBTITLES, m_bFlipSubtitles);
 	theApp.WriteProfileBool(IDS_R_GENERAL, IDS_RG_SHOWOSDSTATS, m_bOSD);
 	theApp.WriteProfileBool(IDS_R_GENERAL, IDS_RG_SAVEFULLPATH, m_bSaveFullPath);
+	theApp.WriteProfileBool(IDS_R_GENERAL, IDS_RG_RESAMPLETRANSFORMS, m_bResampleTransforms);
+	theApp.WriteProfileBool(IDS_R_GENERAL, IDS_RG_PGSINDEXEDLOADING, m_bPGSIndexedLoading);
+	theApp.WriteProfileInt(IDS_R_GENERAL, IDS_RG_STREAMINGRETENTION, m_nStreamingRetention);
+	theApp.WriteProfileInt(IDS_R_GENERAL, IDS_RG_INVALIDATEWINDOW, m_nInvalidateWindow);
+	theApp.WriteProfileBool(IDS_R_GENERAL, IDS_RG_ADAPTIVEQUALITY, m_bAdaptiveQuality);
 	theApp.WriteProfileInt(IDS_R_TIMING, ResStr(IDS_RTM_SUBTITLEDELAY), m_SubtitleDelay);
 	theApp.WriteProfileInt(IDS_R_TIMING, ResStr(IDS_RTM_SUBTITLESPEEDMUL), m_SubtitleSpeedMul);
 	theApp.WriteProfileInt(IDS_R_TIMING, ResStr(IDS_RTM_SUBTITLESPEEDDIV), m_SubtitleSpeedDiv);
@@ -57,6 +57,11 @@ protected:
 	bool m_bMediaFPSEnabled;
 	double m_MediaFPS;
 	bool m_bSaveFullPath;
+	bool m_bResampleTransforms;
+	bool m_bPGSIndexedLoading;
+	int m_nStreamingRetention; // seconds of embedded text subtitles kept, 0 keeps everything
+	int m_nInvalidateWindow; // ms during which the invalidations of the embedded subtitles are merged
+	bool m_bAdaptiveQuality; // lower the rendering quality when the subtitles are not rendered in time
 	NORMALIZEDRECT m_ZoomRect;
 
 	CComPtr<ISubClock> m_pSubClock;
@@ -224,6 +224,8 @@ CDirectVobSubFilter::CDirectVobSubFilter(LPUNKNOWN punk, HRESULT* phr, const GUI
 
 	HRESULT hr = S_OK;
 	m_pTextInputs.push_back(DNew CTextInputPin(this, m_pLock, &m_csSubLock, &hr));
+	m_pTextInputs.back()->SetRetention(m_nStreamingRetention * 1000);
+	m_pTextInputs.back()->SetInvalidateWindow(m_nInvalidateWindow);
 	ASSERT(SUCCEEDED(hr));
 
 	CAMThread::Create();
@@ -235,6 +237,8 @@ CDirectVobSubFilter::CDirectVobSubFilter(LPUNKNOWN punk, HRESULT* phr, const GUI
 
 CDirectVobSubFilter::~CDirectVobSubFilter()
 {
+	DisconnectSubRenderConsumer();
+
 	CAutoLock cAutoLock(&m_csQueueLock);
 	if (m_pSubPicQueue) {
 		m_pSubPicQueue->Invalidate();
@@ -416,12 +420,21 @@ HRESULT CDirectVobSubFilter::Transform(IMediaSample* pIn)
 		m_fps = 10000000.0 / rtAvgTimePerFrame / dRate;
 	}
 
+	bool bSubRenderConsumer = false;
+	if (m_pSubRenderProvider) {
+		m_pSubRenderProvider->ClearConsumer();
+		bSubRenderConsumer = m_pSubRenderProvider->IsConnected();
+	}
+
 	{
 		CAutoLock cAutoLock(&m_csQueueLock);
 
 		if (m_pSubPicQueue) {
-			m_pSubPicQueue->SetTime(CalcCurrentTime());
+			const REFERENCE_TIME rtNow = CalcCurrentTime();
+			m_pSubPicQueue->SetTime(rtNow);
 			m_pSubPicQueue->SetFPS(m_fps);
+			// the actual frame times let the queue follow variable frame rates
+			m_pSubPicQueue->SetFrameTimes(&rtNow, 1);
 		}
 	}
 
@@ -445,7 +458,17 @@ HRESULT CDirectVobSubFilter::Transform(IMediaSample* pIn)
 	CSize sub(m_wout, m_hout);
 	CSize in(bihIn.biWidth, std::abs(bihIn.biHeight));
 
-	CopyPlane(m_pTempPicBuff.get(), pDataIn, sub, in, m_black);
+	// rows of the borders to write, all of them once, then only where subtitles were drawn
+	int fillTop = m_subRowsTop, fillBottom = m_subRowsBottom;
+	if (!m_bBordersFilled || m_bordersIn != in) {
+		fillTop = 0;
+		fillBottom = sub.cy;
+		m_bBordersFilled = true;
+		m_bordersIn = in;
+	}
+	m_subRowsTop = m_subRowsBottom = 0;
+
+	CopyPlane(m_pTempPicBuff.get(), pDataIn, sub, in, m_black, fillTop, fillBottom);
 
 	auto& packsize = m_pInputVFormat->packsize;
 
@@ -456,7 +479,7 @@ HRESULT CDirectVobSubFilter::Transform(IMediaSample* pIn)
 		if (m_pInputVFormat->cmodel == Cm_YUV420) {
 			sub.cy >>= 1;
 			in.cy >>= 1;
-			CopyPlane(pSubUV, pInUV, sub, in, m_blackUV);
+			CopyPlane(pSubUV, pInUV, sub, in, m_blackUV, fillTop >> 1, (fillBottom + 1) >> 1);
 		}
 	}
 	else if (m_pInputVFormat->planes == 3) {
@@ -471,8 +494,8 @@ HRESULT CDirectVobSubFilter::Transform(IMediaSample* pIn)
 			BYTE* pSub3 = pSub2 + (sub.cx * packsize) * sub.cy;
 			BYTE* pIn3 = pIn2 + (in.cx * packsize) * in.cy;
 
-			CopyPlane(pSub2, pIn2, sub, in, m_blackUV);
-			CopyPlane(pSub3, pIn3, sub, in, m_blackUV);
+			CopyPlane(pSub2, pIn2, sub, in, m_blackUV, fillTop >> 1, (fillBottom + 1) >> 1);
+			CopyPlane(pSub3, pIn3, sub, in, m_blackUV, fillTop >> 1, (fillBottom + 1) >> 1);
 		}
 	}
 
@@ -522,14 +545,20 @@ HRESULT CDirectVobSubFilter::Transform(IMediaSample* pIn)
 	{
 		CAutoLock cAutoLock(&m_csQueueLock);
 
-		if (m_pSubPicQueue) {
+		if (m_pSubPicQueue && !bSubRenderConsumer) {
 			CComPtr<ISubPic> pSubPic;
 			if ((m_pSubPicQueue->LookupSubPic(CalcCurrentTime(), pSubPic)) && pSubPic) {
 				CRect r;
 				pSubPic->GetDirtyRect(r);
 
 				if (fFlip ^ fFlipSub) {
+					// drawn bottom-up
+					m_subRowsTop = spd.h - r.bottom;
+					m_subRowsBottom = spd.h - r.top;
 					spd.h = -spd.h;
+				} else {
+					m_subRowsTop = r.top;
+					m_subRowsBottom = r.bottom;
 				}
 
 				pSubPic->AlphaBlt(r, r, &spd);
@@ -851,6 +880,8 @@ HRESULT CDirectVobSubFilter::CompleteConnect(PIN_DIRECTION dir, IPin* pReceivePi
 			m_hSystrayThread = CreateThread(0, 0, SystrayThreadProc, &m_tbid, 0, &tid);
 		}
 
+		ConnectSubRenderConsumer();
+
 		// HACK: triggers CBaseVideoFilter::SetMediaType to adjust m_w/m_h/.. and InitSubPicQueue() to realloc buffers
 		m_pInput->SetMediaType(&m_pInput->CurrentMediaType());
 	}
@@ -868,6 +899,8 @@ HRESULT CDirectVobSubFilter::BreakConnect(PIN_DIRECTION dir)
 		}
 		*/
 	} else if (dir == PINDIR_OUTPUT) {
+		DisconnectSubRenderConsumer();
+
 		// not really needed, but may free up a little memory
 		CAutoLock cAutoLock(&m_csQueueLock);
 		m_pSubPicQueue.Release();
@@ -991,10 +1024,69 @@ REFERENCE_TIME CDirectVobSubFilter::CalcCurrentTime()
 	return (rt - 10000i64*m_SubtitleDelay) * m_SubtitleSpeedMul / m_SubtitleSpeedDiv; // no, it won't overflow if we use normal parameters (__int64 is enough for about 2000 hours if we multiply it by the max: 65536 as m_SubtitleSpeedMul)
 }
 
+REFERENCE_TIME CDirectVobSubFilter::CalcSubtitleTime(REFERENCE_TIME rt, CComPtr<ISubPicProvider>& pSubPicProvider)
+{
+	CAutoLock cAutoLock(&m_csQueueLock);
+
+	if (m_pSubPicQueue) {
+		m_pSubPicQueue->GetSubPicProvider(&pSubPicProvider);
+	}
+
+	// rt is a sample time, like the ones Transform() receives
+	rt = m_pInput->CurrentStartTime() + rt * (m_bExternalSubtitle ? m_pInput->CurrentRate() : 1);
+	return (rt - 10000i64*m_SubtitleDelay) * m_SubtitleSpeedMul / m_SubtitleSpeedDiv;
+}
+
+void CDirectVobSubFilter::ConnectSubRenderConsumer()
+{
+	if (m_pSubRenderProvider && m_pSubRenderProvider->IsConnected()) {
+		return;
+	}
+
+	// the consumer with the highest merit is serviced
+	CComPtr<ISubRenderConsumer> pConsumer;
+	ULONG bestMerit = 0;
+
+	BeginEnumFilters(m_pGraph, pEF, pBF) {
+		if (CComQIPtr<ISubRenderConsumer> pSRC = pBF.p) {
+			ULONG merit = 0;
+			if (SUCCEEDED(pSRC->GetMerit(&merit)) && (!pConsumer || merit > bestMerit)) {
+				pConsumer = pSRC;
+				bestMerit = merit;
+			}
+		}
+	}
+	EndEnumFilters
+
+	if (!pConsumer) {
+		return;
+	}
+
+	DisconnectSubRenderConsumer();
+
+	m_pSubRenderProvider = DNew CSubRenderProvider(this);
+	if (FAILED(m_pSubRenderProvider->Connect(pConsumer))) {
+		DisconnectSubRenderConsumer();
+	}
+}
+
+void CDirectVobSubFilter::DisconnectSubRenderConsumer()
+{
+	if (m_pSubRenderProvider) {
+		m_pSubRenderProvider->Detach();
+		m_pSubRenderProvider.Release();
+	}
+}
+
 void CDirectVobSubFilter::InitSubPicQueue()
 {
 	EXECUTE_ASSERT(WAIT_OBJECT_0 == WaitForSingleObject(m_hEvtTransform, INFINITE));
 
+	// A consumer renders the subtitles with its own queue, the queue of the filter then only holds
+	// the provider and must not render it ahead at another size. Checked before m_csQueueLock is
+	// taken, the provider locks it while rendering.
+	const bool bSubRenderConsumer = m_pSubRenderProvider && m_pSubRenderProvider->IsConnected();
+
 	CAutoLock cAutoLock(&m_csQueueLock);
 
 	m_pSubPicQueue.Release();
@@ -1047,6 +1139,7 @@ void CDirectVobSubFilter::InitSubPicQueue()
 
 	m_pTempPicBuff.reset(new(std::nothrow) BYTE[picbufsize]);
 	m_spd.bits = m_pTempPicBuff.get();
+	m_bBordersFilled = false;
 
 	DXVA2_ExtendedFormat exfmt = {
 	.value = GetExColorInfo(&m_pInput->CurrentMediaType())
@@ -1070,12 +1163,14 @@ void CDirectVobSubFilter::InitSubPicQueue()
 
 	HRESULT hr = S_OK;
 
-	m_pSubPicQueue = m_uSubPictToBuffer > 0
+	m_pSubPicQueue = m_uSubPictToBuffer > 0 && !bSubRenderConsumer
 					 ? (ISubPicQueue*)DNew CSubPicQueue(m_uSubPictToBuffer, !m_bAnimWhenBuffering, m_bAllowDropSubPic, pSubPicAllocator, &hr)
 					 : (ISubPicQueue*)DNew CSubPicQueueNoThread(!m_bAnimWhenBuffering, pSubPicAllocator, &hr);
 
 	if (FAILED(hr)) {
 		m_pSubPicQueue.Release();
+	} else {
+		m_pSubPicQueue->SetAdaptiveQuality(m_bAdaptiveQuality);
 	}
 
 	UpdateSubtitle(false);
@@ -2061,7 +2156,7 @@ bool CDirectVobSubFilter::Open()
 		try {
 			if (!pSubStream && ext == L".sup") {
 				std::unique_ptr<CRenderedHdmvSubtitle> pRHS(DNew CRenderedHdmvSubtitle(&m_csSubLock));
-				if (pRHS->Open(sub_fn, L"", m_videoFileName)) {
+				if (pRHS->Open(sub_fn, L"", m_videoFileName, m_bPGSIndexedLoading)) {
 					pSubStream = pRHS.release();
 				}
 			}
@@ -2173,6 +2268,8 @@ void CDirectVobSubFilter::SetSubtitle(ISubStream* pSubStream, bool fApplyDefStyl
 				pRTS->SetDefaultStyle(s);
 			}
 
+			pRTS->SetTransformResampling(m_bResampleTransforms);
+
 			pRTS->m_ePARCompensationType = m_ePARCompensationType;
 			if (m_CurrentVIH2.dwPictAspectRatioX != 0 && m_CurrentVIH2.dwPictAspectRatioY != 0&& m_CurrentVIH2.bmiHeader.biWidth != 0 && m_CurrentVIH2.bmiHeader.biHeight != 0) {
 				pRTS->m_dPARCompensation = ((double)abs(m_CurrentVIH2.bmiHeader.biWidth) / (double)abs(m_CurrentVIH2.bmiHeader.biHeight)) /
@@ -2224,6 +2321,10 @@ void CDirectVobSubFilter::InvalidateSubtitle(REFERENCE_TIME rtInvalidate, DWORD_
 {
 	CAutoLock cAutolock(&m_csQueueLock);
 
+	if (m_pSubRenderProvider) {
+		m_pSubRenderProvider->Invalidate();
+	}
+
 	if (m_pSubPicQueue) {
 		if (nSubtitleId == -1 || nSubtitleId == m_nSubtitleId) {
 			m_pSubPicQueue->Invalidate(rtInvalidate);
@@ -2252,6 +2353,8 @@ void CDirectVobSubFilter::AddSubStream(ISubStream* pSubStream)
 	if (len == 0) {
 		HRESULT hr = S_OK;
 		m_pTextInputs.push_back(DNew CTextInputPin(this, m_pLock, &m_csSubLock, &hr));
+		m_pTextInputs.back()->SetRetention(m_nStreamingRetention * 1000);
+		m_pTextInputs.back()->SetInvalidateWindow(m_nInvalidateWindow);
 	}
 }
 
@@ -2335,6 +2438,50 @@ void CDirectVobSubFilter::SetupFRD(CStringArray& paths, std::vector<HANDLE>& han
 	}
 }
 
+bool CDirectVobSubFilter::ReloadChangedFile(const CString& fn)
+{
+	CComPtr<ISubStream> pSubStream;
+	double fps;
+
+	{
+		CAutoLock cAutolock(&m_csQueueLock);
+
+		for (const auto& pExternal : m_ExternalSubstreams) {
+			CLSID clsid;
+			pExternal->GetClassID(&clsid);
+
+			if (clsid == __uuidof(CRenderedTextSubtitle)) {
+				const CString& path = ((CRenderedTextSubtitle*)pExternal)->m_path;
+				if (!fn.CompareNoCase(path) || !fn.CompareNoCase(path + L".style")) {
+					pSubStream = pExternal;
+					break;
+				}
+			}
+		}
+
+		fps = m_fps;
+	}
+
+	if (!pSubStream) {
+		return false;
+	}
+
+	std::vector<std::pair<REFERENCE_TIME, REFERENCE_TIME>> changed;
+	if (!((CRenderedTextSubtitle*)pSubStream.p)->ReloadChanged(fps, changed)) {
+		return false;
+	}
+
+	CAutoLock cAutolock(&m_csQueueLock);
+
+	if (m_pSubPicQueue && (DWORD_PTR)pSubStream.p == m_nSubtitleId) {
+		for (const auto& [rtStart, rtStop] : changed) {
+			m_pSubPicQueue->InvalidateRange(rtStart, rtStop);
+		}
+	}
+
+	return true;
+}
+
 DWORD CDirectVobSubFilter::ThreadProc()
 {
 	SetThreadPriority(m_hThread, THREAD_PRIORITY_LOWEST/*THREAD_PRIORITY_BELOW_NORMAL*/);
@@ -2390,15 +2537,32 @@ DWORD CDirectVobSubFilter::ThreadProc()
 			} else {
 				Sleep(500);
 
+				std::vector<CString> changed;
+
 				auto it = m_frd.files.begin();
 				for (size_t i = 0; it != m_frd.files.end(); i++) {
+					const CString& fn = *it++;
 					CFileStatus status;
-					if (CFileGetStatus(*it++, status)
+					if (CFileGetStatus(fn, status)
 							&& m_frd.mtime[i] != status.m_mtime) {
+						changed.push_back(fn);
+					}
+				}
+
+				if (!changed.empty()) {
+					// edited text subtitles are updated in place, anything else is reopened
+					bool bReloaded = true;
+					for (const auto& fn : changed) {
+						if (!ReloadChangedFile(fn)) {
+							bReloaded = false;
+							break;
+						}
+					}
+
+					if (!bReloaded) {
 						Open();
-						SetupFRD(paths, handles);
-						break;
 					}
+					SetupFRD(paths, handles);
 				}
 			}
 		} else {
@@ -28,6 +28,7 @@
 #include "../BaseVideoFilter/BaseVideoFilter.h"
 #include "SubPic/ISubPic.h"
 #include "Scale2x.h"
+#include "SubRenderProvider.h"
 
 struct SystrayIconData {
 	HWND hSystrayWnd;
@@ -68,12 +69,19 @@ class __declspec(uuid("93A22E7A-5091-45ef-BA61-6DA26156A5D0"))
 	, public CAMThread
 {
 	friend class CTextInputPin;
+	friend class CSubRenderProvider;
 
 	CCritSec m_csQueueLock;
 	CComPtr<ISubPicQueue> m_pSubPicQueue;
 	void InitSubPicQueue();
 	SubPicDesc m_spd;
 
+	// set when a consumer renders the subtitles itself, the video is not blended then
+	CComPtr<CSubRenderProvider> m_pSubRenderProvider;
+	void ConnectSubRenderConsumer();
+	void DisconnectSubRenderConsumer();
+	REFERENCE_TIME CalcSubtitleTime(REFERENCE_TIME rt, CComPtr<ISubPicProvider>& pSubPicProvider);
+
 	bool AdjustFrameSize(CSize& s);
 
 	HANDLE m_hEvtTransform = nullptr;
@@ -165,7 +173,16 @@ protected:
 
 	/* ResX2 */
 	std::unique_ptr<BYTE> m_pTempPicBuff;
-	void CopyPlane(BYTE* pSub, BYTE* pIn, CSize sub, CSize in, uint32_t black);
+	void CopyPlane(BYTE* pSub, BYTE* pIn, CSize sub, CSize in, uint32_t black, int fillTop, int fillBottom);
+
+	// planes of at least this size are copied without polluting the cache
+	static const size_t STREAM_COPY_MIN_SIZE = 8 * 1024 * 1024;
+
+	// The black borders around the picture in m_pTempPicBuff are only written again
+	// after a format change or where the last subtitles were drawn
+	bool m_bBordersFilled = false;
+	CSize m_bordersIn;
+	int m_subRowsTop = 0, m_subRowsBottom = 0;
 
 	// segment start time, absolute time
 	CRefTime m_tPrev;
@@ -205,6 +222,7 @@ private:
 	} m_frd;
 
 	void SetupFRD(CStringArray& paths, std::vector<HANDLE>& handles);
+	bool ReloadChangedFile(const CString& fn);
 	DWORD ThreadProc();
 
 private:
@@ -21,224 +21,173 @@
 
 #include "stdafx.h"
 #include <emmintrin.h>
-#include <moreuuids.h>
+#include <tmmintrin.h>
+#include "DSUtil/CPUInfo.h"
 
 #include "AvgLines.h"
 
-void Scale2x_YV( int w, int h, BYTE* d, int dpitch, BYTE* s, int spitch )
-{
-	BYTE* s1;
-	BYTE* s2;
-	BYTE* d1;
+// Every source row is doubled horizontally into every other destination row,
+// each new sample is the average (rounded down) of its neighbours, the last one is repeated.
+// AvgLines8() then fills the rows in between.
 
-	for (s1 = s, s2 = s + h*spitch, d1 = d; s1 < s2; d1 += dpitch) { // TODO: replace this mess with mmx code
-		BYTE* stmp = s1 + spitch;
-		BYTE* dtmp = d1 + dpitch;
-
-		for (BYTE* s3 = s1 + (w-1); s1 < s3; s1 += 1, d1 += 2) {
-			d1[0] = s1[0];
-			d1[1] = (s1[0]+s1[1])>>1;
-		}
-
-		d1[0] = d1[1] = s1[0];
+static __forceinline __m128i avg_floor_epu8(const __m128i a, const __m128i b)
+{
+	// _mm_avg_epu8 rounds up
+	return _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+}
 
-		s1 += 1;
-		d1 += 2;
+static void Scale2xRow_YV(const BYTE* s, BYTE* d, int w)
+{
+	int x = 0;
+
+	for (; x + 17 <= w; x += 16, s += 16, d += 32) {
+		const __m128i a = _mm_loadu_si128((const __m128i*)s);
+		const __m128i b = _mm_loadu_si128((const __m128i*)(s + 1));
+		const __m128i m = avg_floor_epu8(a, b);
+		_mm_storeu_si128((__m128i*)d, _mm_unpacklo_epi8(a, m));
+		_mm_storeu_si128((__m128i*)(d + 16), _mm_unpackhi_epi8(a, m));
+	}
 
-		s1 = stmp;
-		d1 = dtmp;
+	for (; x < w - 1; x++, s++, d += 2) {
+		d[0] = s[0];
+		d[1] = (s[0] + s[1]) >> 1;
 	}
 
-	AvgLines8(d, h*2, dpitch);
+	d[0] = d[1] = s[0];
 }
 
-void Scale2x_YUY2_SSE2( BYTE* s1, BYTE* d1, int w )
+static void Scale2xRow_XRGB32(const BYTE* s, BYTE* d, int w)
 {
-	const uint64_t __0xffffffff00000000 = 0xffffffff00000000;
-	const uint64_t __0x00000000ffffffff = 0x00000000ffffffff;
-	const uint64_t __0x00ff00ff00ff00ff = 0x00ff00ff00ff00ff;
-
-	const __m128i mm4 = _mm_loadl_epi64((const __m128i *)&__0x00ff00ff00ff00ff);	//movq	mm0, __0x00ff00ff00ff00ff
-	const __m128i mm5 = _mm_loadl_epi64((const __m128i *)&__0x00000000ffffffff);	//movq	mm0, __0x00000000ffffffff
-	const __m128i mm6 = _mm_loadl_epi64((const __m128i *)&__0xffffffff00000000);	//movq	mm0, __0xffffffff00000000
-	for (BYTE* s3 = s1 + ((w>>1)-1)*4; s1 < s3; s1 += 4, d1 += 8) {
-		__m128i mm0 = _mm_loadl_epi64((const __m128i *)(s1));	//movq	mm0, [esi]
-		__m128i mm2 = _mm_move_epi64(mm0);						//movq	mm2, mm0
-		mm0 = _mm_and_si128(mm0, mm4);							//pand	mm0, mm4	// mm0 = 00y400y300y200y1
-		mm2 = _mm_srli_epi16(mm2, 8);							//psrlw	mm2, 8		// mm2 = 00u200v200u100v1
-		__m128i mm1 = _mm_move_epi64(mm0);						//movq	mm1, mm0
-		mm0 = _mm_and_si128(mm0, mm5);							//pand	mm0, mm5	// mm0 = 0000000000y200y1
-		mm1 = _mm_slli_epi64(mm1, 16);							//psllq	mm1, 16
-		mm1 = _mm_and_si128(mm1, mm6);							//pand	mm1, mm6	// mm1 = 00y300y200000000
-		mm1 = _mm_or_si128(mm1, mm0);							//por	mm1, mm0	// mm1 = 00y300y200y200y1
-		mm0 = _mm_unpacklo_epi8(mm0, mm0);						//punpcklwd mm0, mm0	// mm0 = 00y200y200y100y1
-		mm0 = _mm_adds_epi16(mm0,mm1);							//paddw	mm0, mm1
-		mm0 = _mm_srli_epi16(mm0, 1);							//psrlw	mm0, 1		// mm0 = (mm0 + mm1) / 2
-		mm1 = _mm_move_epi64(mm2);								//movq	mm1, mm2
-		mm1 = _mm_unpacklo_epi32(mm1, mm1);						//punpckldq	mm1, mm1 // mm1 = 00u100v100u100v1
-		mm1 = _mm_adds_epi16(mm1,mm2);							//paddw	mm1, mm2
-		mm1 = _mm_srli_epi16(mm1, 1);							//psrlw	mm1, 1		// mm1 = (mm1 + mm2) / 2
-		mm1 = _mm_slli_epi64(mm1, 8);							//psllw	mm1, 8
-		mm1 = _mm_or_si128(mm0, mm1);							//por		mm0, mm1	// mm0 = (v1+v2)/2|(y2+y3)/2|(u1+u2)/2|y2|v1|(y1+y2)/2|u1|y1
-		_mm_storel_epi64((__m128i *)(d1), mm0);					//movq	[edi], mm0
+	int x = 0;
+
+	for (; x + 5 <= w; x += 4, s += 16, d += 32) {
+		const __m128i a = _mm_loadu_si128((const __m128i*)s);
+		const __m128i b = _mm_loadu_si128((const __m128i*)(s + 4));
+		const __m128i m = avg_floor_epu8(a, b);
+		_mm_storeu_si128((__m128i*)d, _mm_unpacklo_epi32(a, m));
+		_mm_storeu_si128((__m128i*)(d + 16), _mm_unpackhi_epi32(a, m));
 	}
 
-	*d1++ = s1[0];
-	*d1++ = s1[1];
-	*d1++ =(s1[0]+s1[2])>>1;
-	*d1++ = s1[3];
-
-	*d1++ = s1[2];
-	*d1++ = s1[1];
-	*d1++ = s1[2];
-	*d1++ = s1[3];
+	for (; x < w - 1; x++, s += 4, d += 8) {
+		for (int i = 0; i < 4; i++) {
+			d[i] = s[i];
+			d[i + 4] = (s[i] + s[i + 4]) >> 1;
+		}
+	}
 
-	s1 += 4;
+	*((DWORD*)d) = *((DWORD*)d + 1) = *((const DWORD*)s);
 }
 
-/*
-void Scale2x_YUY2_c( BYTE* s1, BYTE* d1, int w )
+static void Scale2xRow_RGB24(const BYTE* s, BYTE* d, int w)
 {
-	for (BYTE* s3 = s1 + ((w>>1)-1)*4; s1 < s3; s1 += 4, d1 += 8) {
-		d1[0] = s1[0];
-		d1[1] = s1[1];
-		d1[2] = (s1[0]+s1[2])>>1;
-		d1[3] = s1[3];
-
-		d1[4] = s1[2];
-		d1[5] = (s1[1]+s1[5])>>1;
-		d1[6] = (s1[2]+s1[4])>>1;
-		d1[7] = (s1[3]+s1[7])>>1;
+	static const bool bSSSE3 = CPUInfo::HaveSSSE3();
+
+	int x = 0;
+
+	if (bSSSE3) {
+		// 4 pixels in, 8 pixels out: s0 s1 s2 m0 m1 m2 s3 s4 s5 m3 m4 m5 s6 s7 s8 m6 | m7 m8 s9 s10 s11 m9 m10 m11
+		const __m128i shuf_s0 = _mm_setr_epi8(0, 1, 2, -1, -1, -1, 3, 4, 5, -1, -1, -1, 6, 7, 8, -1);
+		const __m128i shuf_m0 = _mm_setr_epi8(-1, -1, -1, 0, 1, 2, -1, -1, -1, 3, 4, 5, -1, -1, -1, 6);
+		const __m128i shuf_s1 = _mm_setr_epi8(-1, -1, 9, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i shuf_m1 = _mm_setr_epi8(7, 8, -1, -1, -1, 9, 10, 11, -1, -1, -1, -1, -1, -1, -1, -1);
+
+		for (; x + 7 <= w; x += 4, s += 12, d += 24) {
+			const __m128i a = _mm_loadu_si128((const __m128i*)s);
+			const __m128i b = _mm_loadu_si128((const __m128i*)(s + 3));
+			const __m128i m = avg_floor_epu8(a, b);
+			_mm_storeu_si128((__m128i*)d, _mm_or_si128(_mm_shuffle_epi8(a, shuf_s0), _mm_shuffle_epi8(m, shuf_m0)));
+			_mm_storel_epi64((__m128i*)(d + 16), _mm_or_si128(_mm_shuffle_epi8(a, shuf_s1), _mm_shuffle_epi8(m, shuf_m1)));
+		}
 	}
 
-	*d1++ = s1[0];
-	*d1++ = s1[1];
-	*d1++ =(s1[0]+s1[2])>>1;
-	*d1++ = s1[3];
-
-	*d1++ = s1[2];
-	*d1++ = s1[1];
-	*d1++ = s1[2];
-	*d1++ = s1[3];
+	for (; x < w - 1; x++, s += 3, d += 6) {
+		for (int i = 0; i < 3; i++) {
+			d[i] = s[i];
+			d[i + 3] = (s[i] + s[i + 3]) >> 1;
+		}
+	}
 
-	s1 += 4;
+	d[0] = d[3] = s[0];
+	d[1] = d[4] = s[1];
+	d[2] = d[5] = s[2];
 }
-*/
 
-void Scale2x_YUY2( int w, int h, BYTE* d, int dpitch, BYTE* s, int spitch )
+static void Scale2xRow_YUY2(const BYTE* s, BYTE* d, int w)
 {
-	BYTE* s1;
-	BYTE* s2;
-	BYTE* d1;
-
-	for (s1 = s, s2 = s + h*spitch, d1 = d; s1 < s2; d1 += dpitch) {
-		// row0, 4 pixels: y1|u1|y2|v1|y3|u2|y4|v2
-		// ->
-		// row0, 8 pixels: y1|u1|(y1+y2)/2|v1|y2|(u1+u2)/2|(y2+y3)/2|(v1+v2)/2
+	// 2 pixels: y1|u1|y2|v1 (y3|u2|y4|v2)
+	// ->
+	// 4 pixels: y1|u1|(y1+y2)/2|v1|y2|(u1+u2)/2|(y2+y3)/2|(v1+v2)/2
+	const int n = w >> 1;
+	int x = 0;
+
+	const __m128i mask_y = _mm_set1_epi16(0x00ff);
+
+	for (; x + 5 <= n; x += 4, s += 16, d += 32) {
+		const __m128i a = _mm_loadu_si128((const __m128i*)s);
+		const __m128i ya = _mm_and_si128(a, mask_y);
+		const __m128i yb = _mm_and_si128(_mm_loadu_si128((const __m128i*)(s + 2)), mask_y);
+		const __m128i ym = _mm_srli_epi16(_mm_add_epi16(ya, yb), 1);
+		const __m128i ca = _mm_srli_epi16(a, 8);
+		const __m128i cb = _mm_srli_epi16(_mm_loadu_si128((const __m128i*)(s + 4)), 8);
+		const __m128i cm = _mm_srli_epi16(_mm_add_epi16(ca, cb), 1);
+
+		const __m128i y0 = _mm_unpacklo_epi16(ya, ym);
+		const __m128i y1 = _mm_unpackhi_epi16(ya, ym);
+		const __m128i c0 = _mm_unpacklo_epi32(ca, cm);
+		const __m128i c1 = _mm_unpackhi_epi32(ca, cm);
+		_mm_storeu_si128((__m128i*)d, _mm_or_si128(y0, _mm_slli_epi16(c0, 8)));
+		_mm_storeu_si128((__m128i*)(d + 16), _mm_or_si128(y1, _mm_slli_epi16(c1, 8)));
+	}
 
-		Scale2x_YUY2_SSE2(s1, d1, w);
+	for (; x < n - 1; x++, s += 4, d += 8) {
+		d[0] = s[0];
+		d[1] = s[1];
+		d[2] = (s[0] + s[2]) >> 1;
+		d[3] = s[3];
 
-		s1 += spitch;
-		d1 += dpitch;
+		d[4] = s[2];
+		d[5] = (s[1] + s[5]) >> 1;
+		d[6] = (s[2] + s[4]) >> 1;
+		d[7] = (s[3] + s[7]) >> 1;
 	}
 
-	AvgLines8(d, h*2, dpitch);
+	d[0] = s[0];
+	d[1] = s[1];
+	d[2] = (s[0] + s[2]) >> 1;
+	d[3] = s[3];
+
+	d[4] = s[2];
+	d[5] = s[1];
+	d[6] = s[2];
+	d[7] = s[3];
 }
 
-void Scale2x_RGB24( int w, int h, BYTE* d, int dpitch, BYTE* s, int spitch )
+template <void (*Scale2xRow)(const BYTE*, BYTE*, int)>
+static void Scale2x(int w, int h, BYTE* d, int dpitch, BYTE* s, int spitch)
 {
-	BYTE* s1;
-	BYTE* s2;
-	BYTE* d1;
-
-	for (s1 = s, s2 = s + h*spitch, d1 = d; s1 < s2; d1 += dpitch) { // TODO: replace this mess with mmx code
-		BYTE* stmp = s1 + spitch;
-		BYTE* dtmp = d1 + dpitch;
-
-		for (BYTE* s3 = s1 + (w-1)*3; s1 < s3; s1 += 3, d1 += 6) {
-			d1[0] = s1[0];
-			d1[1] = s1[1];
-			d1[2] = s1[2];
-			d1[3] = (s1[0]+s1[3])>>1;
-			d1[4] = (s1[1]+s1[4])>>1;
-			d1[5] = (s1[2]+s1[5])>>1;
-		}
-
-		d1[0] = d1[3] = s1[0];
-		d1[1] = d1[4] = s1[1];
-		d1[2] = d1[5] = s1[2];
-
-		s1 += 3;
-		d1 += 6;
-
-		s1 = stmp;
-		d1 = dtmp;
+	for (BYTE* d1 = d, *s2 = s + h*spitch; s < s2; s += spitch, d1 += dpitch*2) {
+		Scale2xRow(s, d1, w);
 	}
 
 	AvgLines8(d, h*2, dpitch);
 }
 
-void Scale2x_XRGB32_SSE2( BYTE* s1, BYTE* d1, int w )
+void Scale2x_YV( int w, int h, BYTE* d, int dpitch, BYTE* s, int spitch )
 {
-	const __m128i mm_zero = _mm_setzero_si128();				//pxor	mm0, mm0
-	for (BYTE* s3 = s1 + (w-1)*4; s1 < s3; s1 += 4, d1 += 8) {
-
-		__m128i mm1 = _mm_loadl_epi64((const __m128i *)(s1));	//movq	mm1, [esi]
-		__m128i mm2 = _mm_move_epi64(mm1);						//movq	mm2, mm1
-
-		mm1 = _mm_unpacklo_epi8(mm1,mm_zero);					//punpcklbw mm1, mm0	// mm1 = 00xx00r100g100b1
-		mm2 = _mm_unpacklo_epi8(mm2,mm_zero);					//punpckhbw mm2, mm0	// mm2 = 00xx00r200g200b2
-
-		mm2 = _mm_adds_epi16(mm2,mm1);							//paddw	mm2, mm1
-		mm2 = _mm_srli_epi16(mm2, 1);							//psrlw	mm2, 1		// mm2 = (mm1 + mm2) / 2
-
-		mm1 = _mm_packus_epi16(mm1,mm2);						//packuswb	mm1, mm2
-
-		_mm_storel_epi64((__m128i *)(d1), mm1);					//movq	[edi], mm0
-	}
-
-	*((DWORD*)d1) = *((DWORD*)s1);
-	*((DWORD*)d1+1) = *((DWORD*)s1);
-
-	s1 += 4;
-	d1 += 8;
+	Scale2x<Scale2xRow_YV>(w, h, d, dpitch, s, spitch);
 }
 
-/*
-void Scale2x_XRGB32_c( BYTE* s1, BYTE* d1, int w )
+void Scale2x_YUY2( int w, int h, BYTE* d, int dpitch, BYTE* s, int spitch )
 {
-	for (BYTE* s3 = s1 + (w-1)*4; s1 < s3; s1 += 3, d1 += 6) {
-		d1[0] = s1[0];
-		d1[1] = s1[1];
-		d1[2] = s1[2];
-		d1[3] = s1[3];
-
-		d1[4] = (s1[0]+s1[4])>>1;
-		d1[5] = (s1[1]+s1[5])>>1;
-		d1[6] = (s1[2]+s1[6])>>1;
-		d1[7] = (s1[4]+s1[7])>>1;
-	}
-
-	*((DWORD*)d1) = *((DWORD*)s1);
-	*((DWORD*)d1+1) = *((DWORD*)s1);
+	Scale2x<Scale2xRow_YUY2>(w, h, d, dpitch, s, spitch);
+}
 
-	s1 += 4;
-	d1 += 8;
+void Scale2x_RGB24( int w, int h, BYTE* d, int dpitch, BYTE* s, int spitch )
+{
+	Scale2x<Scale2xRow_RGB24>(w, h, d, dpitch, s, spitch);
 }
-*/
 
 void Scale2x_XRGB32( int w, int h, BYTE* d, int dpitch, BYTE* s, int spitch )
 {
-	BYTE* s1;
-	BYTE* s2;
-	BYTE* d1;
-
-	for (s1 = s, s2 = s + h*spitch, d1 = d; s1 < s2; d1 += dpitch) {
-		Scale2x_XRGB32_SSE2(s1, d1, w);
-
-		s1 += spitch;
-		d1 += dpitch;
-	}
-
-	AvgLines8(d, h*2, dpitch);
+	Scale2x<Scale2xRow_XRGB32>(w, h, d, dpitch, s, spitch);
 }
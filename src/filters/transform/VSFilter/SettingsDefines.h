@@ -52,6 +52,11 @@
 #define IDS_RG_ENABLEZPICON          L"EnableZPIcon"
 #define IDS_RG_FLIPSUBTITLES         L"FlipSubtitles"
 #define IDS_RG_DISABLERELOADER       L"DisableReloader"
+#define IDS_RG_RESAMPLETRANSFORMS    L"ResampleTransforms"
+#define IDS_RG_PGSINDEXEDLOADING     L"PGSIndexedLoading"
+#define IDS_RG_STREAMINGRETENTION    L"StreamingRetention"
+#define IDS_RG_INVALIDATEWINDOW      L"InvalidateWindow"
+#define IDS_RG_ADAPTIVEQUALITY       L"AdaptiveQuality"
 
 #define IDS_RP_PATH L"Path%d"
 #define IDS_RL_LANG L"Lang%d"
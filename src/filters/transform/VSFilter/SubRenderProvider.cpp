@@ -0,0 +1,506 @@
+/*
+ * (C) 2026 see Authors.txt
+ *
+ * This file is part of MPC-BE.
+ *
+ * MPC-BE is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MPC-BE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "stdafx.h"
+#include <Version.h>
+#include "SubRenderProvider.h"
+#include "DirectVobSubFilter.h"
+#include "SubPic/MemSubPic.h"
+#include "SubPic/SubPicQueueImpl.h"
+#include "Subtitles/RTS.h"
+
+//
+// CSubRenderFrame
+//
+
+CSubRenderFrame::CSubRenderFrame(const CRect& outputRect, ULONGLONG id, const CRect& r, const SubPicDesc& spd)
+	: CUnknown(L"CSubRenderFrame", nullptr)
+	, m_outputRect(outputRect)
+	, m_clipRect(outputRect)
+	, m_id(id)
+	, m_pos(outputRect.TopLeft() + r.TopLeft())
+	, m_size(r.Size())
+	, m_pixels(new(std::nothrow) uint32_t[r.Width() * r.Height()])
+{
+	if (!m_pixels) {
+		m_size.SetSize(0, 0);
+		return;
+	}
+
+	// the subpics have an inverted alpha, the consumers expect a regular premultiplied one
+	uint32_t* dst = m_pixels.get();
+	for (int y = r.top; y < r.bottom; y++) {
+		const uint32_t* src = (const uint32_t*)(spd.bits + spd.pitch * y) + r.left;
+		for (int x = 0, w = r.Width(); x < w; x++) {
+			*dst++ = src[x] ^ 0xff000000;
+		}
+	}
+}
+
+STDMETHODIMP CSubRenderFrame::NonDelegatingQueryInterface(REFIID riid, void** ppv)
+{
+	CheckPointer(ppv, E_POINTER);
+
+	return
+		QI(ISubRenderFrame)
+		__super::NonDelegatingQueryInterface(riid, ppv);
+}
+
+// ISubRenderFrame
+
+STDMETHODIMP CSubRenderFrame::GetOutputRect(RECT* outputRect)
+{
+	CheckPointer(outputRect, E_POINTER);
+	*outputRect = m_outputRect;
+	return S_OK;
+}
+
+STDMETHODIMP CSubRenderFrame::GetClipRect(RECT* clipRect)
+{
+	CheckPointer(clipRect, E_POINTER);
+	*clipRect = m_clipRect;
+	return S_OK;
+}
+
+STDMETHODIMP CSubRenderFrame::GetBitmapCount(int* count)
+{
+	CheckPointer(count, E_POINTER);
+	*count = m_size.cx > 0 && m_size.cy > 0 ? 1 : 0;
+	return S_OK;
+}
+
+STDMETHODIMP CSubRenderFrame::GetBitmap(int index, ULONGLONG* id, POINT* position, SIZE* size, LPCVOID* pixels, int* pitch)
+{
+	if (index != 0 || m_size.cx <= 0 || m_size.cy <= 0) {
+		return E_INVALIDARG;
+	}
+
+	if (id) {
+		*id = m_id;
+	}
+	if (position) {
+		*position = m_pos;
+	}
+	if (size) {
+		*size = m_size;
+	}
+	if (pixels) {
+		*pixels = m_pixels.get();
+	}
+	if (pitch) {
+		*pitch = m_size.cx * 4;
+	}
+
+	return S_OK;
+}
+
+//
+// CSubRenderProvider
+//
+
+CSubRenderProvider::CSubRenderProvider(CDirectVobSubFilter* pFilter)
+	: CUnknown(L"CSubRenderProvider", nullptr)
+	, m_pFilter(pFilter)
+{
+}
+
+CSubRenderProvider::~CSubRenderProvider()
+{
+}
+
+STDMETHODIMP CSubRenderProvider::NonDelegatingQueryInterface(REFIID riid, void** ppv)
+{
+	CheckPointer(ppv, E_POINTER);
+
+	return
+		QI(ISubRenderOptions)
+		QI(ISubRenderProvider)
+		__super::NonDelegatingQueryInterface(riid, ppv);
+}
+
+HRESULT CSubRenderProvider::Connect(ISubRenderConsumer* pConsumer)
+{
+	CheckPointer(pConsumer, E_POINTER);
+
+	{
+		CAutoLock cAutoLock(&m_csLock);
+
+		if (!m_pFilter) {
+			return E_UNEXPECTED;
+		}
+		m_pConsumer = pConsumer;
+	}
+
+	// the consumer may call back into the provider
+	HRESULT hr = pConsumer->Connect(this);
+	if (FAILED(hr)) {
+		CAutoLock cAutoLock(&m_csLock);
+		m_pConsumer.Release();
+	}
+
+	return hr;
+}
+
+void CSubRenderProvider::Detach()
+{
+	CComPtr<ISubRenderConsumer> pConsumer;
+
+	{
+		CAutoLock cAutoLock(&m_csLock);
+
+		m_pFilter = nullptr;
+		pConsumer = m_pConsumer;
+		m_pConsumer.Release();
+		m_pSubPicQueue.Release();
+		m_pSubPicProvider.Release();
+		m_pLastSubPic.Release();
+		m_pLastFrame.Release();
+	}
+
+	if (pConsumer) {
+		pConsumer->Disconnect();
+	}
+}
+
+bool CSubRenderProvider::IsConnected()
+{
+	CAutoLock cAutoLock(&m_csLock);
+
+	return m_pConsumer && m_pFilter;
+}
+
+void CSubRenderProvider::Invalidate()
+{
+	m_bInvalidated = true;
+	m_bClearConsumer = true;
+}
+
+void CSubRenderProvider::ClearConsumer()
+{
+	if (!m_bClearConsumer.exchange(false)) {
+		return;
+	}
+
+	CComQIPtr<ISubRenderConsumer2> pConsumer2;
+
+	{
+		CAutoLock cAutoLock(&m_csLock);
+		pConsumer2 = m_pConsumer.p;
+	}
+
+	if (pConsumer2) {
+		pConsumer2->Clear();
+	}
+}
+
+bool CSubRenderProvider::Render(REFERENCE_TIME rt, const CSize& originalVideoSize, const CRect& videoOutputRect, ULONGLONG frameRate, CComPtr<ISubRenderFrame>& pFrame)
+{
+	CComPtr<ISubPicProvider> pSubPicProvider;
+	const REFERENCE_TIME rtSubtitle = m_pFilter->CalcSubtitleTime(rt, pSubPicProvider);
+	if (!pSubPicProvider) {
+		return true;
+	}
+
+	// text subtitles are rendered at the display resolution, bitmaps are left unscaled
+	CRect outputRect = videoOutputRect;
+	if (pSubPicProvider->GetType() != ST_TEXT || videoOutputRect.IsRectEmpty()) {
+		outputRect = CRect(CPoint(0, 0), originalVideoSize);
+	}
+	if (outputRect.IsRectEmpty()) {
+		return false;
+	}
+
+	const CSize size = outputRect.Size();
+	if (!m_pSubPicQueue || m_size != size) {
+		m_pSubPicQueue.Release();
+		m_pLastSubPic.Release();
+		m_pLastFrame.Release();
+
+		CComPtr<ISubPicAllocator> pSubPicAllocator = DNew CMemSubPicAllocator(size);
+		pSubPicAllocator->SetCurSize(size);
+		pSubPicAllocator->SetCurVidRect(CRect(CPoint(0, 0), size));
+
+		HRESULT hr;
+		m_pSubPicQueue = DNew CSubPicQueueNoThread(false, pSubPicAllocator, &hr);
+		if (FAILED(hr)) {
+			m_pSubPicQueue.Release();
+			return false;
+		}
+
+		m_size = size;
+		m_pSubPicProvider.Release();
+	}
+
+	if (m_pSubPicProvider != pSubPicProvider) {
+		m_pSubPicQueue->SetSubPicProvider(pSubPicProvider);
+		m_pSubPicProvider = pSubPicProvider;
+		m_bInvalidated = true;
+	}
+
+	if (m_bInvalidated.exchange(false)) {
+		m_pSubPicQueue->Invalidate();
+		m_pLastSubPic.Release();
+		m_pLastFrame.Release();
+	}
+
+	m_pSubPicQueue->SetFPS(frameRate > 0 ? 10000000.0 / frameRate : m_pFilter->m_fps);
+
+	CComPtr<ISubPic> pSubPic;
+	if (!m_pSubPicQueue->LookupSubPic(rtSubtitle, pSubPic) || !pSubPic) {
+		return true;
+	}
+
+	// the queue renders again into the same subpic when the time range changes
+	if (pSubPic == m_pLastSubPic && m_pLastFrame
+			&& pSubPic->GetStart() == m_rtLastStart && pSubPic->GetStop() == m_rtLastStop) {
+		pFrame = m_pLastFrame;
+		return true;
+	}
+
+	CRect r;
+	SubPicDesc spd;
+	pSubPic->GetDirtyRect(r);
+	r &= CRect(CPoint(0, 0), size);
+	if (r.IsRectEmpty() || FAILED(pSubPic->GetDesc(spd))) {
+		return true;
+	}
+
+	pFrame = DNew CSubRenderFrame(outputRect, ++m_nBitmapId, r, spd);
+	m_pLastSubPic = pSubPic;
+	m_pLastFrame = pFrame;
+	m_rtLastStart = pSubPic->GetStart();
+	m_rtLastStop = pSubPic->GetStop();
+
+	return true;
+}
+
+// RGB subtitles are reported as "None", the ASS scripts forward their "YCbCr Matrix" header
+// and the bitmap subtitles report the matrix their palette was converted with
+CStringW CSubRenderProvider::GetYuvMatrix()
+{
+	CAutoLock cAutoLock(&m_csLock);
+
+	if (!m_pSubPicProvider) {
+		return L"None";
+	}
+
+	if (m_pSubPicProvider->GetType() != ST_TEXT) {
+		// like CHdmvSub and CDVBSub, the matrix follows the video width
+		return m_size.cx > 720 ? L"TV.709" : L"TV.601";
+	}
+
+	CStringW yuvMatrix = L"None";
+	CLSID clsid;
+	CComQIPtr<ISubStream> pSubStream = m_pSubPicProvider.p;
+	if (pSubStream && SUCCEEDED(pSubStream->GetClassID(&clsid)) && clsid == __uuidof(CRenderedTextSubtitle)) {
+		CRenderedTextSubtitle* pRTS = (CRenderedTextSubtitle*)(ISubStream*)pSubStream;
+
+		if (SUCCEEDED(m_pSubPicProvider->Lock())) {
+			if (pRTS->m_subtitleType == Subtitle::SSA || pRTS->m_subtitleType == Subtitle::ASS) {
+				yuvMatrix = pRTS->m_yuvMatrix.IsEmpty() ? L"TV.601" : pRTS->m_yuvMatrix;
+			}
+			m_pSubPicProvider->Unlock();
+		}
+	}
+
+	return yuvMatrix;
+}
+
+// ISubRenderOptions
+
+STDMETHODIMP CSubRenderProvider::GetBool(LPCSTR field, bool* value)
+{
+	CheckPointer(value, E_POINTER);
+
+	if (!_stricmp(field, "combineBitmaps")) {
+		*value = m_bCombineBitmaps;
+		return S_OK;
+	}
+	if (!_stricmp(field, "isBitmap")) {
+		CAutoLock cAutoLock(&m_csLock);
+		*value = m_pSubPicProvider && m_pSubPicProvider->GetType() != ST_TEXT;
+		return S_OK;
+	}
+	if (!_stricmp(field, "isMovable")) {
+		*value = false;
+		return S_OK;
+	}
+
+	return E_INVALIDARG;
+}
+
+STDMETHODIMP CSubRenderProvider::GetInt(LPCSTR field, int* value)
+{
+	return E_INVALIDARG;
+}
+
+STDMETHODIMP CSubRenderProvider::GetSize(LPCSTR field, SIZE* value)
+{
+	return E_INVALIDARG;
+}
+
+STDMETHODIMP CSubRenderProvider::GetRect(LPCSTR field, RECT* value)
+{
+	return E_INVALIDARG;
+}
+
+STDMETHODIMP CSubRenderProvider::GetUlonglong(LPCSTR field, ULONGLONG* value)
+{
+	return E_INVALIDARG;
+}
+
+STDMETHODIMP CSubRenderProvider::GetDouble(LPCSTR field, double* value)
+{
+	return E_INVALIDARG;
+}
+
+STDMETHODIMP CSubRenderProvider::GetString(LPCSTR field, LPWSTR* value, int* chars)
+{
+	CheckPointer(value, E_POINTER);
+
+	LPCWSTR str = nullptr;
+	CStringW yuvMatrix;
+	if (!_stricmp(field, "name")) {
+		str = L"VSFilter (MPC-BE)";
+	} else if (!_stricmp(field, "version")) {
+		str = _CRT_WIDE(VERSION_STR);
+	} else if (!_stricmp(field, "yuvMatrix")) {
+		yuvMatrix = GetYuvMatrix();
+		str = yuvMatrix;
+	} else if (!_stricmp(field, "outputLevels")) {
+		str = L"PC";
+	} else {
+		return E_INVALIDARG;
+	}
+
+	const int len = (int)wcslen(str);
+	*value = (LPWSTR)LocalAlloc(LPTR, (len + 1) * sizeof(WCHAR));
+	if (!*value) {
+		return E_OUTOFMEMORY;
+	}
+	wcscpy_s(*value, len + 1, str);
+	if (chars) {
+		*chars = len;
+	}
+
+	return S_OK;
+}
+
+STDMETHODIMP CSubRenderProvider::GetBin(LPCSTR field, LPVOID* value, int* size)
+{
+	return E_INVALIDARG;
+}
+
+STDMETHODIMP CSubRenderProvider::SetBool(LPCSTR field, bool value)
+{
+	// all the subtitles of a frame are always combined into one bitmap
+	if (!_stricmp(field, "combineBitmaps")) {
+		m_bCombineBitmaps = value;
+		return S_OK;
+	}
+
+	return E_INVALIDARG;
+}
+
+STDMETHODIMP CSubRenderProvider::SetInt(LPCSTR field, int value)
+{
+	return E_INVALIDARG;
+}
+
+STDMETHODIMP CSubRenderProvider::SetSize(LPCSTR field, SIZE value)
+{
+	return E_INVALIDARG;
+}
+
+STDMETHODIMP CSubRenderProvider::SetRect(LPCSTR field, RECT value)
+{
+	return E_INVALIDARG;
+}
+
+STDMETHODIMP CSubRenderProvider::SetUlonglong(LPCSTR field, ULONGLONG value)
+{
+	return E_INVALIDARG;
+}
+
+STDMETHODIMP CSubRenderProvider::SetDouble(LPCSTR field, double value)
+{
+	return E_INVALIDARG;
+}
+
+STDMETHODIMP CSubRenderProvider::SetString(LPCSTR field, LPWSTR value, int chars)
+{
+	return E_INVALIDARG;
+}
+
+STDMETHODIMP CSubRenderProvider::SetBin(LPCSTR field, LPVOID value, int size)
+{
+	return E_INVALIDARG;
+}
+
+// ISubRenderProvider
+
+STDMETHODIMP CSubRenderProvider::RequestFrame(REFERENCE_TIME start, REFERENCE_TIME stop, LPVOID context)
+{
+	CComPtr<ISubRenderConsumer> pConsumer;
+	CComPtr<ISubRenderFrame> pFrame;
+
+	{
+		CAutoLock cAutoLock(&m_csLock);
+
+		if (!m_pConsumer || !m_pFilter) {
+			return E_UNEXPECTED;
+		}
+
+		pConsumer = m_pConsumer;
+	}
+
+	// the consumer is queried without holding the lock, it may call back into the provider
+	CSize originalVideoSize;
+	CRect videoOutputRect;
+	ULONGLONG frameRate = 0;
+	if (SUCCEEDED(pConsumer->GetSize("originalVideoSize", &originalVideoSize))
+			&& SUCCEEDED(pConsumer->GetRect("videoOutputRect", &videoOutputRect))) {
+		pConsumer->GetUlonglong("frameRate", &frameRate);
+
+		CAutoLock cAutoLock(&m_csLock);
+
+		if (!m_pConsumer || !m_pFilter) {
+			return E_UNEXPECTED;
+		}
+
+		Render(start, originalVideoSize, videoOutputRect, frameRate, pFrame);
+	}
+
+	// frames are rendered synchronously, delivering a null frame when there is nothing to show
+	return pConsumer->DeliverFrame(start, stop, context, pFrame);
+}
+
+STDMETHODIMP CSubRenderProvider::Disconnect()
+{
+	CAutoLock cAutoLock(&m_csLock);
+
+	m_pConsumer.Release();
+	m_pSubPicQueue.Release();
+	m_pSubPicProvider.Release();
+	m_pLastSubPic.Release();
+	m_pLastFrame.Release();
+
+	return S_OK;
+}
@@ -0,0 +1,119 @@
+/*
+ * (C) 2026 see Authors.txt
+ *
+ * This file is part of MPC-BE.
+ *
+ * MPC-BE is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MPC-BE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <SubRenderIntf.h>
+#include "SubPic/ISubPic.h"
+
+class CDirectVobSubFilter;
+
+// One subtitle frame delivered to a consumer: a single bitmap holding all the subtitles
+// of the frame in premultiplied RGBA.
+
+class CSubRenderFrame : public CUnknown, public ISubRenderFrame
+{
+	CRect m_outputRect;
+	CRect m_clipRect;
+
+	ULONGLONG m_id;
+	CPoint m_pos;
+	CSize m_size;
+	std::unique_ptr<uint32_t[]> m_pixels;
+
+public:
+	CSubRenderFrame(const CRect& outputRect, ULONGLONG id, const CRect& r, const SubPicDesc& spd);
+
+	DECLARE_IUNKNOWN;
+	STDMETHODIMP NonDelegatingQueryInterface(REFIID riid, void** ppv);
+
+	// ISubRenderFrame
+	STDMETHODIMP GetOutputRect(RECT* outputRect);
+	STDMETHODIMP GetClipRect(RECT* clipRect);
+	STDMETHODIMP GetBitmapCount(int* count);
+	STDMETHODIMP GetBitmap(int index, ULONGLONG* id, POINT* position, SIZE* size, LPCVOID* pixels, int* pitch);
+};
+
+// Renders the subtitles of the filter for an ISubRenderConsumer (madVR, MPC-VR, ...) at the display
+// resolution. While a consumer is connected, the filter passes the video through without blending.
+
+class CSubRenderProvider : public CUnknown, public ISubRenderProvider
+{
+	CCritSec m_csLock;
+
+	CDirectVobSubFilter* m_pFilter;
+	CComPtr<ISubRenderConsumer> m_pConsumer;
+
+	// the subtitles are rendered by a private queue at the consumer's resolution
+	CComPtr<ISubPicQueue> m_pSubPicQueue;
+	CComPtr<ISubPicProvider> m_pSubPicProvider;
+	CSize m_size;
+
+	// the last frame is delivered again as long as the subpic does not change
+	CComPtr<ISubPic> m_pLastSubPic;
+	CComPtr<ISubRenderFrame> m_pLastFrame;
+	REFERENCE_TIME m_rtLastStart = 0, m_rtLastStop = 0;
+	ULONGLONG m_nBitmapId = 0;
+
+	bool m_bCombineBitmaps = false;
+
+	std::atomic<bool> m_bInvalidated = false;
+	std::atomic<bool> m_bClearConsumer = false;
+
+	bool Render(REFERENCE_TIME rt, const CSize& originalVideoSize, const CRect& videoOutputRect, ULONGLONG frameRate, CComPtr<ISubRenderFrame>& pFrame);
+	CStringW GetYuvMatrix();
+
+public:
+	CSubRenderProvider(CDirectVobSubFilter* pFilter);
+	virtual ~CSubRenderProvider();
+
+	DECLARE_IUNKNOWN;
+	STDMETHODIMP NonDelegatingQueryInterface(REFIID riid, void** ppv);
+
+	// called by the filter
+	HRESULT Connect(ISubRenderConsumer* pConsumer);
+	void Detach();
+	bool IsConnected();
+	void Invalidate(); // does not lock, can be called with any lock held
+	void ClearConsumer(); // asks the consumer to request the invalidated frames again
+
+	// ISubRenderOptions
+	STDMETHODIMP GetBool(LPCSTR field, bool* value);
+	STDMETHODIMP GetInt(LPCSTR field, int* value);
+	STDMETHODIMP GetSize(LPCSTR field, SIZE* value);
+	STDMETHODIMP GetRect(LPCSTR field, RECT* value);
+	STDMETHODIMP GetUlonglong(LPCSTR field, ULONGLONG* value);
+	STDMETHODIMP GetDouble(LPCSTR field, double* value);
+	STDMETHODIMP GetString(LPCSTR field, LPWSTR* value, int* chars);
+	STDMETHODIMP GetBin(LPCSTR field, LPVOID* value, int* size);
+	STDMETHODIMP SetBool(LPCSTR field, bool value);
+	STDMETHODIMP SetInt(LPCSTR field, int value);
+	STDMETHODIMP SetSize(LPCSTR field, SIZE value);
+	STDMETHODIMP SetRect(LPCSTR field, RECT value);
+	STDMETHODIMP SetUlonglong(LPCSTR field, ULONGLONG value);
+	STDMETHODIMP SetDouble(LPCSTR field, double value);
+	STDMETHODIMP SetString(LPCSTR field, LPWSTR value, int chars);
+	STDMETHODIMP SetBin(LPCSTR field, LPVOID value, int size);
+
+	// ISubRenderProvider
+	STDMETHODIMP RequestFrame(REFERENCE_TIME start, REFERENCE_TIME stop, LPVOID context);
+	STDMETHODIMP Disconnect();
+};
@@ -0,0 +1,69 @@
+/*
+ * (C) 2026 see Authors.txt
+ *
+ * This file is part of MPC-BE.
+ *
+ * MPC-BE is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MPC-BE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+/** \file csri_vsfilter.h
+ * CSRI extensions of the VSFilter renderer, include after csri.h.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	/** extension id, csri_query_ext() returns a struct csri_vsfilter_batch* */
+#define CSRI_EXT_VSFILTER_BATCH (csri_ext_id)"vsfilter.batch"
+
+	/** bounding box of the rendered subtitles, empty if nothing was drawn */
+	struct csri_vsfilter_rect {
+		int left, top, right, bottom;
+	};
+
+	struct csri_vsfilter_batch {
+		/** set the frame rate used for frame based effects (default 25).
+		 * \return 0 on success, -1 on invalid arguments
+		 */
+		int (*set_framerate)(csri_inst *inst, unsigned num, unsigned den);
+
+		/** render count frames in parallel.
+		 * \param frames frames in the format set by csri_request_fmt()
+		 * \param times frame times in seconds
+		 * \param bboxes receives the bounding box of every frame, can be NULL
+		 * \return 0 on success, -1 on invalid arguments
+		 *
+		 * The call returns when all frames are rendered. It may be called
+		 * from several threads at once, as may csri_render(). The frames are
+		 * rendered by the calling thread and by worker threads which are
+		 * started by the first call and kept until csri_close().
+		 */
+		int (*render_batch)(csri_inst *inst, struct csri_frame *const *frames, const double *times,
+							struct csri_vsfilter_rect *bboxes, size_t count);
+
+		/** set the number of threads rendering a batch, the calling thread
+		 * included (default 0, the number of processors). Every thread
+		 * other than the calling one keeps its own copy of the subtitles.
+		 * \return 0 on success, -1 if a batch was already rendered
+		 */
+		int (*set_threads)(csri_inst *inst, unsigned threads);
+	};
+
+#ifdef __cplusplus
+}
+#endif
@@ -26,10 +26,37 @@
 #include "Subtitles/VobSubFile.h"
 #include "Subtitles/RTS.h"
 #include "SubPic/MemSubPicEx.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 #define CSRIAPI extern "C" __declspec(dllexport)
 #define CSRI_OWN_HANDLES
 typedef const char *csri_rend;
+
+// additional renderer for parallel rendering
+struct csri_vsfilter_renderer {
+	CCritSec cs;
+	CRenderedTextSubtitle *rts = nullptr;
+
+	~csri_vsfilter_renderer() {
+		delete rts;
+	}
+};
+
+// frames of a render_batch() call, shared by the calling thread and the workers
+struct csri_vsfilter_job {
+	struct csri_frame *const *frames;
+	const double *times;
+	struct csri_vsfilter_rect *bboxes;
+	size_t count;
+	double fps;
+	std::atomic<size_t> next = 0;
+	size_t done = 0; // protected by mutex_jobs
+};
+
 extern "C" struct csri_vsfilter_inst {
 	CRenderedTextSubtitle *rts;
 	CCritSec *cs;
@@ -38,10 +65,26 @@ extern "C" struct csri_vsfilter_inst {
 	CRect video_rect;
 	enum csri_pixfmt pixfmt;
 	size_t readorder;
+	double fps = 25.0;
+
+	// source of the subtitles, to open more renderers
+	CStringW filename;
+	std::vector<BYTE> data;
+
+	// batch rendering workers, each with its own renderer
+	std::mutex mutex_jobs;
+	std::condition_variable cond_jobs;
+	std::condition_variable cond_done;
+	std::deque<csri_vsfilter_job*> jobs;
+	std::vector<std::thread> workers;
+	unsigned threads = 0;
+	bool workers_started = false;
+	bool stop = false;
 };
 
 typedef struct csri_vsfilter_inst csri_inst;
 #include "csri.h"
+#include "csri_vsfilter.h"
 
 static csri_rend csri_vsfilter = "vsfilter";
 
@@ -62,6 +105,7 @@ CSRIAPI csri_inst *csri_open_file(csri_rend *renderer, const char *filename, str
 	inst->cs = DNew CCritSec();
 	inst->rts = DNew CRenderedTextSubtitle(inst->cs);
 	if (inst->rts->Open(CString(namebuf), CP_ACP, false, "", "")) {
+		inst->filename = namebuf;
 		delete[] namebuf;
 		inst->readorder = 0;
 		return inst;
@@ -82,6 +126,7 @@ CSRIAPI csri_inst *csri_open_mem(csri_rend *renderer, const void *data, size_t l
 	inst->cs = DNew CCritSec();
 	inst->rts = DNew CRenderedTextSubtitle(inst->cs);
 	if (inst->rts->Open((BYTE*)data, (int)length, DEFAULT_CHARSET, L"CSRI memory subtitles")) {
+		inst->data.assign((const BYTE*)data, (const BYTE*)data + length);
 		inst->readorder = 0;
 		return inst;
 	} else {
@@ -98,6 +143,15 @@ CSRIAPI void csri_close(csri_inst *inst)
 		return;
 	}
 
+	{
+		std::lock_guard<std::mutex> lock(inst->mutex_jobs);
+		inst->stop = true;
+	}
+	inst->cond_jobs.notify_all();
+	for (auto& worker : inst->workers) {
+		worker.join();
+	}
+
 	delete inst->rts;
 	delete inst->cs;
 	delete inst;
@@ -130,10 +184,8 @@ CSRIAPI int csri_request_fmt(csri_inst *inst, const struct csri_fmt *fmt)
 	return 0;
 }
 
-CSRIAPI void csri_render(csri_inst *inst, struct csri_frame *frame, double time)
+static bool csri_init_spd(const csri_inst *inst, struct csri_frame *frame, SubPicDesc& spd)
 {
-	const double arbitrary_framerate = 25.0;
-	SubPicDesc spd;
 	spd.w = inst->screen_res.cx;
 	spd.h = inst->screen_res.cy;
 	switch (inst->pixfmt) {
@@ -170,16 +222,169 @@ CSRIAPI void csri_render(csri_inst *inst, struct csri_frame *frame, double time)
 
 		default:
 			// eh?
-			return;
+			return false;
 	}
 	spd.vidrect = inst->video_rect;
 
-	inst->rts->Render(spd, (REFERENCE_TIME)(time*10000000), arbitrary_framerate, inst->video_rect);
+	return true;
+}
+
+static double csri_get_fps(csri_inst *inst)
+{
+	CAutoLock cAutoLock(inst->cs);
+	return inst->fps;
+}
+
+static void csri_render_frame(csri_inst *inst, CRenderedTextSubtitle *rts, struct csri_frame *frame, double time, double fps, struct csri_vsfilter_rect *bbox)
+{
+	CRect r;
+
+	SubPicDesc spd;
+	if (csri_init_spd(inst, frame, spd)) {
+		rts->Render(spd, (REFERENCE_TIME)(time*10000000), fps, r);
+	}
+
+	if (bbox) {
+		*bbox = { r.left, r.top, r.right, r.bottom };
+	}
+}
+
+CSRIAPI void csri_render(csri_inst *inst, struct csri_frame *frame, double time)
+{
+	csri_render_frame(inst, inst->rts, frame, time, csri_get_fps(inst), nullptr);
+}
+
+//
+// vsfilter.batch extension
+//
+
+static std::unique_ptr<csri_vsfilter_renderer> csri_open_renderer(csri_inst *inst)
+{
+	auto renderer = std::make_unique<csri_vsfilter_renderer>();
+	renderer->rts = DNew CRenderedTextSubtitle(&renderer->cs);
+
+	const bool ret = inst->data.empty()
+					 ? renderer->rts->Open(CString(inst->filename), CP_ACP, false, "", "")
+					 : renderer->rts->Open(inst->data.data(), (int)inst->data.size(), DEFAULT_CHARSET, L"CSRI memory subtitles");
+
+	return ret ? std::move(renderer) : nullptr;
+}
+
+static void csri_batch_worker(csri_inst *inst)
+{
+	// the copy of the subtitles lives as long as the worker
+	auto renderer = csri_open_renderer(inst);
+	if (!renderer) {
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(inst->mutex_jobs);
+	for (;;) {
+		inst->cond_jobs.wait(lock, [inst] { return inst->stop || !inst->jobs.empty(); });
+		if (inst->stop) {
+			return;
+		}
+
+		csri_vsfilter_job *job = inst->jobs.front();
+		const size_t i = job->next++;
+		if (i >= job->count) {
+			// the last frames are being rendered, the caller waits for them
+			inst->jobs.pop_front();
+			continue;
+		}
+
+		lock.unlock();
+		csri_render_frame(inst, renderer->rts, job->frames[i], job->times[i], job->fps, job->bboxes ? &job->bboxes[i] : nullptr);
+		lock.lock();
+
+		if (++job->done == job->count) {
+			inst->cond_done.notify_all();
+		}
+	}
+}
+
+static int csri_vsfilter_set_framerate(csri_inst *inst, unsigned num, unsigned den)
+{
+	if (!inst || !num || !den) {
+		return -1;
+	}
+
+	CAutoLock cAutoLock(inst->cs);
+	inst->fps = (double)num / den;
+	return 0;
+}
+
+static int csri_vsfilter_set_threads(csri_inst *inst, unsigned threads)
+{
+	if (!inst) {
+		return -1;
+	}
+
+	std::lock_guard<std::mutex> lock(inst->mutex_jobs);
+	if (inst->workers_started) {
+		return -1;
+	}
+
+	inst->threads = threads;
+	return 0;
 }
 
-// No extensions supported
+static int csri_vsfilter_render_batch(csri_inst *inst, struct csri_frame *const *frames, const double *times,
+									  struct csri_vsfilter_rect *bboxes, size_t count)
+{
+	if (!inst || !frames || !times) {
+		return -1;
+	}
+
+	csri_vsfilter_job job = { frames, times, bboxes, count, csri_get_fps(inst) };
+
+	{
+		std::lock_guard<std::mutex> lock(inst->mutex_jobs);
+
+		// the calling thread renders with the main renderer, the workers with their own
+		if (!inst->workers_started) {
+			inst->workers_started = true;
+			const unsigned threads = inst->threads ? inst->threads : std::max(std::thread::hardware_concurrency(), 1u);
+			for (unsigned i = 1; i < threads; i++) {
+				inst->workers.emplace_back(csri_batch_worker, inst);
+			}
+		}
+
+		if (!inst->workers.empty() && count > 1) {
+			inst->jobs.push_back(&job);
+		}
+	}
+	inst->cond_jobs.notify_all();
+
+	size_t done = 0;
+	for (size_t i; (i = job.next++) < count; done++) {
+		csri_render_frame(inst, inst->rts, frames[i], times[i], job.fps, bboxes ? &bboxes[i] : nullptr);
+	}
+
+	std::unique_lock<std::mutex> lock(inst->mutex_jobs);
+	job.done += done;
+	inst->cond_done.wait(lock, [&job] { return job.done == job.count; });
+
+	auto it = std::find(inst->jobs.begin(), inst->jobs.end(), &job);
+	if (it != inst->jobs.end()) {
+		inst->jobs.erase(it);
+	}
+
+	return 0;
+}
+
+static struct csri_vsfilter_batch csri_vsfilter_batch_ext = {
+	csri_vsfilter_set_framerate,
+	csri_vsfilter_render_batch,
+	csri_vsfilter_set_threads
+};
+
 CSRIAPI void *csri_query_ext(csri_rend *rend, csri_ext_id extname)
 {
+	if (extname && !strcmp(extname, CSRI_EXT_VSFILTER_BATCH)) {
+		return &csri_vsfilter_batch_ext;
+	}
+
 	return 0;
 }
 
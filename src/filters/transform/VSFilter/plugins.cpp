@@ -21,6 +21,8 @@
 
 #include "stdafx.h"
 #include <afxdlgs.h>
+#include <atomic>
+#include <mutex>
 #include <atlpath.h>
 #include "resource.h"
 #include "Subtitles/VobSubFile.h"
@@ -68,6 +70,85 @@ namespace Plugin
 	private:
 		CString m_fn;
 
+		// Private renderer of a thread that found the main one busy
+		struct RenderContext {
+			CCritSec csSubLock;
+			CComPtr<ISubPicProvider> pSubPicProvider;
+			CComPtr<ISubPicQueue> pSubPicQueue;
+			DWORD_PTR SubPicProviderId = 0;
+			LONG nGeneration = 0;
+		};
+
+		std::mutex m_mutexRender; // owner of m_pSubPicQueue
+		std::mutex m_mutexContexts;
+		std::vector<std::unique_ptr<RenderContext>> m_freeContexts;
+		std::atomic<LONG> m_nGeneration = 0; // changes when the subtitles are opened or reloaded
+
+		bool Render(CComPtr<ISubPicQueue>& pSubPicQueue, ISubPicProvider* pSubPicProvider, DWORD_PTR& SubPicProviderId,
+					SubPicDesc& dst, REFERENCE_TIME rt) {
+			if (!pSubPicQueue) {
+				CComPtr<ISubPicAllocator> pSubPicAllocator = DNew CMemSubPicExAllocator(CSize(dst.w, dst.h), dst.type, m_bt601);
+
+				HRESULT hr;
+				if (!(pSubPicQueue = DNew CSubPicQueueNoThread(false, pSubPicAllocator, &hr)) || FAILED(hr)) {
+					pSubPicQueue.Release();
+					return false;
+				}
+			}
+
+			if (SubPicProviderId != (DWORD_PTR)pSubPicProvider) {
+				pSubPicQueue->SetSubPicProvider(pSubPicProvider);
+				SubPicProviderId = (DWORD_PTR)pSubPicProvider;
+			}
+
+			CComPtr<ISubPic> pSubPic;
+			if (!pSubPicQueue->LookupSubPic(rt, pSubPic)) {
+				return false;
+			}
+
+			CRect r;
+			pSubPic->GetDirtyRect(r);
+
+			if (dst.type == MSP_RGB32 || dst.type == MSP_RGB24) {
+				dst.h = -dst.h;
+			}
+
+			pSubPic->AlphaBlt(r, r, &dst);
+
+			return true;
+		}
+
+		std::unique_ptr<RenderContext> AcquireRenderContext() {
+			const LONG nGeneration = m_nGeneration;
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutexContexts);
+				while (!m_freeContexts.empty()) {
+					std::unique_ptr<RenderContext> ctx = std::move(m_freeContexts.back());
+					m_freeContexts.pop_back();
+					if (ctx->nGeneration == nGeneration) {
+						return ctx;
+					}
+				}
+			}
+
+			auto ctx = std::make_unique<RenderContext>();
+			ctx->nGeneration = nGeneration;
+			ctx->pSubPicProvider.Attach(CreateSubPicProvider(GetFileName(), &ctx->csSubLock));
+			if (!ctx->pSubPicProvider) {
+				return nullptr;
+			}
+
+			return ctx;
+		}
+
+		void ReleaseRenderContext(std::unique_ptr<RenderContext> ctx) {
+			std::lock_guard<std::mutex> lock(m_mutexContexts);
+			if (ctx->nGeneration == m_nGeneration) {
+				m_freeContexts.push_back(std::move(ctx));
+			}
+		}
+
 	protected:
 		float m_fps = -1;
 		CCritSec m_csSubLock;
@@ -76,6 +157,18 @@ namespace Plugin
 		DWORD_PTR m_SubPicProviderId = 0;
 		bool m_bt601 = false;
 
+		// Opens another instance of the subtitles for a concurrent renderer,
+		// returns an AddRef'ed provider or nullptr
+		virtual ISubPicProvider* CreateSubPicProvider(CString fn, CCritSec* pLock) {
+			return nullptr;
+		}
+
+		void InvalidateRenderContexts() {
+			std::lock_guard<std::mutex> lock(m_mutexContexts);
+			m_nGeneration++;
+			m_freeContexts.clear();
+		}
+
 	public:
 		CFilter() {
 			CAMThread::Create();
@@ -97,41 +190,43 @@ namespace Plugin
 			m_bt601 = bt601;
 		}
 
+		// matrix is the value of the _Matrix frame property
+		void SetMatrix(const int64_t matrix, const int w, const int h) {
+			switch (matrix) {
+			case 0:
+				SetBt601(w <= 1024 && h <= 576);
+				break;
+			case 5:
+			case 6:
+				SetBt601(true);
+				break;
+			default:
+				SetBt601(false);
+			}
+		}
+
+		// Safe to call from several threads at once. The first thread renders
+		// with m_pSubPicProvider, the others with private copies of it.
 		bool Render(SubPicDesc& dst, REFERENCE_TIME rt, float fps) {
 			if (!m_pSubPicProvider) {
 				return false;
 			}
 
-			if (!m_pSubPicQueue) {
-				CComPtr<ISubPicAllocator> pSubPicAllocator = DNew CMemSubPicExAllocator(CSize(dst.w, dst.h), dst.type, m_bt601);
-
-				HRESULT hr;
-				if (!(m_pSubPicQueue = DNew CSubPicQueueNoThread(false, pSubPicAllocator, &hr)) || FAILED(hr)) {
-					m_pSubPicQueue.Release();
-					return false;
-				}
-			}
-
-			if (m_SubPicProviderId != (DWORD_PTR)(ISubPicProvider*)m_pSubPicProvider) {
-				m_pSubPicQueue->SetSubPicProvider(m_pSubPicProvider);
-				m_SubPicProviderId = (DWORD_PTR)(ISubPicProvider*)m_pSubPicProvider;
-			}
-
-			CComPtr<ISubPic> pSubPic;
-			if (!m_pSubPicQueue->LookupSubPic(rt, pSubPic)) {
-				return false;
+			std::unique_lock<std::mutex> lock(m_mutexRender, std::try_to_lock);
+			if (lock.owns_lock()) {
+				return Render(m_pSubPicQueue, m_pSubPicProvider, m_SubPicProviderId, dst, rt);
 			}
 
-			CRect r;
-			pSubPic->GetDirtyRect(r);
-
-			if (dst.type == MSP_RGB32 || dst.type == MSP_RGB24) {
-				dst.h = -dst.h;
+			std::unique_ptr<RenderContext> ctx = AcquireRenderContext();
+			if (!ctx) {
+				lock.lock();
+				return Render(m_pSubPicQueue, m_pSubPicProvider, m_SubPicProviderId, dst, rt);
 			}
 
-			pSubPic->AlphaBlt(r, r, &dst);
+			const bool ret = Render(ctx->pSubPicQueue, ctx->pSubPicProvider, ctx->SubPicProviderId, dst, rt);
+			ReleaseRenderContext(std::move(ctx));
 
-			return true;
+			return ret;
 		}
 
 		DWORD ThreadProc() {
@@ -161,9 +256,25 @@ namespace Plugin
 							fs.m_mtime = fs2.m_mtime;
 
 							if (CComQIPtr<ISubStream> pSubStream = m_pSubPicProvider.p) {
-								CAutoLock cAutoLock(&m_csSubLock);
-								pSubStream->Reload();
+								CLSID clsid;
+								pSubStream->GetClassID(&clsid);
+
+								// edited text subtitles are updated in place and only the changed times are re-rendered
+								std::vector<std::pair<REFERENCE_TIME, REFERENCE_TIME>> changed;
+								if (clsid == __uuidof(CRenderedTextSubtitle)
+										&& ((CRenderedTextSubtitle*)pSubStream.p)->ReloadChanged(m_fps, changed)) {
+									std::lock_guard<std::mutex> lock(m_mutexRender);
+									if (m_pSubPicQueue) {
+										for (const auto& [rtStart, rtStop] : changed) {
+											m_pSubPicQueue->InvalidateRange(rtStart, rtStop);
+										}
+									}
+								} else {
+									CAutoLock cAutoLock(&m_csSubLock);
+									pSubStream->Reload();
+								}
 							}
+							InvalidateRenderContexts();
 						}
 					}
 				} else if (WAIT_TIMEOUT == i) {
@@ -206,18 +317,29 @@ namespace Plugin
 		bool Open(CString fn) {
 			SetFileName(L"");
 			m_pSubPicProvider.Release();
+			InvalidateRenderContexts();
 
-			if (CVobSubFile* vsf = DNew CVobSubFile(&m_csSubLock)) {
-				m_pSubPicProvider = (ISubPicProvider*)vsf;
-				if (vsf->Open(CString(fn))) {
-					SetFileName(fn);
-				} else {
-					m_pSubPicProvider.Release();
-				}
+			m_pSubPicProvider.Attach(CreateSubPicProvider(fn, &m_csSubLock));
+			if (m_pSubPicProvider) {
+				SetFileName(fn);
 			}
 
 			return !!m_pSubPicProvider;
 		}
+
+	protected:
+		ISubPicProvider* CreateSubPicProvider(CString fn, CCritSec* pLock) override {
+			CComPtr<ISubPicProvider> pSubPicProvider;
+
+			if (CVobSubFile* vsf = DNew CVobSubFile(pLock)) {
+				pSubPicProvider = (ISubPicProvider*)vsf;
+				if (!vsf->Open(fn)) {
+					pSubPicProvider.Release();
+				}
+			}
+
+			return pSubPicProvider.Detach();
+		}
 	};
 
 	class CTextSubFilter : virtual public CFilter
@@ -242,20 +364,29 @@ namespace Plugin
 			SetFileName(L"");
 			m_DefaultCodePage = ExpandCodePage(codePage);
 			m_pSubPicProvider.Release();
+			InvalidateRenderContexts();
 
-			if (!m_pSubPicProvider) {
-				if (CRenderedTextSubtitle* rts = DNew CRenderedTextSubtitle(&m_csSubLock)) {
-					m_pSubPicProvider = (ISubPicProvider*)rts;
-					if (rts->Open(CString(fn), m_DefaultCodePage, false, "", "")) {
-						SetFileName(fn);
-					} else {
-						m_pSubPicProvider.Release();
-					}
-				}
+			m_pSubPicProvider.Attach(CreateSubPicProvider(fn, &m_csSubLock));
+			if (m_pSubPicProvider) {
+				SetFileName(fn);
 			}
 
 			return !!m_pSubPicProvider;
 		}
+
+	protected:
+		ISubPicProvider* CreateSubPicProvider(CString fn, CCritSec* pLock) override {
+			CComPtr<ISubPicProvider> pSubPicProvider;
+
+			if (CRenderedTextSubtitle* rts = DNew CRenderedTextSubtitle(pLock)) {
+				pSubPicProvider = (ISubPicProvider*)rts;
+				if (!rts->Open(fn, m_DefaultCodePage, false, "", "")) {
+					pSubPicProvider.Release();
+				}
+			}
+
+			return pSubPicProvider.Detach();
+		}
 	};
 
 	//
@@ -574,6 +705,7 @@ namespace Plugin
 		class CAvisynthFilter : public GenericVideoFilter, virtual public CFilter
 		{
 			int msp_type;
+			int bits_per_component;
 		public:
 			bool has_at_least_v8; // avs interface version check
 
@@ -583,16 +715,24 @@ namespace Plugin
 				: GenericVideoFilter(c)
 				, vfr(_vfr)
 			{
+				bits_per_component = vi.BitsPerComponent();
+				const bool b8bit = (bits_per_component == 8);
+				const bool b16bit = (bits_per_component > 8 && bits_per_component <= 16);
+
 				msp_type =
 					vi.IsRGB32() ? (env->GetVar("RGBA").AsBool() ? MSP_RGBA : MSP_RGB32) :
 					vi.IsRGB24() ? MSP_RGB24 :
 					vi.IsYUY2() ? MSP_YUY2 :
 					/*vi.IsYV12()*/ vi.pixel_type == VideoInfo::CS_YV12 ? (s_fSwapUV ? MSP_IYUV : MSP_YV12) :
 					/*vi.IsIYUV()*/ vi.pixel_type == VideoInfo::CS_IYUV ? (s_fSwapUV ? MSP_YV12 : MSP_IYUV) :
+					vi.IsPlanarRGB() || vi.IsPlanarRGBA() ? (b8bit ? MSP_RGBP : b16bit ? MSP_RGBP16 : -1) :
+					vi.Is420() ? (b8bit ? MSP_YV12 : b16bit ? MSP_YUV420P16 : -1) :
+					vi.Is422() ? (b8bit ? MSP_YV16 : b16bit ? MSP_YUV422P16 : -1) :
+					vi.Is444() ? (b8bit ? MSP_YV24 : b16bit ? MSP_YUV444P16 : -1) :
 					-1;
 
 				if (msp_type == -1) {
-					env->ThrowError("Format not supported. Use RGB24, RGB32, YUY2, YV12.");
+					env->ThrowError("Format not supported. Use RGB24, RGB32, YUY2 or planar YUV 4:2:0/4:2:2/4:4:4 and RGB with 8-16 bits.");
 				}
 
 				has_at_least_v8 = true;
@@ -629,21 +769,7 @@ namespace Plugin
 								val_Int = env->propGetInt(&avsMap, keyName, 0, &err);
 								if (!err) {
 									if (strcmp(keyName, "_Matrix") == 0) {
-										bool bt601;
-
-										switch (val_Int) {
-										case 0:
-											bt601 = (vi.width <= 1024 && vi.height <= 576);
-											break;
-										case 5:
-										case 6:
-											bt601 = true;
-											break;
-										default:
-											bt601 = false;
-										}
-
-										SetBt601(bt601);
+										SetMatrix(val_Int, vi.width, vi.height);
 									}
 								}
 								break;
@@ -653,6 +779,11 @@ namespace Plugin
 				}
 			}
 
+			// GetFrame may run on several threads at once, see CFilter::Render
+			int __stdcall SetCacheHints(int cachehints, int frame_range) override {
+				return cachehints == CACHE_GET_MTMODE ? MT_NICE_FILTER : 0;
+			}
+
 			PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env) {
 				PVideoFrame frame = child->GetFrame(n, env);
 
@@ -662,10 +793,15 @@ namespace Plugin
 				dst.type = msp_type;
 				dst.bpp  = frame->GetRowSize() / dst.w * 8;
 
-				{
-					// 8 bit classic
-					env->MakeWritable(&frame);
+				env->MakeWritable(&frame);
 
+				if (msp_type == MSP_RGBP || msp_type == MSP_RGBP16) {
+					dst.pitch   = frame->GetPitch(PLANAR_G);
+					dst.pitchUV = frame->GetPitch(PLANAR_B);
+					dst.bits    = frame->GetWritePtr(PLANAR_G);
+					dst.bitsU   = frame->GetWritePtr(PLANAR_B);
+					dst.bitsV   = frame->GetWritePtr(PLANAR_R);
+				} else {
 					dst.pitch   = frame->GetPitch();
 					dst.pitchUV = frame->GetPitch(PLANAR_U); // n/a for RGB
 					dst.bits    = frame->GetWritePtr();
@@ -673,6 +809,10 @@ namespace Plugin
 					dst.bitsV   = frame->GetWritePtr(PLANAR_V); // n/a for RGB
 				}
 
+				if (bits_per_component > 8) {
+					dst.bpp = bits_per_component;
+				}
+
 				// Common part
 				float fps = m_fps > 0 ? m_fps : (float)vi.fps_numerator / vi.fps_denominator;
 
@@ -803,6 +943,244 @@ namespace Plugin
 			return nullptr;
 		}
 	}
+
+	//
+	// VapourSynth interface (API 4, R55+)
+	//
+	namespace VapourSynth
+	{
+#include <vapoursynth/VapourSynth4.h>
+
+		static int GetMspType(const VSVideoFormat& format)
+		{
+			if (format.sampleType != stInteger || format.bitsPerSample > 16) {
+				return -1;
+			}
+
+			const bool b8bit = (format.bitsPerSample == 8);
+
+			if (format.colorFamily == cfRGB) {
+				return b8bit ? MSP_RGBP : MSP_RGBP16;
+			}
+			if (format.colorFamily == cfYUV) {
+				if (format.subSamplingW == 1 && format.subSamplingH == 1) {
+					return b8bit ? MSP_YV12 : MSP_YUV420P16;
+				}
+				if (format.subSamplingW == 1 && format.subSamplingH == 0) {
+					return b8bit ? MSP_YV16 : MSP_YUV422P16;
+				}
+				if (format.subSamplingW == 0 && format.subSamplingH == 0) {
+					return b8bit ? MSP_YV24 : MSP_YUV444P16;
+				}
+			}
+
+			return -1;
+		}
+
+		class CVapourSynthFilter : virtual public CFilter
+		{
+			VSNode* m_node;
+			const VSAPI* m_vsapi;
+			VSVideoInfo m_vi;
+			int m_msp_type;
+			VFRTranslator* m_vfr;
+
+		public:
+			CVapourSynthFilter(VSNode* node, const VSAPI* vsapi, VFRTranslator* vfr)
+				: m_node(node)
+				, m_vsapi(vsapi)
+				, m_vi(*vsapi->getVideoInfo(node))
+				, m_msp_type(GetMspType(m_vi.format))
+				, m_vfr(vfr)
+			{
+				if (m_vi.format.colorFamily == cfYUV) {
+					if (const VSFrame* frame = vsapi->getFrame(0, node, nullptr, 0)) {
+						int err = 0;
+						const int64_t matrix = vsapi->mapGetInt(vsapi->getFramePropertiesRO(frame), "_Matrix", 0, &err);
+						if (!err) {
+							SetMatrix(matrix, m_vi.width, m_vi.height);
+						}
+						vsapi->freeFrame(frame);
+					}
+				}
+			}
+
+			virtual ~CVapourSynthFilter() {
+				m_vsapi->freeNode(m_node);
+			}
+
+			static const VSFrame* VS_CC GetFrame(int n, int activationReason, void* instanceData, void** frameData,
+												 VSFrameContext* frameCtx, VSCore* core, const VSAPI* vsapi)
+			{
+				auto filter = static_cast<CVapourSynthFilter*>(instanceData);
+
+				if (activationReason == arInitial) {
+					vsapi->requestFrameFilter(n, filter->m_node, frameCtx);
+					return nullptr;
+				}
+				if (activationReason != arAllFramesReady) {
+					return nullptr;
+				}
+
+				const VSFrame* src = vsapi->getFrameFilter(n, filter->m_node, frameCtx);
+				VSFrame* frame = vsapi->copyFrame(src, core);
+				vsapi->freeFrame(src);
+
+				// SubPicDesc takes the planes in G, B, R order for RGB, VapourSynth stores R, G, B
+				const bool bRGB = (filter->m_vi.format.colorFamily == cfRGB);
+				const int planes[3] = { bRGB ? 1 : 0, bRGB ? 2 : 1, bRGB ? 0 : 2 };
+
+				SubPicDesc dst;
+				dst.w       = filter->m_vi.width;
+				dst.h       = filter->m_vi.height;
+				dst.type    = filter->m_msp_type;
+				dst.bpp     = filter->m_vi.format.bitsPerSample;
+				dst.pitch   = (int)vsapi->getStride(frame, planes[0]);
+				dst.pitchUV = (int)vsapi->getStride(frame, planes[1]);
+				dst.bits    = vsapi->getWritePtr(frame, planes[0]);
+				dst.bitsU   = vsapi->getWritePtr(frame, planes[1]);
+				dst.bitsV   = vsapi->getWritePtr(frame, planes[2]);
+
+				const float fps = filter->m_fps > 0 ? filter->m_fps : (float)filter->m_vi.fpsNum / filter->m_vi.fpsDen;
+
+				REFERENCE_TIME timestamp;
+
+				if (!filter->m_vfr) {
+					timestamp = (REFERENCE_TIME)(10000000i64 * n / fps);
+				} else {
+					timestamp = (REFERENCE_TIME)(10000000 * filter->m_vfr->TimeStampFromFrameNumber(n));
+				}
+
+				// Render is safe to call from the parallel frame requests
+				filter->Render(dst, timestamp, fps);
+
+				return frame;
+			}
+
+			static void VS_CC Free(void* instanceData, VSCore* core, const VSAPI* vsapi)
+			{
+				delete static_cast<CVapourSynthFilter*>(instanceData);
+			}
+
+			static bool Create(CVapourSynthFilter* filter, const char* name, VSMap* out, VSCore* core, const VSAPI* vsapi)
+			{
+				if (!filter->m_pSubPicProvider) {
+					vsapi->mapSetError(out, CStringA(name) + ": Can't open the subtitle file");
+					delete filter;
+					return false;
+				}
+				if (filter->m_msp_type == -1) {
+					vsapi->mapSetError(out, CStringA(name) + ": Format not supported. Use planar YUV 4:2:0/4:2:2/4:4:4 or RGB with 8-16 bits.");
+					delete filter;
+					return false;
+				}
+				if (filter->m_fps <= 0 && !filter->m_vfr && (filter->m_vi.fpsNum <= 0 || filter->m_vi.fpsDen <= 0)) {
+					vsapi->mapSetError(out, CStringA(name) + ": Variable frame rate clips need fps or vfr");
+					delete filter;
+					return false;
+				}
+
+				VSFilterDependency deps[] = { { filter->m_node, rpStrictSpatial } };
+				vsapi->createVideoFilter(out, name, &filter->m_vi, GetFrame, Free, fmParallel, deps, 1, filter, core);
+
+				return true;
+			}
+		};
+
+		class CVobSubVapourSynthFilter : public CVobSubFilter, public CVapourSynthFilter
+		{
+		public:
+			CVobSubVapourSynthFilter(VSNode* node, const VSAPI* vsapi, const char* fn)
+				: CVobSubFilter(UTF8ToWStr(fn))
+				, CVapourSynthFilter(node, vsapi, nullptr) {
+			}
+		};
+
+		class CTextSubVapourSynthFilter : public CTextSubFilter, public CVapourSynthFilter
+		{
+		public:
+			CTextSubVapourSynthFilter(VSNode* node, const VSAPI* vsapi, const char* fn, UINT codePage, float fps, VFRTranslator* vfr)
+				: CTextSubFilter(UTF8ToWStr(fn), codePage, fps)
+				, CVapourSynthFilter(node, vsapi, vfr) {
+			}
+		};
+
+		static VFRTranslator* GetVFRArg(const VSMap* in, const VSAPI* vsapi)
+		{
+			int err = 0;
+			const char* vfr = vsapi->mapGetData(in, "vfr", 0, &err);
+			return err ? nullptr : GetVFRTranslator(vfr);
+		}
+
+		static void VS_CC VobSubCreate(const VSMap* in, VSMap* out, void* userData, VSCore* core, const VSAPI* vsapi)
+		{
+			VSNode* node = vsapi->mapGetNode(in, "clip", 0, nullptr);
+			const char* fn = vsapi->mapGetData(in, "file", 0, nullptr);
+
+			CVapourSynthFilter::Create(DNew CVobSubVapourSynthFilter(node, vsapi, fn), "VobSub", out, core, vsapi);
+		}
+
+		static void VS_CC TextSubCreate(const VSMap* in, VSMap* out, void* userData, VSCore* core, const VSAPI* vsapi)
+		{
+			int err = 0;
+			VSNode* node = vsapi->mapGetNode(in, "clip", 0, nullptr);
+			const char* fn = vsapi->mapGetData(in, "file", 0, nullptr);
+			const int codePage = vsapi->mapGetIntSaturated(in, "defcodepage", 0, &err);
+			const double fps = vsapi->mapGetFloat(in, "fps", 0, &err);
+
+			CVapourSynthFilter::Create(
+				DNew CTextSubVapourSynthFilter(node, vsapi, fn, codePage, err ? -1.0f : (float)fps, GetVFRArg(in, vsapi)),
+				"TextSub", out, core, vsapi);
+		}
+
+		// Renders the subtitles over a black RGB24 clip of the given size.
+		// Unlike the AviSynth version the alpha channel is not exported.
+		static void VS_CC MaskSubCreate(const VSMap* in, VSMap* out, void* userData, VSCore* core, const VSAPI* vsapi)
+		{
+			int err = 0;
+			const double fps = vsapi->mapGetFloat(in, "fps", 0, &err);
+			if (err && !vsapi->mapNumElements(in, "vfr")) {
+				vsapi->mapSetError(out, "MaskSub: You must specify either fps or a VFR timecodes file");
+				return;
+			}
+
+			VSMap* args = vsapi->createMap();
+			vsapi->mapSetInt(args, "width", vsapi->mapGetInt(in, "width", 0, nullptr), maReplace);
+			vsapi->mapSetInt(args, "height", vsapi->mapGetInt(in, "height", 0, nullptr), maReplace);
+			vsapi->mapSetInt(args, "length", vsapi->mapGetInt(in, "length", 0, nullptr), maReplace);
+			vsapi->mapSetInt(args, "format", pfRGB24, maReplace);
+			vsapi->mapSetInt(args, "fpsnum", (int64_t)((err ? 25.0 : fps) * 1000 + 0.5), maReplace);
+			vsapi->mapSetInt(args, "fpsden", 1000, maReplace);
+
+			VSMap* ret = vsapi->invoke(vsapi->getPluginByID("com.vapoursynth.std", core), "BlankClip", args);
+			vsapi->freeMap(args);
+
+			if (const char* error = vsapi->mapGetError(ret)) {
+				vsapi->mapSetError(out, CStringA("MaskSub: ") + error);
+				vsapi->freeMap(ret);
+				return;
+			}
+
+			VSNode* node = vsapi->mapGetNode(ret, "clip", 0, nullptr);
+			vsapi->freeMap(ret);
+
+			const char* fn = vsapi->mapGetData(in, "file", 0, nullptr);
+			const int codePage = vsapi->mapGetIntSaturated(in, "defcodepage", 0, &err);
+
+			CVapourSynthFilter::Create(
+				DNew CTextSubVapourSynthFilter(node, vsapi, fn, err ? CP_ACP : codePage, -1.0f, GetVFRArg(in, vsapi)),
+				"MaskSub", out, core, vsapi);
+		}
+
+		VS_EXTERNAL_API(void) VapourSynthPluginInit2(VSPlugin* plugin, const VSPLUGINAPI* vspapi)
+		{
+			vspapi->configPlugin("org.mpc-be.vsfilter", "vsf", "MPC-BE VSFilter subtitle renderer",
+								 VS_MAKE_VERSION(1, 0), VAPOURSYNTH_API_VERSION, 0, plugin);
+			vspapi->registerFunction("VobSub", "clip:vnode;file:data;", "clip:vnode;", VobSubCreate, nullptr, plugin);
+			vspapi->registerFunction("TextSub", "clip:vnode;file:data;defcodepage:int:opt;fps:float:opt;vfr:data:opt;", "clip:vnode;", TextSubCreate, nullptr, plugin);
+			vspapi->registerFunction("MaskSub", "file:data;width:int;height:int;fps:float:opt;length:int;defcodepage:int:opt;vfr:data:opt;", "clip:vnode;", MaskSubCreate, nullptr, plugin);
+		}
+	}
 }
 
 UINT_PTR CALLBACK OpenHookProc(HWND hDlg, UINT uiMsg, WPARAM wParam, LPARAM lParam)